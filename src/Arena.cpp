@@ -0,0 +1,119 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#include "Arena.hpp"
+#include <new>
+#include <cstdint>
+
+namespace helper {
+
+  Arena::Arena(std::size_t chunkSize, std::size_t retain) : _chunkSize(chunkSize), _retain(retain), _chunks(),
+							     _current(0), _ptr(nullptr), _end(nullptr), _used(0) {
+  }
+
+  Arena::~Arena() {
+    for(const Chunk& c : _chunks)
+      ::operator delete(c.data);
+  }
+
+  /**
+   * @brief Release all the allocations, the objects allocated from the arena must be gone.
+   */
+  auto Arena::reset() -> void {
+    std::size_t kept = 0, n = 0;
+    for(; n < _chunks.size() && kept + _chunks[n].size <= _retain; ++n)
+      kept += _chunks[n].size;
+    for(std::size_t i = n; i < _chunks.size(); ++i)
+      ::operator delete(_chunks[i].data);
+    _chunks.resize(n);
+    _current = 0;
+    _used = 0;
+    _ptr = _chunks.empty() ? nullptr : _chunks[0].data;
+    _end = _chunks.empty() ? nullptr : _chunks[0].data + _chunks[0].size;
+  }
+
+  /**
+   * @brief Release all the allocations and give all the chunks back (idle owner).
+   */
+  auto Arena::release() -> void {
+    for(const Chunk& c : _chunks)
+      ::operator delete(c.data);
+    std::vector<Chunk>().swap(_chunks);
+    _current = 0;
+    _used = 0;
+    _ptr = _end = nullptr;
+  }
+
+  /**
+   * @brief Get the number of bytes allocated since the last reset.
+   * @return std::size_t
+   */
+  auto Arena::used() const -> std::size_t {
+    return _used;
+  }
+
+  /**
+   * @brief Get the number of bytes owned by the arena.
+   * @return std::size_t
+   */
+  auto Arena::capacity() const -> std::size_t {
+    std::size_t total = 0;
+    for(const Chunk& c : _chunks)
+      total += c.size;
+    return total;
+  }
+
+  /**
+   * @brief Switch to a chunk with at least the requested free space.
+   * @param bytes The requested size (alignment included).
+   */
+  auto Arena::next(std::size_t bytes) -> void {
+    std::size_t i = _ptr == nullptr ? 0 : _current + 1;
+    /* reuse a retained chunk if one is large enough */
+    std::size_t found = i;
+    while(found < _chunks.size() && _chunks[found].size < bytes) ++found;
+    if(found < _chunks.size()) {
+      if(found != i) std::swap(_chunks[found], _chunks[i]);
+    } else {
+      std::size_t size = bytes > _chunkSize ? bytes : _chunkSize;
+      Chunk c = { static_cast<char*>(::operator new(size)), size };
+      _chunks.insert(_chunks.begin() + i, c);
+    }
+    _current = i;
+    _ptr = _chunks[i].data;
+    _end = _ptr + _chunks[i].size;
+  }
+
+  auto Arena::do_allocate(std::size_t bytes, std::size_t alignment) -> void* {
+    std::uintptr_t p = reinterpret_cast<std::uintptr_t>(_ptr);
+    std::size_t pad = (alignment - (p & (alignment - 1))) & (alignment - 1);
+    if(_ptr == nullptr || static_cast<std::size_t>(_end - _ptr) < bytes + pad) {
+      next(bytes + alignment);
+      p = reinterpret_cast<std::uintptr_t>(_ptr);
+      pad = (alignment - (p & (alignment - 1))) & (alignment - 1);
+    }
+    char* r = _ptr + pad;
+    _ptr = r + bytes;
+    _used += bytes + pad;
+    return r;
+  }
+
+  auto Arena::do_deallocate(void* p, std::size_t bytes, std::size_t alignment) -> void {
+    (void)alignment;
+    /* only the last allocation can be given back (typical of a growing container) */
+    if(static_cast<char*>(p) + bytes == _ptr) {
+      _ptr = static_cast<char*>(p);
+      _used -= bytes;
+    }
+  }
+
+  auto Arena::do_is_equal(const std::pmr::memory_resource& other) const noexcept -> bool {
+    return this == &other;
+  }
+
+} /* namespace helper */
@@ -0,0 +1,134 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <memory_resource>
+#include <string>
+#include <ostream>
+#include <streambuf>
+#include <vector>
+#include <cstddef>
+
+namespace helper {
+
+  constexpr std::size_t ARENA_CHUNK  = 0x10000;
+  constexpr std::size_t ARENA_RETAIN = 0x1000000;
+
+  /**
+   * @brief Bump-pointer memory resource, the memory is released all at once by reset.
+   * The chunks are kept between two resets (up to the retain limit), so a steady state
+   * request does not call the global allocator.
+   */
+  class Arena : public std::pmr::memory_resource {
+    public:
+      /**
+       * @param chunkSize The default chunk size.
+       * @param retain The maximum number of bytes kept by reset.
+       */
+      Arena(std::size_t chunkSize = ARENA_CHUNK, std::size_t retain = ARENA_RETAIN);
+      virtual ~Arena();
+      Arena(const Arena&) = delete;
+      Arena& operator=(const Arena&) = delete;
+
+      /**
+       * @brief Release all the allocations, the objects allocated from the arena must be gone.
+       */
+      auto reset() -> void;
+
+      /**
+       * @brief Release all the allocations and give all the chunks back (idle owner).
+       */
+      auto release() -> void;
+
+      /**
+       * @brief Get the number of bytes allocated since the last reset.
+       * @return std::size_t
+       */
+      auto used() const -> std::size_t;
+
+      /**
+       * @brief Get the number of bytes owned by the arena.
+       * @return std::size_t
+       */
+      auto capacity() const -> std::size_t;
+
+    protected:
+      auto do_allocate(std::size_t bytes, std::size_t alignment) -> void* override;
+      auto do_deallocate(void* p, std::size_t bytes, std::size_t alignment) -> void override;
+      auto do_is_equal(const std::pmr::memory_resource& other) const noexcept -> bool override;
+
+    private:
+      struct Chunk {
+	  char* data;
+	  std::size_t size;
+      };
+      std::size_t _chunkSize;
+      std::size_t _retain;
+      std::vector<Chunk> _chunks;
+      std::size_t _current;
+      char* _ptr;
+      char* _end;
+      std::size_t _used;
+
+      /**
+       * @brief Switch to a chunk with at least the requested free space.
+       * @param bytes The requested size (alignment included).
+       */
+      auto next(std::size_t bytes) -> void;
+  };
+
+  /**
+   * @brief Stream buffer appending to a pmr string.
+   */
+  class ArenaStringBuf : public std::streambuf {
+    public:
+      ArenaStringBuf(std::pmr::string& str) : _str(str) { }
+
+      /**
+       * @brief Get the underlying string.
+       * @return std::pmr::string&
+       */
+      auto str() -> std::pmr::string& { return _str; }
+
+    protected:
+      auto overflow(int_type c) -> int_type override {
+	if(c != traits_type::eof()) _str.push_back(static_cast<char>(c));
+	return c;
+      }
+
+      auto xsputn(const char* s, std::streamsize n) -> std::streamsize override {
+	_str.append(s, n);
+	return n;
+      }
+
+    private:
+      std::pmr::string& _str;
+  };
+
+  /**
+   * @brief Output stream appending to a pmr string (usually backed by an Arena).
+   */
+  class ArenaStream : public std::ostream {
+    public:
+      ArenaStream(std::pmr::string& str) : std::ostream(nullptr), _buf(str) { rdbuf(&_buf); }
+
+      /**
+       * @brief Get the underlying string.
+       * @return std::pmr::string&
+       */
+      auto str() -> std::pmr::string& { return _buf.str(); }
+
+    private:
+      ArenaStringBuf _buf;
+  };
+
+} /* namespace helper */
+
+#endif /* __ARENA_H__ */
@@ -0,0 +1,163 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#include "BodyFraming.hpp"
+#include <charconv>
+#include <algorithm>
+
+namespace net {
+  namespace http {
+
+    BodyFraming::BodyFraming() : _end(BodyEnd::CLOSE), _done(false), _remaining(0), _state(ChunkState::SIZE), _digits(false) {
+    }
+
+    /**
+     * @brief Start a new body from the complete response headers.
+     * @param hdr The response headers.
+     * @param head true for the response of a HEAD request.
+     */
+    auto BodyFraming::start(HttpHeader& hdr, bool head) -> void {
+      _remaining = 0;
+      _state = ChunkState::SIZE;
+      _digits = false;
+      std::size_t code = hdr.code();
+      std::string_view cl = hdr.value("Content-Length");
+      if(head || code == 204 || code == 304)
+	_end = BodyEnd::NONE;
+      /* the chunks take precedence over Content-Length */
+      else if(hdr.equals("Transfer-Encoding", "chunked"))
+	_end = BodyEnd::CHUNKED;
+      else if(!cl.empty() && std::from_chars(cl.data(), cl.data() + cl.size(), _remaining).ec == std::errc())
+	_end = BodyEnd::LENGTH;
+      else
+	_end = BodyEnd::CLOSE;
+      _done = _end == BodyEnd::NONE || (_end == BodyEnd::LENGTH && _remaining == 0);
+    }
+
+    /**
+     * @brief Scan the next body bytes.
+     * @param data The data received after the headers.
+     * @return The number of bytes belonging to the body, the rest follows its end.
+     */
+    auto BodyFraming::feed(std::string_view data) -> std::size_t {
+      if(_done) return 0;
+      switch(_end) {
+	case BodyEnd::LENGTH: {
+	  std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(_remaining, data.size()));
+	  _remaining -= n;
+	  _done = _remaining == 0;
+	  return n;
+	}
+	case BodyEnd::CHUNKED:
+	  return chunked(data);
+	default:
+	  return data.size();
+      }
+    }
+
+    /**
+     * @brief Scan the next bytes of a chunked body.
+     * @param data The data.
+     * @return The number of bytes belonging to the body.
+     */
+    auto BodyFraming::chunked(std::string_view data) -> std::size_t {
+      std::size_t i = 0;
+      while(i < data.size() && _state != ChunkState::DONE) {
+	char c = data[i];
+	switch(_state) {
+	  case ChunkState::SIZE: {
+	    int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+	    if(digit >= 0 && _remaining <= (UINT64_MAX >> 4)) {
+	      _remaining = (_remaining << 4) | static_cast<std::uint64_t>(digit);
+	      _digits = true;
+	    } else if(_digits && (c == ';' || c == ' ' || c == '\t'))
+	      _state = ChunkState::EXTENSION;
+	    else if(_digits && c == '\r')
+	      _state = ChunkState::SIZE_LF;
+	    else if(_digits && c == '\n')
+	      _state = _remaining ? ChunkState::DATA : ChunkState::TRAILER;
+	    else {
+	      /* not a chunk size, the connection delimits the body */
+	      _end = BodyEnd::CLOSE;
+	      return data.size();
+	    }
+	    ++i;
+	    break;
+	  }
+	  case ChunkState::EXTENSION:
+	    if(c == '\r') _state = ChunkState::SIZE_LF;
+	    else if(c == '\n') _state = _remaining ? ChunkState::DATA : ChunkState::TRAILER;
+	    ++i;
+	    break;
+	  case ChunkState::SIZE_LF:
+	    if(c == '\n') _state = _remaining ? ChunkState::DATA : ChunkState::TRAILER;
+	    ++i;
+	    break;
+	  case ChunkState::DATA: {
+	    std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(_remaining, data.size() - i));
+	    _remaining -= n;
+	    i += n;
+	    if(!_remaining) _state = ChunkState::DATA_CR;
+	    break;
+	  }
+	  case ChunkState::DATA_CR:
+	    /* a bare '\n' is tolerated */
+	    _state = c == '\r' ? ChunkState::DATA_LF : ChunkState::SIZE;
+	    if(c == '\r' || c == '\n') ++i;
+	    _digits = false;
+	    break;
+	  case ChunkState::DATA_LF:
+	    if(c == '\n') ++i;
+	    _state = ChunkState::SIZE;
+	    break;
+	  case ChunkState::TRAILER:
+	    _state = c == '\r' ? ChunkState::FINAL_LF : c == '\n' ? ChunkState::DONE : ChunkState::FIELD;
+	    ++i;
+	    break;
+	  case ChunkState::FIELD:
+	    if(c == '\n') _state = ChunkState::TRAILER;
+	    ++i;
+	    break;
+	  case ChunkState::FINAL_LF:
+	    if(c == '\n') ++i;
+	    _state = ChunkState::DONE;
+	    break;
+	  default:
+	    break;
+	}
+      }
+      _done = _state == ChunkState::DONE;
+      return i;
+    }
+
+    /**
+     * @brief Test if the body is complete.
+     * @return bool
+     */
+    auto BodyFraming::done() const -> bool {
+      return _done;
+    }
+
+    /**
+     * @brief Get the end of the current body.
+     * @return BodyEnd
+     */
+    auto BodyFraming::end() const -> BodyEnd {
+      return _end;
+    }
+
+    /**
+     * @brief Get the number of body bytes still expected (BodyEnd::LENGTH).
+     * @return std::uint64_t
+     */
+    auto BodyFraming::remaining() const -> std::uint64_t {
+      return _end == BodyEnd::LENGTH ? _remaining : 0;
+    }
+
+  } /* namespace http */
+} /* namespace net */
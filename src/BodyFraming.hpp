@@ -0,0 +1,104 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#ifndef __BODYFRAMING_H__
+#define __BODYFRAMING_H__
+
+#include "HttpHeader.hpp"
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+
+namespace net {
+  namespace http {
+
+    /**
+     * @brief How the end of a response body is known.
+     */
+    enum class BodyEnd : unsigned char {
+	NONE = 0, /* no body (HEAD, 204, 304) */
+	LENGTH,   /* Content-Length bytes */
+	CHUNKED,  /* terminal zero-size chunk and the trailers */
+	CLOSE     /* end of the connection */
+    };
+
+    /**
+     * @brief Incremental tracking of the end of a response body, so that the reader stops at
+     * the last byte instead of waiting for the server to close the connection.
+     * The chunks are only scanned (sizes, extensions, trailers), the decoding is left to the client.
+     * A malformed chunk size falls back on the end of the connection.
+     */
+    class BodyFraming {
+      public:
+	BodyFraming();
+	virtual ~BodyFraming() = default;
+
+	/**
+	 * @brief Start a new body from the complete response headers.
+	 * @param hdr The response headers.
+	 * @param head true for the response of a HEAD request.
+	 */
+	auto start(HttpHeader& hdr, bool head) -> void;
+
+	/**
+	 * @brief Scan the next body bytes.
+	 * @param data The data received after the headers.
+	 * @return The number of bytes belonging to the body, the rest follows its end.
+	 */
+	auto feed(std::string_view data) -> std::size_t;
+
+	/**
+	 * @brief Test if the body is complete.
+	 * @return bool
+	 */
+	auto done() const -> bool;
+
+	/**
+	 * @brief Get the end of the current body.
+	 * @return BodyEnd
+	 */
+	auto end() const -> BodyEnd;
+
+	/**
+	 * @brief Get the number of body bytes still expected (BodyEnd::LENGTH).
+	 * @return std::uint64_t
+	 */
+	auto remaining() const -> std::uint64_t;
+
+      private:
+	enum class ChunkState : unsigned char {
+	    SIZE = 0,   /* hexadecimal size */
+	    EXTENSION,  /* ';' up to the end of the size line */
+	    SIZE_LF,    /* '\n' of the size line */
+	    DATA,       /* chunk data */
+	    DATA_CR,    /* '\r' after the data */
+	    DATA_LF,    /* '\n' after the data */
+	    TRAILER,    /* start of a trailer line, or of the final empty line */
+	    FIELD,      /* inside a trailer line */
+	    FINAL_LF,   /* '\n' of the final empty line */
+	    DONE
+	};
+
+	BodyEnd _end;
+	bool _done;
+	std::uint64_t _remaining;
+	ChunkState _state;
+	bool _digits;
+
+	/**
+	 * @brief Scan the next bytes of a chunked body.
+	 * @param data The data.
+	 * @return The number of bytes belonging to the body.
+	 */
+	auto chunked(std::string_view data) -> std::size_t;
+    };
+
+  } /* namespace http */
+} /* namespace net */
+
+#endif /* __BODYFRAMING_H__ */
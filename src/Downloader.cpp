@@ -0,0 +1,322 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#include "Downloader.hpp"
+#include "Helper.hpp"
+#include "Trace.hpp"
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <charconv>
+#include <cstring>
+#include <iomanip>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace net {
+  namespace http {
+
+    using std::string;
+    using std::string_view;
+    using clock = std::chrono::steady_clock;
+
+    /**
+     * @brief Header of the journal, followed by one 64-bit count of written bytes per range.
+     */
+    struct JournalHeader {
+	char magic[8];
+	std::uint64_t size;
+	std::uint32_t ranges;
+	std::uint32_t reserved;
+	char validator[112];
+    };
+    static constexpr char JOURNAL_MAGIC[8] = { 'H', 'T', 'T', 'P', 'U', 'R', 'N', 'G' };
+
+    /**
+     * @brief Parse a number of a header value.
+     * @param s The value.
+     * @param value The number.
+     * @return false if the value is not a number.
+     */
+    static auto number(string_view s, std::uint64_t& value) -> bool {
+      return !s.empty() && std::from_chars(s.data(), s.data() + s.size(), value).ec == std::errc();
+    }
+
+    /**
+     * @brief Throw the last libc error.
+     * @param message The message.
+     */
+    [[noreturn]] static auto fail(const string& message) -> void {
+      throw HttpClientException(message + strerror(errno));
+    }
+
+    Downloader::Downloader(const string& appname, const HttpClientConnect& connect, const DownloadConfig& config)
+      : _appname(appname), _connect(connect), _config(config), _fd(-1), _journal(-1), _size(0), _ranged(false),
+	_validator(), _starts(), _done(), _resumed(0), _downloaded(0), _elapsed(0.0) {
+      if(_config.output.empty()) throw HttpClientException("Invalid download file");
+      if(_config.connections == 0) _config.connections = DOWNLOAD_CONNECTIONS;
+      /* the ranges are written as received */
+      _connect.method = "GET";
+      _connect.gzip = false;
+      _connect.print_query = _connect.print_chunk = _connect.print_raw_resp = _connect.print_hex = false;
+      _connect.print_nothing = true;
+    }
+
+    Downloader::~Downloader() {
+      if(_fd != -1) ::close(_fd);
+      if(_journal != -1) ::close(_journal);
+    }
+
+    /**
+     * @brief Download the resource, the journal is kept if a range fails.
+     */
+    auto Downloader::run() -> void {
+      const clock::time_point start = clock::now();
+      if((_fd = ::open(_config.output.c_str(), O_RDWR | O_CREAT, 0644)) == -1)
+	fail("Unable to open the file " + _config.output + ": ");
+      probe();
+      if(_ranged) {
+	journal();
+	/* the blocks are reserved up front, the ranges do not fragment the file */
+	if(::fallocate(_fd, 0, 0, static_cast<off_t>(_size)) == -1 && errno != EOPNOTSUPP)
+	  fail("Unable to allocate the file " + _config.output + ": ");
+	if(::ftruncate(_fd, static_cast<off_t>(_size)) == -1)
+	  fail("Unable to resize the file " + _config.output + ": ");
+	std::mutex lock;
+	string error;
+	std::vector<std::thread> workers;
+	for(std::size_t i = 0; i < _starts.size(); ++i)
+	  workers.emplace_back([this, i, &lock, &error]() {
+	      Trace::track(static_cast<std::uint32_t>(i + 1), "range " + std::to_string(i));
+	      try {
+		fetch(i);
+	      } catch(const std::exception& e) {
+		std::lock_guard<std::mutex> guard(lock);
+		error = "Range " + std::to_string(i) + ": " + e.what();
+	      }
+	    });
+	for(std::thread& t : workers) t.join();
+	if(!error.empty())
+	  throw HttpClientException(error + " (resume with the same command)");
+	/* complete, the journal is useless */
+	::close(_journal);
+	_journal = -1;
+	::unlink((_config.output + ".journal").c_str());
+      }
+      _elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    }
+
+    /**
+     * @brief Get the size and the range support of the resource, the body is written
+     * at once if the server does not serve ranges.
+     */
+    auto Downloader::probe() -> void {
+      HttpClientConnect cnx = _connect;
+      cnx.headers["Range"] = "bytes=0-0";
+      HttpClient client(_appname);
+      string data;
+      client.open(cnx, data);
+      HttpHeader& hdr = client.getHttpHeader();
+      _validator = string(hdr.value("ETag"));
+      if(_validator.empty()) _validator = string(hdr.value("Last-Modified"));
+      if(_validator.size() >= sizeof(JournalHeader::validator)) _validator.clear();
+      if(hdr.code() == 206) {
+	/* Content-Range: bytes 0-0/<size> */
+	string_view range = hdr.value("Content-Range");
+	std::size_t slash = range.find('/');
+	if(slash == string_view::npos || !number(range.substr(slash + 1), _size))
+	  throw HttpClientException("Invalid Content-Range: " + string(range));
+	_ranged = true;
+	return;
+      }
+      if(hdr.code() != 200)
+	throw HttpClientException("Unexpected response code " + std::to_string(hdr.code()));
+      /* no ranges, the whole body on this connection */
+      if(hdr.equals("Transfer-Encoding", "chunked") || hdr.contains("Content-Encoding")) {
+	/* decoded by the client */
+	cnx.headers.erase("Range");
+	client.connect(cnx);
+	const string& plain = client.getPlainText();
+	if(::ftruncate(_fd, 0) == -1)
+	  fail("Unable to resize the file " + _config.output + ": ");
+	write(plain, 0);
+	_size = plain.size();
+	_downloaded += _size;
+	return;
+      }
+      std::uint64_t length = UINT64_MAX;
+      if(number(hdr.value("Content-Length"), length)
+	 && ::fallocate(_fd, 0, 0, static_cast<off_t>(length)) == -1 && errno != EOPNOTSUPP)
+	fail("Unable to allocate the file " + _config.output + ": ");
+      std::uint64_t offset = 0;
+      while(offset < length) {
+	if(data.empty()) client.read(data);
+	if(data.empty()) break;
+	std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(data.size(), length - offset));
+	write(string_view(data).substr(0, n), offset);
+	offset += n;
+	data.clear();
+      }
+      if(length != UINT64_MAX && offset < length)
+	throw HttpClientException("Connection closed after " + std::to_string(offset) + " of " + std::to_string(length) + " bytes");
+      if(::ftruncate(_fd, static_cast<off_t>(offset)) == -1)
+	fail("Unable to resize the file " + _config.output + ": ");
+      _size = offset;
+      _downloaded += offset;
+    }
+
+    /**
+     * @brief Load the journal of a previous run or create a new one.
+     */
+    auto Downloader::journal() -> void {
+      string path = _config.output + ".journal";
+      if((_journal = ::open(path.c_str(), O_RDWR | O_CREAT, 0644)) == -1)
+	fail("Unable to open the journal " + path + ": ");
+      JournalHeader header;
+      std::size_t ranges = 0;
+      if(::pread(_journal, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header))
+	 && !memcmp(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) && header.size == _size
+	 && header.ranges > 0 && string_view(header.validator, strnlen(header.validator, sizeof(header.validator))) == _validator) {
+	/* same resource, the previous layout of the ranges is kept */
+	ranges = header.ranges;
+	_done.assign(ranges, 0);
+	ssize_t size = static_cast<ssize_t>(ranges * sizeof(std::uint64_t));
+	if(::pread(_journal, _done.data(), size, sizeof(header)) != size)
+	  _done.assign(ranges, 0);
+      } else {
+	ranges = static_cast<std::size_t>(std::max<std::uint64_t>(1, std::min<std::uint64_t>(_config.connections, _size)));
+	_done.assign(ranges, 0);
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+	header.size = _size;
+	header.ranges = static_cast<std::uint32_t>(ranges);
+	memcpy(header.validator, _validator.data(), _validator.size());
+	ssize_t size = static_cast<ssize_t>(ranges * sizeof(std::uint64_t));
+	if(::ftruncate(_journal, 0) == -1 || ::pwrite(_journal, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))
+	   || ::pwrite(_journal, _done.data(), size, sizeof(header)) != size)
+	  fail("Unable to write the journal " + path + ": ");
+      }
+      _starts.resize(ranges);
+      _resumed = 0;
+      for(std::size_t i = 0; i < ranges; ++i) {
+	_starts[i] = _size * i / ranges;
+	std::uint64_t length = _size * (i + 1) / ranges - _starts[i];
+	_done[i] = std::min(_done[i], length);
+	_resumed += _done[i];
+      }
+    }
+
+    /**
+     * @brief Download what remains of a range.
+     * @param index The range index.
+     */
+    auto Downloader::fetch(std::size_t index) -> void {
+      const std::uint64_t end = _size * (index + 1) / _starts.size();
+      std::uint64_t& done = _done[index];
+      HttpClient client(_appname);
+      HttpClientConnect cnx = _connect;
+      string data;
+      for(unsigned int attempt = 1;; ++attempt) {
+	std::uint64_t offset = _starts[index] + done;
+	if(offset >= end) break;
+	try {
+	  cnx.headers["Range"] = "bytes=" + std::to_string(offset) + "-" + std::to_string(end - 1);
+	  /* a modified resource is sent whole (200) instead of mixed with the previous one */
+	  if(!_validator.empty()) cnx.headers["If-Range"] = _validator;
+	  client.open(cnx, data);
+	  HttpHeader& hdr = client.getHttpHeader();
+	  if(hdr.code() != 206)
+	    throw HttpClientException("Unexpected response code " + std::to_string(hdr.code()) + " (resource modified?)");
+	  string_view range = hdr.value("Content-Range");
+	  std::uint64_t first;
+	  if(range.substr(0, 6) != "bytes " || !number(range.substr(6, range.find('-') - 6), first) || first != offset)
+	    throw HttpClientException("Invalid Content-Range: " + string(range));
+	  std::uint64_t journaled = done;
+	  while(offset < end) {
+	    /* the connection is not read up to its close once the range is complete */
+	    if(data.empty()) client.read(data);
+	    if(data.empty()) break;
+	    std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(data.size(), end - offset));
+	    write(string_view(data).substr(0, n), offset);
+	    offset += n;
+	    done += n;
+	    _downloaded += n;
+	    if(done - journaled >= DOWNLOAD_JOURNAL_STEP) {
+	      checkpoint(index, done);
+	      journaled = done;
+	    }
+	    data.clear();
+	  }
+	  checkpoint(index, done);
+	  if(offset < end)
+	    throw HttpClientException("Connection closed " + std::to_string(end - offset) + " bytes before the end");
+	} catch(const HttpClientException&) {
+	  if(attempt >= DOWNLOAD_ATTEMPTS) throw;
+	} catch(const EasySocketException&) {
+	  if(attempt >= DOWNLOAD_ATTEMPTS) throw;
+	}
+      }
+      client.reset();
+    }
+
+    /**
+     * @brief Save the progress of a range in the journal.
+     * @param index The range index.
+     * @param done The number of bytes written.
+     */
+    auto Downloader::checkpoint(std::size_t index, std::uint64_t done) -> void {
+      const off_t entry = static_cast<off_t>(sizeof(JournalHeader) + index * sizeof(std::uint64_t));
+      ssize_t w;
+      while((w = ::pwrite(_journal, &done, sizeof(done), entry)) < 0 && errno == EINTR);
+      /* a torn entry would resume from a wrong offset */
+      if(w != static_cast<ssize_t>(sizeof(done))) {
+	if(w >= 0) errno = EIO;
+	fail("Unable to write the journal " + _config.output + ".journal: ");
+      }
+    }
+
+    /**
+     * @brief Write some data at an offset of the destination file.
+     * @param data The data.
+     * @param offset The offset.
+     */
+    auto Downloader::write(string_view data, std::uint64_t offset) -> void {
+      while(!data.empty()) {
+	ssize_t w = ::pwrite(_fd, data.data(), data.size(), static_cast<off_t>(offset));
+	if(w < 0) {
+	  if(errno == EINTR) continue;
+	  fail("Unable to write the file " + _config.output + ": ");
+	}
+	data.remove_prefix(static_cast<std::size_t>(w));
+	offset += static_cast<std::uint64_t>(w);
+      }
+    }
+
+    /**
+     * @brief Print the summary (size, ranges, resumed bytes and throughput).
+     * @param os The output stream.
+     */
+    auto Downloader::report(std::ostream& os) const -> void {
+      std::ios_base::fmtflags flags = os.flags();
+      std::streamsize precision = os.precision();
+      os << std::fixed << std::setprecision(3);
+      os << "Downloaded " << _config.output << ": " << helper::Helper::toHumanStringSize(_size);
+      if(_ranged) os << " in " << _starts.size() << " range(s)";
+      else os << " (no ranges, single connection)";
+      os << std::endl;
+      if(_resumed)
+	os << "Resumed: " << helper::Helper::toHumanStringSize(_resumed) << " already written" << std::endl;
+      double bytes = static_cast<double>(_downloaded.load());
+      os << "Transferred " << helper::Helper::toHumanStringSize(_downloaded.load()) << " in " << _elapsed << " s ("
+	 << (_elapsed > 0.0 ? bytes * 8 / _elapsed / 1e9 : 0.0) << " Gbit/s)" << std::endl;
+      os.flags(flags);
+      os.precision(precision);
+    }
+
+  } /* namespace http */
+} /* namespace net */
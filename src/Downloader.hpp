@@ -0,0 +1,118 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#ifndef __DOWNLOADER_H__
+#define __DOWNLOADER_H__
+
+#include "HttpClient.hpp"
+#include <ostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+
+namespace net {
+  namespace http {
+
+    /* default number of ranges (and connections) */
+    constexpr unsigned int DOWNLOAD_CONNECTIONS = 4;
+    /* attempts of a range before giving up */
+    constexpr unsigned int DOWNLOAD_ATTEMPTS = 3;
+    /* bytes written between two updates of the journal entry of a range */
+    constexpr std::uint64_t DOWNLOAD_JOURNAL_STEP = 0x400000;
+
+    struct DownloadConfig {
+	/**
+	 * @param output The destination file (the journal is output + ".journal").
+	 * @param connections The number of ranges, one connection each (0 for DOWNLOAD_CONNECTIONS).
+	 */
+	std::string output;
+	unsigned int connections;
+    };
+
+    /**
+     * @brief Parallel ranged download into a preallocated file.
+     * A first GET of the byte 0 gives the size (Content-Range) and tells if the server
+     * serves ranges (206), the body is then split into N ranges fetched concurrently over
+     * N connections and written in place with pwrite. The progress of each range is kept
+     * in a journal, so that an interrupted run resumes where it stopped as long as the
+     * size and the validator (ETag or Last-Modified) of the resource are unchanged.
+     * A server without ranges is downloaded on a single connection.
+     */
+    class Downloader {
+      public:
+	/**
+	 * @param appname The application name (User-Agent).
+	 * @param connect The request, copied for each range with the printing disabled.
+	 * @param config The download configuration.
+	 */
+	Downloader(const std::string& appname, const HttpClientConnect& connect, const DownloadConfig& config);
+	virtual ~Downloader();
+
+	/**
+	 * @brief Download the resource, the journal is kept if a range fails.
+	 */
+	auto run() -> void;
+
+	/**
+	 * @brief Print the summary (size, ranges, resumed bytes and throughput).
+	 * @param os The output stream.
+	 */
+	auto report(std::ostream& os) const -> void;
+
+      private:
+	std::string _appname;
+	HttpClientConnect _connect;
+	DownloadConfig _config;
+	int _fd;
+	int _journal;
+	std::uint64_t _size;
+	bool _ranged;
+	std::string _validator;
+	std::vector<std::uint64_t> _starts;
+	std::vector<std::uint64_t> _done;
+	std::uint64_t _resumed;
+	std::atomic<std::uint64_t> _downloaded;
+	double _elapsed;
+
+	/**
+	 * @brief Get the size and the range support of the resource, the body is written
+	 * at once if the server does not serve ranges.
+	 */
+	auto probe() -> void;
+
+	/**
+	 * @brief Load the journal of a previous run or create a new one.
+	 */
+	auto journal() -> void;
+
+	/**
+	 * @brief Download what remains of a range.
+	 * @param index The range index.
+	 */
+	auto fetch(std::size_t index) -> void;
+
+	/**
+	 * @brief Save the progress of a range in the journal.
+	 * @param index The range index.
+	 * @param done The number of bytes written.
+	 */
+	auto checkpoint(std::size_t index, std::uint64_t done) -> void;
+
+	/**
+	 * @brief Write some data at an offset of the destination file.
+	 * @param data The data.
+	 * @param offset The offset.
+	 */
+	auto write(std::string_view data, std::uint64_t offset) -> void;
+    };
+
+  } /* namespace http */
+} /* namespace net */
+
+#endif /* __DOWNLOADER_H__ */
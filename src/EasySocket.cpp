@@ -7,14 +7,28 @@
 *******************************************************************************
 */
 #include "EasySocket.hpp" 
+#include "SlabPool.hpp"
+#include "PerfCounters.hpp"
+#include "Uring.hpp"
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <cstring>
+#include <mutex>
+#include <poll.h>
 #include <sstream>  
 #include <openssl/err.h> 
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netdb.h>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
+#include <cstddef>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <unistd.h>
@@ -52,6 +66,17 @@ static int easy_socket_dumb_callback(int preverify_ok, X509_STORE_CTX *ctx) {
 
 namespace net {
   unsigned long EasySocket::_lib_ssl_errno = 0L;
+  bool EasySocket::_lowMemory = false;
+  bool EasySocket::_tcpInfoEnabled = false;
+  bool EasySocket::_timestamping = false;
+  IoBackend EasySocket::_backend = IoBackend::SOCKET;
+  SocketProfile EasySocket::_profile = DEFAULT_PROFILE;
+  std::string EasySocket::_unixPath;
+  SSL_CTX* EasySocket::_sharedCtx = nullptr;
+  static std::mutex sharedCtxLock;
+  /* the last session of each peer ("host:port"), resumed by the next connection to it */
+  static std::map<std::string, SSL_SESSION*, std::less<>> sessions;
+  static std::mutex sessionsLock;
   constexpr unsigned short PORT_HTTP       = 80;
   constexpr unsigned short PORT_HTTPS      = 443;
 
@@ -60,6 +85,10 @@ namespace net {
    * @return false if the initialization fail, true else.
    */
   auto EasySocket::loadSSL() -> bool {
+#ifdef OPENSSL_INIT_NO_ATEXIT
+    /* the sockets may still be open when the atexit handlers run, unloadSSL does the cleanup */
+    OPENSSL_init_ssl(OPENSSL_INIT_NO_ATEXIT | OPENSSL_INIT_LOAD_SSL_STRINGS | OPENSSL_INIT_LOAD_CRYPTO_STRINGS, NULL);
+#endif
     OpenSSL_add_all_algorithms();
     ERR_load_BIO_strings();
     ERR_load_crypto_strings();
@@ -73,6 +102,15 @@ namespace net {
    * @brief Release the SSL stack, should be called only once in your application.
    */
   auto EasySocket::unloadSSL() -> void {
+    if(_sharedCtx != nullptr) {
+      SSL_CTX_free(_sharedCtx);
+      _sharedCtx = nullptr;
+    }
+    {
+      std::lock_guard<std::mutex> lock(sessionsLock);
+      for(auto& session : sessions) SSL_SESSION_free(session.second);
+      sessions.clear();
+    }
     ERR_free_strings();
     EVP_cleanup();
   }
@@ -84,7 +122,120 @@ namespace net {
     return std::string(ERR_error_string(_lib_ssl_errno, NULL));
   }
 
-  EasySocket::EasySocket() : _fd(-1), _useSSL(false), _open(false), _ctx(nullptr), _ssl(nullptr) {
+  /**
+   * @brief Change the low-memory mode of the next connections: shared SSL context,
+   * OpenSSL buffers released while idle and TLS records received through a slab
+   * borrowed from the SlabPool of the thread.
+   * @param lowMemory The mode.
+   */
+  auto EasySocket::lowMemory(bool lowMemory) -> void {
+    _lowMemory = lowMemory;
+  }
+
+  /**
+   * @brief Get the low-memory mode.
+   * @return bool
+   */
+  auto EasySocket::lowMemory() -> bool {
+    return _lowMemory;
+  }
+
+  /**
+   * @brief Create a new client SSL context.
+   * @return The context or nullptr.
+   */
+  auto EasySocket::newContext() -> SSL_CTX* {
+    /* We first need to establish what sort of */
+    /* connection we know how to make. We can use one of */
+    /* SSLv23_client_method(), SSLv2_client_method() and */
+    /* SSLv3_client_method(). */
+    /*  Try to create a new SSL context. */
+    SSL_CTX* ctx = SSL_CTX_new(SSLv23_client_method());
+    if(ctx == nullptr) return nullptr;
+    SSL_CTX_set_mode(ctx, SSL_MODE_AUTO_RETRY);
+
+    /* Set it up so tha we will connect to *any* site, regardless of their certificate. */
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, easy_socket_dumb_callback);
+    /* Enable bug support hacks. */
+    SSL_CTX_set_options(ctx, SSL_OP_ALL);
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+    /* Many servers close the connection without close_notify. */
+    SSL_CTX_set_options(ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+    if(_lowMemory) {
+      SSL_CTX_set_mode(ctx, SSL_MODE_RELEASE_BUFFERS);
+      /* the sessions are kept per peer by storeSession (the internal cache is server-side only),
+	 a resumed handshake skips the certificate and the key exchange */
+      SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+      SSL_CTX_sess_set_new_cb(ctx, storeSession);
+    }
+    return ctx;
+  }
+
+  /**
+   * @brief Keep the new session of a connection for the next connection to the same peer
+   * (with TLS 1.3 the tickets come after the handshake, with the first reads).
+   * @param ssl The SSL object of the connection.
+   * @param session The session.
+   * @return 1 if the session is kept.
+   */
+  auto EasySocket::storeSession(SSL* ssl, SSL_SESSION* session) -> int {
+    EasySocket* socket = static_cast<EasySocket*>(SSL_get_app_data(ssl));
+    if(socket == nullptr || !SSL_SESSION_is_resumable(session)) return 0;
+    std::lock_guard<std::mutex> lock(sessionsLock);
+    auto found = sessions.find(socket->_peer);
+    if(found == sessions.end())
+      sessions.emplace(socket->_peer, session);
+    else {
+      SSL_SESSION_free(found->second);
+      found->second = session;
+    }
+    return 1;
+  }
+
+  /**
+   * @brief Test if the handshake of the connection resumed a previous session.
+   * @return bool
+   */
+  auto EasySocket::sessionReused() -> bool {
+    return _resumed;
+  }
+
+  EasySocket::EasySocket() : _fd(-1), _useSSL(false), _open(false), _ctx(nullptr), _ssl(nullptr),
+			     _eof(false), _resumed(false), _budget(0), _memoryPeak(0), _timings(), _tcpInfo(), _stamps(), _slot(-1), _rbio(nullptr), _wbio(nullptr), _out(), _peer() {
+  }
+
+  /**
+   * @brief Change the per-connection memory budget: the bytes kept by the client and the live buffers
+    * of the connection (TLS BIOs and send buffer), checked by account.
+   * @param budget The budget in bytes, 0 for no limit.
+   */
+  auto EasySocket::budget(std::size_t budget) -> void {
+    _budget = budget;
+  }
+
+  /**
+   * @brief Get the peak memory used by the connection (see account).
+   * @return std::size_t
+   */
+  auto EasySocket::memoryPeak() -> std::size_t {
+    return _memoryPeak;
+  }
+
+  /**
+    * @brief Check the memory in use against the budget: the bytes kept by the caller (receive
+    * buffer and buffered response) and the live buffers of the connection.
+    * @param kept The bytes kept by the caller.
+    */
+  auto EasySocket::account(std::size_t kept) -> void {
+    std::size_t used = kept + _out.capacity();
+    if(_ssl != nullptr) used += BIO_ctrl_pending(_rbio) + BIO_ctrl_pending(_wbio);
+    if(used > _memoryPeak) _memoryPeak = used;
+    if(_budget && used > _budget) {
+      std::ostringstream oss;
+      oss << "[[" << __LINE__ << "]] Memory budget exceeded (" << used << " > " << _budget << ")";
+      throw EasySocketException(oss.str());
+    }
   }
 
   EasySocket::~EasySocket() {
@@ -96,66 +247,316 @@ namespace net {
    */
   auto EasySocket::disconnect() -> void {
     if(_ctx != nullptr) {
-      SSL_CTX_free(_ctx);   
+      /* the shared context is released by unloadSSL */
+      if(_ctx != _sharedCtx) SSL_CTX_free(_ctx);
       _ctx = nullptr;
     }
     if(_ssl != nullptr) {
+      /* without a shutdown OpenSSL drops the session as bad, the established ones stay resumable */
+      if(_open) SSL_set_shutdown(_ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+      /* the memory BIOs are freed with it */
       SSL_free(_ssl); 
       _ssl = nullptr;
+      _rbio = _wbio = nullptr;
     }
-    if(_fd != -1) close(_fd);
+    if(_slot != -1) {
+      Uring::thread().detach(_slot);
+      _slot = -1;
+    }
+    if(_fd != -1) {
+      if(_open) sampleTcp(TcpPoint::CLOSE);
+      /* the ACK of the last request bytes may come after the first response byte */
+      if(_open && _timestamping) Timestamping::transmit(_fd, _stamps);
+      close(_fd);
+    }
+    _fd = -1;
     _open = false;
   }
+  /**
+   * @brief Enable the TCP_INFO sampling of the next connections (see TcpPoint).
+   * @param enable The mode.
+   */
+  auto EasySocket::tcpInfo(bool enable) -> void {
+    _tcpInfoEnabled = enable;
+  }
+
+  /**
+   * @brief Get the TCP_INFO sampling mode.
+   * @return bool
+   */
+  auto EasySocket::tcpInfo() -> bool {
+    return _tcpInfoEnabled;
+  }
+
+  /**
+   * @brief Get a TCP_INFO sample of the current connection.
+   * @param point The sampling point.
+   * @return const TcpSample& (invalid if not sampled)
+   */
+  auto EasySocket::tcpInfo(TcpPoint point) const -> const TcpSample& {
+    return _tcpInfo[static_cast<std::size_t>(point)];
+  }
+
+  /**
+   * @brief Change the I/O backend of the next connections.
+   * @param backend The backend (IoBackend::URING falls back on the socket calls if unavailable).
+   */
+  auto EasySocket::ioBackend(IoBackend backend) -> void {
+    _backend = backend;
+  }
+
+  /**
+   * @brief Get the I/O backend.
+   * @return IoBackend
+   */
+  auto EasySocket::ioBackend() -> IoBackend {
+    return _backend;
+  }
+
+  /**
+   * @brief Connect the next connections to a Unix socket instead of the host (which still
+   * names the Host header), '@name' for the Linux abstract namespace.
+   * @param path The socket path, empty for TCP.
+   * @return false if the path is too long.
+   */
+  auto EasySocket::unixSocket(const std::string& path) -> bool {
+    if(path.size() >= sizeof(sockaddr_un::sun_path)) return false;
+    _unixPath = path;
+    return true;
+  }
+
+  /**
+   * @brief Get the Unix socket path.
+   * @return const std::string& (empty for TCP)
+   */
+  auto EasySocket::unixSocket() -> const std::string& {
+    return _unixPath;
+  }
+
+  /**
+   * @brief Test if the current connection uses io_uring.
+   * @return bool
+   */
+  auto EasySocket::uring() const -> bool {
+    return _slot != -1;
+  }
+
+  /**
+   * @brief Change the socket options of the next connections.
+   * @param profile The options.
+   */
+  auto EasySocket::profile(const SocketProfile& profile) -> void {
+    _profile = profile;
+  }
+
+  /**
+   * @brief Get the socket options.
+   * @return const SocketProfile&
+   */
+  auto EasySocket::profile() -> const SocketProfile& {
+    return _profile;
+  }
+
+  /**
+   * @brief Enable the kernel RX/TX timestamping (SO_TIMESTAMPING) of the next connections.
+   * @param enable The mode.
+   */
+  auto EasySocket::timestamping(bool enable) -> void {
+    _timestamping = enable;
+  }
+
+  /**
+   * @brief Get the kernel timestamping mode.
+   * @return bool
+   */
+  auto EasySocket::timestamping() -> bool {
+    return _timestamping;
+  }
+
+  /**
+   * @brief Get the kernel timestamps of the current connection (last request write,
+   * first response byte).
+   * @return const KernelStamps&
+   */
+  auto EasySocket::stamps() const -> const KernelStamps& {
+    return _stamps;
+  }
+
+  /**
+   * @brief Sample TCP_INFO if enabled.
+   * @param point The sampling point.
+   */
+  auto EasySocket::sampleTcp(TcpPoint point) -> void {
+    if(_tcpInfoEnabled && _unixPath.empty()) TcpInfo::sample(_fd, _tcpInfo[static_cast<std::size_t>(point)]);
+  }
+
+  /**
+   * @brief Get the phases timings of the current connection (started by connect).
+   * @return Timings&
+   */
+  auto EasySocket::timings() -> Timings& {
+    return _timings;
+  }
+
   /**
    * @brief Connect the socket to the remote address.
    * @param host The remote address.
    * @param port The remote port.
    * @return EasySocketResult
    */
-  auto EasySocket::connect(std::string host, int port) -> void { 
+  auto EasySocket::connect(std::string_view host, int port) -> void {
     _open = false;
+    _eof = false;
+    _resumed = false;
+    _memoryPeak = 0;
+    _timings.start();
+    _out.clear();
+    memset(_tcpInfo, 0, sizeof(_tcpInfo));
+    memset(&_stamps, 0, sizeof(_stamps));
+    PerfScope perf(PerfPhase::CONNECT);
+    if(_useSSL && _lowMemory) {
+      /* the key of the resumed sessions, the capacity is reused */
+      _peer.assign(host);
+      _peer += ':';
+      _peer += std::to_string(port);
+    }
 
-    if ((_fd = ::socket(AF_INET, SOCK_STREAM, 0)) < 0)
-      throw_libc("Cannot create socket: ");
-
-    struct hostent *remoteh;
-    /* Look up the remote host to get its network number. */
-    if ((remoteh = ::gethostbyname(host.c_str())) == NULL) {
-      disconnect();
-      throw_libc("Cannot resolv host: ");
+    const bool local = !_unixPath.empty();
+    struct sockaddr_storage address;
+    socklen_t length = 0;
+    int family = AF_UNIX;
+    memset(&address, 0, sizeof(address));
+    std::unique_ptr<struct addrinfo, decltype(&::freeaddrinfo)> addresses(nullptr, ::freeaddrinfo);
+    const struct addrinfo* candidate = nullptr;
+    if(local) {
+      struct sockaddr_un* un = reinterpret_cast<struct sockaddr_un*>(&address);
+      un->sun_family = AF_UNIX;
+      memcpy(un->sun_path, _unixPath.data(), _unixPath.size());
+      /* '@' selects the abstract namespace, whose name is the exact length of the address */
+      if(un->sun_path[0] == '@') un->sun_path[0] = 0;
+      length = static_cast<socklen_t>(offsetof(struct sockaddr_un, sun_path) + _unixPath.size());
+    } else {
+      /* reentrant (the workers of the load, the download and the probe resolve concurrently), IPv4 or IPv6 */
+      /* the resolver needs a terminated name, copied on the stack */
+      char name[NI_MAXHOST];
+      if(host.size() >= sizeof(name)) {
+	std::ostringstream oss;
+	oss << "[[" << __LINE__ << "]] Host name too long: " << host;
+	throw EasySocketException(oss.str());
+      }
+      memcpy(name, host.data(), host.size());
+      name[host.size()] = 0;
+      struct addrinfo hints, *result = nullptr;
+      memset(&hints, 0, sizeof(hints));
+      hints.ai_family = AF_UNSPEC;
+      hints.ai_socktype = SOCK_STREAM;
+      int rc = ::getaddrinfo(name, std::to_string(port).c_str(), &hints, &result);
+      if(rc != 0) {
+	std::ostringstream oss;
+	oss << "[[" << __LINE__ << "]] Cannot resolv host " << host << ": " << (rc == EAI_SYSTEM ? strerror(errno) : gai_strerror(rc));
+	throw EasySocketException(oss.str());
+      }
+      addresses.reset(result);
+      candidate = result;
     }
+    _timings.mark(TimingPhase::DNS);
 
-    struct sockaddr_in address;
-    /* Initialize the address varaible, which specifies where connect() should attempt to connect. */
-    bcopy(remoteh->h_addr, &address.sin_addr, remoteh->h_length);
-    address.sin_family = AF_INET;
-    address.sin_port = htons(port);
-    if (!(::connect(_fd, (struct sockaddr *)(&address), sizeof(address)) >= 0)) {
+    /* the addresses are tried in the resolver order (IPv6 first on a dual-stack host) */
+    std::string_view hello;
+    for(;;) {
+      if(candidate != nullptr) {
+	memcpy(&address, candidate->ai_addr, candidate->ai_addrlen);
+	length = candidate->ai_addrlen;
+	family = candidate->ai_family;
+      }
+      if ((_fd = ::socket(family, SOCK_STREAM, 0)) < 0)
+	throw_libc("Cannot create socket: ");
+      applyProfile();
+      Uring& ring = Uring::thread();
+      _slot = -1;
+      /* fall back on the socket calls when the kernel lacks io_uring (or the fixed files are full) */
+      if(_backend == IoBackend::URING && ring.ok()) {
+	int slot = ring.attach(_fd);
+	if(slot >= 0) _slot = slot;
+      }
+      /* with io_uring, the TLS ClientHello is sent with the connect */
+      if(_useSSL && _slot != -1) {
+	newSSL();
+	SSL_set_connect_state(_ssl);
+	SSL_do_handshake(_ssl);
+	char* data;
+	long size = BIO_get_mem_data(_wbio, &data);
+	hello = std::string_view(data, size > 0 ? size : 0);
+      }
+      int r = _slot == -1 ? ::connect(_fd, (struct sockaddr *)(&address), length)
+	: ring.connect(_slot, (struct sockaddr *)(&address), length, hello);
+      if (r >= 0) break;
+      if(_slot != -1) r = -r;
+      else r = errno;
       disconnect();
+      hello = std::string_view();
+      if(candidate != nullptr && candidate->ai_next != nullptr) {
+	candidate = candidate->ai_next;
+	continue;
+      }
+      errno = r;
       throw_libc("Cannot connect: ");
     }
+    if(!hello.empty()) (void)BIO_reset(_wbio);
+    /* with Fast Open the connect returns before the handshake, which then falls in the TLS phase
+       or in the wait for the first byte */
+    _timings.mark(TimingPhase::CONNECT);
+    quickAck();
+    sampleTcp(TcpPoint::CONNECTED);
+    /* before the handshake, so that the TX stamps numbering covers all the bytes */
+    if(_timestamping) Timestamping::enable(_fd);
     if(!_useSSL) {
       _open = true;
       return;
     }
+    perf.next(PerfPhase::TLS);
 
-    /* We first need to establish what sort of */
-    /* connection we know how to make. We can use one of */
-    /* SSLv23_client_method(), SSLv2_client_method() and */
-    /* SSLv3_client_method(). */
-    /*  Try to create a new SSL context. */
-    if(( _ctx = SSL_CTX_new(SSLv23_client_method())) == nullptr) {
+    if(_ssl == nullptr) {
+      newSSL();
+      SSL_set_connect_state(_ssl);
+    }
+    /* the handshake through the memory BIOs */
+    int rc;
+    while((rc = SSL_do_handshake(_ssl)) != 1) {
+      if(SSL_get_error(_ssl, rc) != SSL_ERROR_WANT_READ) {
+	_lib_ssl_errno = ERR_get_error();
+	disconnect();
+	throw_ssl("SSL Error: ");
+      }
+      flushTLS();
+      if(!fillTLS()) {
+	disconnect();
+	throw EasySocketException("SSL Error: connection closed during the handshake");
+      }
+    }
+    flushTLS();
+    _timings.mark(TimingPhase::TLS);
+    _resumed = SSL_session_reused(_ssl) == 1;
+
+    _open = true;
+  }
+
+  /**
+   * @brief Create the SSL object of the connection on a pair of memory BIOs, the ciphertext
+   * goes through the transport of the connection (see sendRaw and fillTLS).
+   */
+  auto EasySocket::newSSL() -> void {
+    if(_lowMemory) {
+      std::lock_guard<std::mutex> lock(sharedCtxLock);
+      if(_sharedCtx == nullptr) _sharedCtx = newContext();
+      _ctx = _sharedCtx;
+    } else
+      _ctx = newContext();
+    if(_ctx == nullptr) {
       _lib_ssl_errno = ERR_get_error();
       disconnect();
       throw_ssl("SSL Error: ");
     }
-    SSL_CTX_set_mode(_ctx, SSL_MODE_AUTO_RETRY);
-
-    /* Set it up so tha we will connect to *any* site, regardless of their certificate. */
-    SSL_CTX_set_verify(_ctx, SSL_VERIFY_NONE, easy_socket_dumb_callback);
-    /* Enable bug support hacks. */
-    SSL_CTX_set_options(_ctx, SSL_OP_ALL);
-
 
     if ((_ssl = SSL_new(_ctx)) == NULL) {
       _lib_ssl_errno = ERR_get_error();
@@ -163,99 +564,405 @@ namespace net {
       throw_ssl("SSL Error: ");
     }
     SSL_set_mode(_ssl, SSL_MODE_AUTO_RETRY); 
+    if(_lowMemory) {
+      SSL_set_app_data(_ssl, this);
+      std::lock_guard<std::mutex> lock(sessionsLock);
+      auto found = sessions.find(_peer);
+      /* the SSL object takes its own reference */
+      if(found != sessions.end()) SSL_set_session(_ssl, found->second);
+    }
 
-    if (SSL_set_fd(_ssl, _fd) == 0) {
+    /* OpenSSL never touches the socket */
+    _rbio = BIO_new(BIO_s_mem());
+    _wbio = BIO_new(BIO_s_mem());
+    if(_rbio == nullptr || _wbio == nullptr) {
+      BIO_free(_rbio);
+      BIO_free(_wbio);
+      _rbio = _wbio = nullptr;
       _lib_ssl_errno = ERR_get_error();
       disconnect();
       throw_ssl("SSL Error: ");
     }
-    if (SSL_connect(_ssl) == -1) {
-      _lib_ssl_errno = ERR_get_error();
-      disconnect();
-      throw_ssl("SSL Error: ");
+    SSL_set_bio(_ssl, _rbio, _wbio);
+  }
+
+  /**
+   * @brief Apply the socket options set before the connect (see SocketProfile).
+   */
+  auto EasySocket::applyProfile() -> void {
+    int on = 1;
+    /* before the connect, the window scale depends on the receive buffer */
+    if(_profile.sendBuffer > 0)
+      ::setsockopt(_fd, SOL_SOCKET, SO_SNDBUF, &_profile.sendBuffer, sizeof(_profile.sendBuffer));
+    if(_profile.receiveBuffer > 0)
+      ::setsockopt(_fd, SOL_SOCKET, SO_RCVBUF, &_profile.receiveBuffer, sizeof(_profile.receiveBuffer));
+    /* the driver queue is polled by the reads (raising SO_BUSY_POLL above net.core.busy_read
+       needs CAP_NET_ADMIN), the spin of recvRaw still applies without it */
+    if(_profile.busyPoll > 0) {
+      ::setsockopt(_fd, SOL_SOCKET, SO_BUSY_POLL, &_profile.busyPoll, sizeof(_profile.busyPoll));
+      ::setsockopt(_fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &on, sizeof(on));
     }
-    
+    /* the next ones are TCP options */
+    if(!_unixPath.empty()) return;
+    if(_profile.noDelay)
+      ::setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    /* connect returns at once and the first write leaves with the SYN (with a cookie of the
+       kernel cache, else a regular handshake), the classic connect if unsupported */
+    if(_profile.fastOpen)
+      ::setsockopt(_fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &on, sizeof(on));
+  }
 
-    _open = true;
+  /**
+   * @brief Leave the delayed ACK mode if the profile asks for it.
+   */
+  auto EasySocket::quickAck() -> void {
+    int on = 1;
+    if(_profile.quickAck && _unixPath.empty())
+      ::setsockopt(_fd, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(on));
   }
 
+  /**
+   * @brief Spin on non-blocking reads for the busy-poll budget.
+   * @param buffer The buffer.
+   * @param size The buffer size.
+   * @param flags The recv flags (MSG_PEEK to only wait).
+   * @return The number of bytes read (0 at the end of the stream), -1 if the budget expired.
+   */
+  auto EasySocket::spin(char* buffer, std::size_t size, int flags) -> ssize_t {
+    using clock = std::chrono::steady_clock;
+    const clock::time_point deadline = clock::now() + std::chrono::microseconds(_profile.busyPoll);
+    do {
+      ssize_t reads = ::recv(_fd, buffer, size, flags | MSG_DONTWAIT);
+      if(reads >= 0) return reads;
+      if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+	throw_libc("Read error (" + std::to_string(reads) + "): ");
+    } while(clock::now() < deadline);
+    return -1;
+  }
 
   /**
-   * @brief Write some data to the socket descriptor.
-   * @param toWrite The data to write.
+   * @brief Send some parts on the transport, with a single gathering write when possible.
+   * @param iov The parts.
+   * @param count The number of parts (at most SEND_PARTS).
    */
-  auto EasySocket::write(const std::string toWrite) -> void {
-    if(_useSSL) {
-      for (;;) {
-	int rc1 = SSL_write(_ssl, toWrite.c_str(), toWrite.size());
-	int rc2 = SSL_get_error(_ssl, rc1);
-	switch (rc2) {
-	  case SSL_ERROR_NONE:
-	  case SSL_ERROR_ZERO_RETURN:
-	    return;
-	  case SSL_ERROR_WANT_READ:
-	  case SSL_ERROR_WANT_WRITE: {
-	    throw_ssl("Want write error (" + std::to_string(rc1) + "): ");
-	    break;
-	  }
-	  default:
-	    throw_ssl("SSL Write error (" + std::to_string(rc1) + "): ");
-	}
+  auto EasySocket::sendRaw(const struct iovec* iov, int count) -> void {
+    if(_timestamping) _stamps.written = Timestamping::now();
+    if(_slot != -1) {
+      int r = Uring::thread().send(_slot, iov, count);
+      if(r < 0) {
+	errno = -r;
+	throw_libc("Write error: ");
       }
+      quickAck();
+      return;
     }
-    else {
-      int w = ::write(_fd, toWrite.c_str(), toWrite.size());
-      if(w < 0)
+    struct iovec parts[SEND_PARTS];
+    std::copy(iov, iov + count, parts);
+    struct iovec* p = parts;
+    while(count) {
+      ssize_t w = ::writev(_fd, p, count);
+      if(w < 0) {
+	if(errno == EINTR) continue;
 	throw_libc("Write error (" + std::to_string(w) + "): ");
+      }
+      /* short write */
+      std::size_t n = static_cast<std::size_t>(w);
+      while(count && n >= p->iov_len) {
+	n -= p->iov_len;
+	++p;
+	--count;
+      }
+      if(count) {
+	p->iov_base = static_cast<char*>(p->iov_base) + n;
+	p->iov_len -= n;
+      }
     }
+    quickAck();
   }
 
   /**
-   * @brief Read some data from the socket descriptor.
-   * @param toRead The data reads.
+   * @brief Read once from the transport.
+   * @param buffer The buffer.
+   * @param size The buffer size.
+   * @return The number of bytes read, 0 at the end of the stream.
    */
-  auto EasySocket::read(std::string &toRead) -> void {
-    char buffer[1024];
-    std::ostringstream oss;
-    bool leave = false;
+  auto EasySocket::recvRaw(char* buffer, std::size_t size) -> std::size_t {
+    if(_slot != -1) {
+      ssize_t r = Uring::thread().recv(_slot, buffer, size);
+      if(r < 0) {
+	errno = static_cast<int>(-r);
+	throw_libc("Read error: ");
+      }
+      return static_cast<std::size_t>(r);
+    }
+    ssize_t reads;
+    /* the wakeup of a parked thread is not part of the measure when the response comes within the budget */
+    if(_profile.busyPoll > 0 && (reads = spin(buffer, size, 0)) >= 0)
+      return static_cast<std::size_t>(reads);
+    while((reads = ::read(_fd, buffer, size)) < 0 && errno == EINTR);
+    if(reads < 0)
+      throw_libc("Read error (" + std::to_string(reads) + "): ");
+    return static_cast<std::size_t>(reads);
+  }
+
+  /**
+   * @brief Send the ciphertext written by OpenSSL in the memory BIO, all the pending
+   * records leave together.
+   */
+  auto EasySocket::flushTLS() -> void {
+    char* data;
+    long size = BIO_get_mem_data(_wbio, &data);
+    if(size <= 0) return;
+    struct iovec iov = { data, static_cast<std::size_t>(size) };
+    try {
+      sendRaw(&iov, 1);
+    } catch(...) {
+      (void)BIO_reset(_wbio);
+      throw;
+    }
+    (void)BIO_reset(_wbio);
+  }
+
+  /**
+   * @brief Give the received ciphertext to OpenSSL through the memory BIO, as many
+   * records as the transport has ready.
+   * @return false at the end of the stream.
+   */
+  auto EasySocket::fillTLS() -> bool {
+    if(_slot != -1) {
+      /* straight from the provided buffers of the ring */
+      Uring& ring = Uring::thread();
+      std::string_view data;
+      int r = ring.pending(_slot, data);
+      if(r < 0) {
+	errno = -r;
+	throw_libc("Read error: ");
+      }
+      if(!data.empty()) {
+	BIO_write(_rbio, data.data(), static_cast<int>(data.size()));
+	ring.consume(_slot, data.size());
+	return true;
+      }
+    } else {
+      /* the slab of the thread is only borrowed once the record is there */
+      if(_lowMemory) waitSocket();
+      char* slab = SlabPool::acquire();
+      std::size_t reads;
+      try {
+	reads = recvRaw(slab, SLAB_SIZE);
+      } catch(...) {
+	SlabPool::release(slab);
+	throw;
+      }
+      if(reads) BIO_write(_rbio, slab, static_cast<int>(reads));
+      SlabPool::release(slab);
+      if(reads) return true;
+    }
+    /* the next reads of OpenSSL see the end of the stream */
+    BIO_set_mem_eof_return(_rbio, 0);
+    return false;
+  }
+
+  /**
+   * @brief Write some data to the socket descriptor, the small writes are coalesced
+   * until flush (or the next read).
+   * @param toWrite The data to write.
+   */
+  auto EasySocket::write(std::string_view toWrite) -> void {
+    if(_out.size() + toWrite.size() <= SLAB_SIZE) {
+      _out.append(toWrite);
+      return;
+    }
+    send(toWrite);
+  }
+
+  /**
+   * @brief Send the coalesced writes.
+   */
+  auto EasySocket::flush() -> void {
+    if(!_out.empty()) send(std::string_view());
+  }
+
+  /**
+   * @brief Send the coalesced writes followed by some data.
+   * @param extra The data.
+   */
+  auto EasySocket::send(std::string_view extra) -> void {
+    std::string_view parts[] = { _out, extra };
     if(_useSSL) {
-      for(;!leave;) {
-	bzero(buffer, 1024);
-	int rc1 = SSL_read(_ssl, buffer, 1023);
-	int rc2 = SSL_get_error(_ssl, rc1);
-	if(rc1 > 0) oss << buffer;
-	switch (rc2) {
-	  case SSL_ERROR_SYSCALL:
-	    if(rc1) {
-	      throw_ssl("Read read error (" + std::to_string(rc2) + "): ");
-	    }
-	  case SSL_ERROR_NONE:
-	  case SSL_ERROR_ZERO_RETURN:
-	    if(rc1 == 0) leave = true;
-	    break;
-	  case SSL_ERROR_WANT_READ:
-	  case SSL_ERROR_WANT_WRITE: {
-	    throw_ssl("Want read error (" + std::to_string(rc2) + "): ");
-	    break;
-	  }
-	  default: {
-	    throw_ssl("SSL read error (" + std::to_string(rc2) + "): ");
-	    break;
+      /* one record per part instead of one per write, then one send for all of them */
+      for(auto part : parts) {
+	while(!part.empty()) {
+	  int rc = SSL_write(_ssl, part.data(), part.size());
+	  if(rc <= 0) {
+	    _out.clear();
+	    throw_ssl("SSL Write error (" + std::to_string(rc) + "): ");
 	  }
+	  part.remove_prefix(rc);
 	}
       }
+      _out.clear();
+      flushTLS();
     } else {
-      for(;;) {
-	bzero(buffer, 1024);
-	int reads = ::read(_fd, buffer, 1023);
-	if(reads == 0) break;
-	if(reads < 0) {
-	  throw_libc("Read error (" + std::to_string(reads) + "): ");
-	}
-	oss << buffer;
+      struct iovec iov[SEND_PARTS];
+      int count = 0;
+      for(auto part : parts)
+	if(!part.empty()) iov[count++] = { const_cast<char*>(part.data()), part.size() };
+      try {
+	sendRaw(iov, count);
+      } catch(...) {
+	_out.clear();
+	throw;
       }
+      _out.clear();
     }
-    toRead = oss.str();
+    if(_lowMemory) std::string().swap(_out);
+  }
+
+  /**
+   * @brief Read once from the socket descriptor.
+   * @param buffer The buffer.
+   * @param size The buffer size.
+   * @return The number of bytes read, 0 at the end of the stream.
+   */
+  auto EasySocket::readSome(char* buffer, std::size_t size) -> std::size_t {
+    if(!_useSSL) return recvRaw(buffer, size);
+    for(;;) {
+      int rc = SSL_read(_ssl, buffer, size);
+      if(rc > 0) return rc;
+      switch(SSL_get_error(_ssl, rc)) {
+	case SSL_ERROR_ZERO_RETURN:
+	  return 0;
+	case SSL_ERROR_WANT_READ:
+	  /* post-handshake messages (TLS 1.3 tickets) may need an answer */
+	  flushTLS();
+	  if(!fillTLS()) {
+	    /* SSL_OP_IGNORE_UNEXPECTED_EOF: a close without close_notify is the end */
+	    rc = SSL_read(_ssl, buffer, size);
+	    return rc > 0 ? rc : 0;
+	  }
+	  break;
+	case SSL_ERROR_SYSCALL:
+	  if(rc == 0) return 0;
+	  [[fallthrough]];
+	default:
+	  throw_ssl("SSL read error (" + std::to_string(rc) + "): ");
+      }
+    }
+  }
+
+  /**
+   * @brief Wait until some data is pending.
+   */
+  auto EasySocket::waitReadable() -> void {
+    /* already received, or already decrypted */
+    if(_useSSL && (SSL_has_pending(_ssl) || BIO_pending(_rbio) > 0)) return;
+    waitSocket();
+  }
+
+  /**
+   * @brief Wait until the socket descriptor (or the ring) has some data, whatever OpenSSL holds.
+   */
+  auto EasySocket::waitSocket() -> void {
+    if(_slot != -1) {
+      int r = Uring::thread().wait(_slot);
+      if(r < 0) {
+	errno = -r;
+	throw_libc("Poll error: ");
+      }
+      return;
+    }
+    char c;
+    if(_profile.busyPoll > 0 && spin(&c, 1, MSG_PEEK) >= 0) return;
+    struct pollfd pfd = { _fd, POLLIN, 0 };
+    while(::poll(&pfd, 1, -1) < 0) {
+      if(errno != EINTR)
+	throw_libc("Poll error: ");
+    }
+  }
+
+  /**
+   * @brief Read some data from the socket descriptor (empty at the end of the stream).
+   * @param toRead The data reads.
+   */
+  auto EasySocket::read(std::string &toRead) -> void {
+    toRead.clear();
+    if(_eof) return;
+    flush();
+    /* the idle connections do not hold any receive buffer, the caller's string only grows once data is pending */
+    if(_lowMemory) waitReadable();
+    /* straight into the caller's string, whose capacity is reused */
+    toRead.resize(SLAB_SIZE);
+    std::size_t reads;
+    try {
+      /* the RX stamp of the first response byte, unless already given to OpenSSL */
+      /* with io_uring the data is already received by the ring, only the TX stamps are available */
+      if(_timestamping && !_timings.has(TimingPhase::FIRST_BYTE) && _slot == -1
+	 && !(_useSSL && (SSL_pending(_ssl) || BIO_pending(_rbio) > 0))) {
+	Timestamping::receive(_fd, _stamps);
+	Timestamping::transmit(_fd, _stamps);
+      } else if(_timestamping && !_timings.has(TimingPhase::FIRST_BYTE))
+	Timestamping::transmit(_fd, _stamps);
+      reads = readSome(&toRead[0], SLAB_SIZE);
+    } catch(...) {
+      toRead.clear();
+      throw;
+    }
+    toRead.resize(reads);
+    if(reads && !_timings.has(TimingPhase::FIRST_BYTE)) {
+      _timings.mark(TimingPhase::FIRST_BYTE);
+      sampleTcp(TcpPoint::FIRST_BYTE);
+    }
+    if(!reads) _eof = true;
+  }
+
+  /**
+   * @brief Test if EOF is reached.
+   * @return bool
+   */
+  auto EasySocket::isEOF() -> bool {
+    return _eof;
+  }
+
+  /**
+   * @brief Test if the connection is established.
+   * @return bool
+   */
+  auto EasySocket::isOpen() -> bool {
+    return _open;
+  }
+
+  /**
+   * @brief Start a new request on the open connection (keep-alive), the timings and the
+   * samples restart as with connect but the connect phases are not marked.
+   * @return false if the connection is closed, or if the peer closed it or sent unexpected data.
+   */
+  auto EasySocket::reuse() -> bool {
+    if(!_open || _eof) return false;
+    if(_useSSL && (SSL_has_pending(_ssl) || BIO_pending(_rbio) > 0)) return false;
+    /* an idle connection has nothing to read, else the server closed it (or is out of sync) */
+    struct pollfd pfd = { _fd, POLLIN | POLLRDHUP, 0 };
+    if(::poll(&pfd, 1, 0) != 0) return false;
+    if(_slot != -1 && Uring::thread().ready(_slot)) return false;
+    _timings.start();
+    _memoryPeak = 0;
+    _resumed = false;
+    memset(_tcpInfo, 0, sizeof(_tcpInfo));
+    /* the stamps of the previous request are dropped */
+    if(_timestamping) Timestamping::transmit(_fd, _stamps);
+    memset(&_stamps, 0, sizeof(_stamps));
+    sampleTcp(TcpPoint::CONNECTED);
+    return true;
+  }
+
+  /**
+   * @brief Keep the connection open after a complete response: the end of request samples
+   * (TCP_INFO and TX stamps) are taken as before a close.
+   */
+  auto EasySocket::keep() -> void {
+    if(!_open) return;
+    sampleTcp(TcpPoint::CLOSE);
+    if(_timestamping) Timestamping::transmit(_fd, _stamps);
   }
 
   /**
@@ -11,8 +11,13 @@
 
 #include <exception>
 #include <string>
+#include <string_view>
 #include <openssl/ssl.h>
 #include <openssl/bio.h> 
+#include <sys/uio.h>
+#include "Timings.hpp"
+#include "TcpInfo.hpp"
+#include "Timestamping.hpp"
 
 
 namespace net {
@@ -27,6 +32,34 @@ namespace net {
       std::string _msg;
   };
 
+  /* maximum number of parts of a gathering write */
+  constexpr int SEND_PARTS = 2;
+
+  /**
+   * @brief I/O backends of the sockets.
+   */
+  enum class IoBackend : unsigned char {
+      SOCKET = 0, /* blocking read/write system calls */
+      URING       /* per-thread io_uring (see Uring) */
+  };
+
+  /**
+   * @brief Socket options of the connections.
+   */
+  struct SocketProfile {
+      bool fastOpen;      /* TCP_FASTOPEN_CONNECT: the first write (request or ClientHello) goes with the SYN */
+      bool noDelay;       /* TCP_NODELAY */
+      bool quickAck;      /* TCP_QUICKACK after the connect and after each send */
+      int sendBuffer;     /* SO_SNDBUF, 0 for the kernel default */
+      int receiveBuffer;  /* SO_RCVBUF, 0 for the kernel default */
+      int busyPoll;       /* microseconds of SO_BUSY_POLL and of the non-blocking reads before parking, 0 to disable */
+  };
+
+  /* no option, the kernel defaults */
+  constexpr SocketProfile DEFAULT_PROFILE = { false, false, false, 0, 0, 0 };
+  /* saves the RTT of the handshake to the repeat destinations and the delayed ACKs */
+  constexpr SocketProfile LOW_LATENCY_PROFILE = { true, true, true, 0, 0, 0 };
+
   class EasySocket {
     public:
 
@@ -49,13 +82,136 @@ namespace net {
        */
       static auto lastErrorSSL() -> std::string;
 
+      /**
+       * @brief Change the low-memory mode of the next connections: shared SSL context,
+       * OpenSSL buffers released while idle and TLS records received through a slab
+       * borrowed from the SlabPool of the thread. An idle keep-alive connection then only holds
+       * its socket and its SSL object (HttpClient::release gives the response buffers back).
+       * @param lowMemory The mode.
+       */
+      static auto lowMemory(bool lowMemory) -> void;
+
+      /**
+       * @brief Get the low-memory mode.
+       * @return bool
+       */
+      static auto lowMemory() -> bool;
+
+      /**
+       * @brief Enable the TCP_INFO sampling of the next connections (see TcpPoint).
+       * @param enable The mode.
+       */
+      static auto tcpInfo(bool enable) -> void;
+
+      /**
+       * @brief Get the TCP_INFO sampling mode.
+       * @return bool
+       */
+      static auto tcpInfo() -> bool;
+
+      /**
+       * @brief Get a TCP_INFO sample of the current connection.
+       * @param point The sampling point.
+       * @return const TcpSample& (invalid if not sampled)
+       */
+      auto tcpInfo(TcpPoint point) const -> const TcpSample&;
+
+      /**
+       * @brief Change the I/O backend of the next connections.
+       * @param backend The backend (IoBackend::URING falls back on the socket calls if unavailable).
+       */
+      static auto ioBackend(IoBackend backend) -> void;
+
+      /**
+       * @brief Get the I/O backend.
+       * @return IoBackend
+       */
+      static auto ioBackend() -> IoBackend;
+
+      /**
+       * @brief Connect the next connections to a Unix socket instead of the host (which still
+       * names the Host header), '@name' for the Linux abstract namespace.
+       * @param path The socket path, empty for TCP.
+       * @return false if the path is too long.
+       */
+      static auto unixSocket(const std::string& path) -> bool;
+
+      /**
+       * @brief Get the Unix socket path.
+       * @return const std::string& (empty for TCP)
+       */
+      static auto unixSocket() -> const std::string&;
+
+      /**
+       * @brief Test if the current connection uses io_uring.
+       * @return bool
+       */
+      auto uring() const -> bool;
+
+      /**
+       * @brief Change the socket options of the next connections.
+       * @param profile The options.
+       */
+      static auto profile(const SocketProfile& profile) -> void;
+
+      /**
+       * @brief Get the socket options.
+       * @return const SocketProfile&
+       */
+      static auto profile() -> const SocketProfile&;
+
+      /**
+       * @brief Enable the kernel RX/TX timestamping (SO_TIMESTAMPING) of the next connections.
+       * @param enable The mode.
+       */
+      static auto timestamping(bool enable) -> void;
+
+      /**
+       * @brief Get the kernel timestamping mode.
+       * @return bool
+       */
+      static auto timestamping() -> bool;
+
+      /**
+       * @brief Get the kernel timestamps of the current connection (last request write,
+       * first response byte).
+       * @return const KernelStamps&
+       */
+      auto stamps() const -> const KernelStamps&;
+
+      /**
+       * @brief Change the per-connection memory budget: the bytes kept by the client and the live buffers
+	* of the connection (TLS BIOs and send buffer), checked by account.
+       * @param budget The budget in bytes, 0 for no limit.
+       */
+      auto budget(std::size_t budget) -> void;
+
+      /**
+       * @brief Get the peak memory used by the connection (see account).
+       * @return std::size_t
+       */
+      auto memoryPeak() -> std::size_t;
+
+      /**
+	* @brief Check the memory in use against the budget: the bytes kept by the caller (receive
+	* buffer and buffered response) and the live buffers of the connection.
+	* @param kept The bytes kept by the caller.
+	*/
+      auto account(std::size_t kept) -> void;
+
+      /**
+       * @brief Get the phases timings of the current connection (started by connect).
+       * @return Timings&
+       */
+      auto timings() -> Timings&;
+
       /**
        * @brief Connect the socket to the remote address.
        * @param host The remote address.
        * @param port The remote port.
        * @return EasySocketResult
        */
-      auto connect(std::string host, int port) -> void;
+      auto connect(std::string_view host, int port) -> void;
 
       /**
        * @brief Close the socket with the remote address.
@@ -81,13 +237,19 @@ namespace net {
       auto fd() -> int;
 
       /**
-       * @brief Write some data to the socket descriptor.
+       * @brief Write some data to the socket descriptor, the small writes are coalesced
+       * until flush (or the next read).
        * @param toWrite The data to write.
        */
-      auto write(const std::string toWrite) -> void;
+      auto write(std::string_view toWrite) -> void;
 
       /**
-       * @brief Read some data from the socket descriptor.
+       * @brief Send the coalesced writes.
+       */
+      auto flush() -> void;
+
+      /**
+       * @brief Read some data from the socket descriptor (empty at the end of the stream).
        * @param toRead The data reads.
        */
       auto read(std::string &toRead) -> void;
@@ -97,7 +259,7 @@ namespace net {
        * @param toWrite The data to write.
        * @return EasySocket&
        */
-      EasySocket& operator << (const std::string toWrite) {
+      EasySocket& operator << (std::string_view toWrite) {
 	write(toWrite);
 	return *this;
       }
@@ -118,13 +280,155 @@ namespace net {
        */
       auto isEOF() -> bool;
 
+      /**
+       * @brief Test if the connection is established.
+       * @return bool
+       */
+      auto isOpen() -> bool;
+
+      /**
+       * @brief Start a new request on the open connection (keep-alive), the timings and the
+       * samples restart as with connect but the connect phases are not marked.
+       * @return false if the connection is closed, or if the peer closed it or sent unexpected data.
+       */
+      auto reuse() -> bool;
+
+      /**
+       * @brief Keep the connection open after a complete response: the end of request samples
+       * (TCP_INFO and TX stamps) are taken as before a close.
+       */
+      auto keep() -> void;
+
+      /**
+       * @brief Test if the handshake of the connection resumed a previous session.
+       * @return bool
+       */
+      auto sessionReused() -> bool;
+
     private:
       int _fd;
       bool _useSSL;
       bool _open;
       SSL_CTX *_ctx;
       SSL     *_ssl;
+      bool _eof;
+      bool _resumed;
+      std::size_t _budget;
+      std::size_t _memoryPeak;
+      Timings _timings;
+      TcpSample _tcpInfo[TCP_POINTS];
+      KernelStamps _stamps;
+      int _slot;
+      BIO *_rbio;
+      BIO *_wbio;
+      std::string _out;
+      std::string _peer;
       static unsigned long _lib_ssl_errno;
+      static bool _lowMemory;
+      static bool _tcpInfoEnabled;
+      static bool _timestamping;
+      static IoBackend _backend;
+      static SocketProfile _profile;
+      static std::string _unixPath;
+      static SSL_CTX *_sharedCtx;
+
+      /**
+       * @brief Create a new client SSL context.
+       * @return The context or nullptr.
+       */
+      static auto newContext() -> SSL_CTX*;
+
+      /**
+       * @brief Keep the new session of a connection for the next connection to the same peer
+       * (with TLS 1.3 the tickets come after the handshake, with the first reads).
+       * @param ssl The SSL object of the connection.
+       * @param session The session.
+       * @return 1 if the session is kept.
+       */
+      static auto storeSession(SSL* ssl, SSL_SESSION* session) -> int;
+
+      /**
+       * @brief Create the SSL object of the connection on a pair of memory BIOs, the ciphertext
+       * goes through the transport of the connection (see sendRaw and fillTLS).
+       */
+      auto newSSL() -> void;
+
+      /**
+       * @brief Send some parts on the transport, with a single gathering write when possible.
+       * @param iov The parts.
+       * @param count The number of parts (at most SEND_PARTS).
+       */
+      auto sendRaw(const struct iovec* iov, int count) -> void;
+
+      /**
+       * @brief Read once from the transport.
+       * @param buffer The buffer.
+       * @param size The buffer size.
+       * @return The number of bytes read, 0 at the end of the stream.
+       */
+      auto recvRaw(char* buffer, std::size_t size) -> std::size_t;
+
+      /**
+       * @brief Send the ciphertext written by OpenSSL in the memory BIO, all the pending
+       * records leave together.
+       */
+      auto flushTLS() -> void;
+
+      /**
+       * @brief Give the received ciphertext to OpenSSL through the memory BIO, as many
+       * records as the transport has ready.
+       * @return false at the end of the stream.
+       */
+      auto fillTLS() -> bool;
+
+      /**
+       * @brief Send the coalesced writes followed by some data.
+       * @param extra The data.
+       */
+      auto send(std::string_view extra) -> void;
+
+      /**
+       * @brief Read once from the socket descriptor.
+       * @param buffer The buffer.
+       * @param size The buffer size.
+       * @return The number of bytes read, 0 at the end of the stream.
+       */
+      auto readSome(char* buffer, std::size_t size) -> std::size_t;
+
+      /**
+       * @brief Wait until some data is pending.
+       */
+      auto waitReadable() -> void;
+
+      /**
+       * @brief Wait until the socket descriptor (or the ring) has some data, whatever OpenSSL holds.
+       */
+      auto waitSocket() -> void;
+
+      /**
+       * @brief Apply the socket options set before the connect (see SocketProfile).
+       */
+      auto applyProfile() -> void;
+
+      /**
+       * @brief Leave the delayed ACK mode if the profile asks for it.
+       */
+      auto quickAck() -> void;
+
+      /**
+       * @brief Spin on non-blocking reads for the busy-poll budget.
+       * @param buffer The buffer.
+       * @param size The buffer size.
+       * @param flags The recv flags (MSG_PEEK to only wait).
+       * @return The number of bytes read (0 at the end of the stream), -1 if the budget expired.
+       */
+      auto spin(char* buffer, std::size_t size, int flags) -> ssize_t;
+
+      /**
+       * @brief Sample TCP_INFO if enabled.
+       * @param point The sampling point.
+       */
+      auto sampleTcp(TcpPoint point) -> void;
   };
 
 } /* namespace net */
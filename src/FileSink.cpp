@@ -0,0 +1,256 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#include "FileSink.hpp"
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+namespace net {
+
+  /**
+   * @brief Throw an error of the sink.
+   * @param message The message.
+   * @param error The errno value.
+   */
+  [[noreturn]] static auto fail(const std::string& message, int error) -> void {
+    throw FileSinkException(message + strerror(error));
+  }
+
+  FileSink::FileSink(const std::string& path, SinkMode mode) : _path(path), _mode(mode), _fd(-1), _direct(false), _written(0),
+							       _map(nullptr), _mapSize(0), _buffers{ nullptr, nullptr }, _current(0),
+							       _fill(0), _writer(), _lock(), _cond(), _pending(-1), _pendingOffset(0),
+							       _pendingSize(0), _stop(false), _error(0) {
+  }
+
+  FileSink::~FileSink() {
+    try {
+      close();
+    } catch(...) {
+    }
+    release();
+  }
+
+  /**
+   * @brief Create (or truncate) the file for a new body.
+   * @param size The expected size, 0 if unknown.
+   */
+  auto FileSink::open(std::size_t size) -> void {
+    release();
+    _written = 0;
+    _direct = false;
+    int flags = _mode == SinkMode::MMAP ? O_RDWR | O_CREAT | O_TRUNC : O_WRONLY | O_CREAT | O_TRUNC;
+    if(_mode == SinkMode::DIRECT) {
+      _fd = ::open(_path.c_str(), flags | O_DIRECT, 0644);
+      _direct = _fd != -1;
+    }
+    /* tmpfs and some other file systems refuse O_DIRECT */
+    if(_fd == -1 && (_mode == SinkMode::MMAP || errno == EINVAL))
+      _fd = ::open(_path.c_str(), flags, 0644);
+    if(_fd == -1) fail("Unable to open the file " + _path + ": ", errno);
+    if(size && ::fallocate(_fd, 0, 0, static_cast<off_t>(size)) == -1 && errno != EOPNOTSUPP)
+      fail("Unable to allocate the file " + _path + ": ", errno);
+    if(_mode == SinkMode::MMAP) {
+      grow(size ? size : SINK_MAP_INITIAL);
+      return;
+    }
+    for(char*& b : _buffers) {
+      void* p = nullptr;
+      if(posix_memalign(&p, SINK_ALIGN, SINK_BLOCK) != 0) {
+	release();
+	throw FileSinkException("Unable to allocate the buffers of " + _path);
+      }
+      b = static_cast<char*>(p);
+    }
+    _current = _fill = 0;
+    _pending = -1;
+    _stop = false;
+    _error = 0;
+    _writer = std::thread(&FileSink::writer, this);
+  }
+
+  /**
+   * @brief Grow the mapping (and the file) to hold at least a size.
+   * @param size The size.
+   */
+  auto FileSink::grow(std::size_t size) -> void {
+    std::size_t length = std::max(size, _mapSize * 2);
+    if(::ftruncate(_fd, static_cast<off_t>(length)) == -1)
+      fail("Unable to resize the file " + _path + ": ", errno);
+    void* p = _map == nullptr ? ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0)
+      : ::mremap(_map, _mapSize, length, MREMAP_MAYMOVE);
+    if(p == MAP_FAILED) {
+      int error = errno;
+      _map = nullptr;
+      _mapSize = 0;
+      fail("Unable to map the file " + _path + ": ", error);
+    }
+    _map = static_cast<char*>(p);
+    _mapSize = length;
+    ::madvise(_map, _mapSize, MADV_SEQUENTIAL);
+  }
+
+  /**
+   * @brief Append some data.
+   * @param data The data.
+   */
+  auto FileSink::write(std::string_view data) -> void {
+    if(_fd == -1) throw FileSinkException("The file " + _path + " is not open");
+    if(_mode == SinkMode::MMAP) {
+      if(_written + data.size() > _mapSize) grow(_written + data.size());
+      memcpy(_map + _written, data.data(), data.size());
+      _written += data.size();
+      return;
+    }
+    while(!data.empty()) {
+      std::size_t n = std::min(SINK_BLOCK - _fill, data.size());
+      memcpy(_buffers[_current] + _fill, data.data(), n);
+      _fill += n;
+      _written += n;
+      data.remove_prefix(n);
+      if(_fill == SINK_BLOCK) submit(SINK_BLOCK);
+    }
+  }
+
+  /**
+   * @brief Hand the current buffer to the writer once it is idle and switch to the other one.
+   * @param size The number of bytes to write (aligned with O_DIRECT).
+   */
+  auto FileSink::submit(std::size_t size) -> void {
+    std::unique_lock<std::mutex> lock(_lock);
+    /* the other buffer is free once the writer is idle */
+    _cond.wait(lock, [this]() { return _pending == -1; });
+    if(_error) fail("Unable to write the file " + _path + ": ", _error);
+    _pending = static_cast<int>(_current);
+    _pendingOffset = _written - _fill;
+    _pendingSize = size;
+    _cond.notify_all();
+    _current ^= 1;
+    _fill = 0;
+  }
+
+  /**
+   * @brief Wait until the writer is idle.
+   */
+  auto FileSink::drain() -> void {
+    std::unique_lock<std::mutex> lock(_lock);
+    _cond.wait(lock, [this]() { return _pending == -1; });
+  }
+
+  /**
+   * @brief Writer thread of the DIRECT mode.
+   */
+  auto FileSink::writer() -> void {
+    std::unique_lock<std::mutex> lock(_lock);
+    for(;;) {
+      _cond.wait(lock, [this]() { return _pending != -1 || _stop; });
+      if(_pending == -1) return;
+      const char* data = _buffers[_pending];
+      std::size_t size = _pendingSize;
+      off_t offset = static_cast<off_t>(_pendingOffset);
+      lock.unlock();
+      int error = 0;
+      while(size) {
+	ssize_t w = ::pwrite(_fd, data, size, offset);
+	if(w < 0 && errno == EINTR) continue;
+	if(w <= 0) {
+	  error = w < 0 ? errno : EIO;
+	  break;
+	}
+	data += w;
+	size -= static_cast<std::size_t>(w);
+	offset += w;
+      }
+      lock.lock();
+      if(error) _error = error;
+      _pending = -1;
+      _cond.notify_all();
+    }
+  }
+
+  /**
+   * @brief Flush the data and cut the file to the written size.
+   */
+  auto FileSink::close() -> void {
+    if(_fd == -1) return;
+    if(_mode == SinkMode::MMAP) {
+      ::munmap(_map, _mapSize);
+      _map = nullptr;
+      _mapSize = 0;
+    } else if(_writer.joinable()) {
+      if(_fill) {
+	/* the tail is padded to the alignment, the padding is cut below */
+	std::size_t size = _direct ? (_fill + SINK_ALIGN - 1) & ~(SINK_ALIGN - 1) : _fill;
+	memset(_buffers[_current] + _fill, 0, size - _fill);
+	submit(size);
+      }
+      drain();
+      {
+	std::lock_guard<std::mutex> lock(_lock);
+	_stop = true;
+	_cond.notify_all();
+      }
+      _writer.join();
+    }
+    int error = _error;
+    if(!error && ::ftruncate(_fd, static_cast<off_t>(_written)) == -1) error = errno;
+    release();
+    if(error) fail("Unable to write the file " + _path + ": ", error);
+  }
+
+  /**
+   * @brief Release the file and the buffers.
+   */
+  auto FileSink::release() -> void {
+    if(_writer.joinable()) {
+      {
+	std::lock_guard<std::mutex> lock(_lock);
+	_stop = true;
+	_cond.notify_all();
+      }
+      _writer.join();
+    }
+    if(_map != nullptr) ::munmap(_map, _mapSize);
+    _map = nullptr;
+    _mapSize = 0;
+    for(char*& b : _buffers) {
+      free(b);
+      b = nullptr;
+    }
+    if(_fd != -1) ::close(_fd);
+    _fd = -1;
+  }
+
+  /**
+   * @brief Get the number of bytes written since open.
+   * @return std::size_t
+   */
+  auto FileSink::written() const -> std::size_t {
+    return _written;
+  }
+
+  /**
+   * @brief Get the file path.
+   * @return const std::string&
+   */
+  auto FileSink::path() const -> const std::string& {
+    return _path;
+  }
+
+  /**
+   * @brief Get the name of the active write path (mmap, O_DIRECT or buffered).
+   * @return std::string_view
+   */
+  auto FileSink::method() const -> std::string_view {
+    return _mode == SinkMode::MMAP ? "mmap" : _direct ? "O_DIRECT" : "buffered";
+  }
+
+} /* namespace net */
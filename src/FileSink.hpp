@@ -0,0 +1,151 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#ifndef __FILESINK_H__
+#define __FILESINK_H__
+
+#include <exception>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+
+namespace net {
+
+  /* O_DIRECT buffer size (two of them) */
+  constexpr std::size_t SINK_BLOCK = 0x100000;
+  /* O_DIRECT alignment of the buffers, offsets and sizes */
+  constexpr std::size_t SINK_ALIGN = 0x1000;
+  /* first mapping when the size is unknown, doubled when full */
+  constexpr std::size_t SINK_MAP_INITIAL = 0x100000;
+
+  class FileSinkException: public std::exception {
+    public:
+      FileSinkException(std::string msg) : _msg(msg) { }
+      virtual ~FileSinkException() = default;
+
+      virtual const char* what() const throw() { return _msg.c_str(); }
+    private:
+      std::string _msg;
+  };
+
+  /**
+   * @brief Write paths of the file sink.
+   */
+  enum class SinkMode : unsigned char {
+      MMAP = 0, /* shared mapping of the file, sized from the expected length */
+      DIRECT    /* O_DIRECT, two aligned buffers written by a background thread */
+  };
+
+  /**
+   * @brief Output file of a response body, without iostreams.
+   * With MMAP the body is copied straight into the page cache pages of the file.
+   * With DIRECT one buffer is filled while the other one is written, bypassing the
+   * page cache (the file systems without O_DIRECT get buffered writes).
+   */
+  class FileSink {
+    public:
+      /**
+       * @param path The file path.
+       * @param mode The write path.
+       */
+      FileSink(const std::string& path, SinkMode mode);
+      virtual ~FileSink();
+      FileSink(const FileSink&) = delete;
+      FileSink& operator=(const FileSink&) = delete;
+
+      /**
+       * @brief Create (or truncate) the file for a new body.
+       * @param size The expected size, 0 if unknown.
+       */
+      auto open(std::size_t size) -> void;
+
+      /**
+       * @brief Append some data.
+       * @param data The data.
+       */
+      auto write(std::string_view data) -> void;
+
+      /**
+       * @brief Flush the data and cut the file to the written size.
+       */
+      auto close() -> void;
+
+      /**
+       * @brief Get the number of bytes written since open.
+       * @return std::size_t
+       */
+      auto written() const -> std::size_t;
+
+      /**
+       * @brief Get the file path.
+       * @return const std::string&
+       */
+      auto path() const -> const std::string&;
+
+      /**
+       * @brief Get the name of the active write path (mmap, O_DIRECT or buffered).
+       * @return std::string_view
+       */
+      auto method() const -> std::string_view;
+
+    private:
+      std::string _path;
+      SinkMode _mode;
+      int _fd;
+      bool _direct;
+      std::size_t _written;
+      /* MMAP */
+      char* _map;
+      std::size_t _mapSize;
+      /* DIRECT */
+      char* _buffers[2];
+      std::size_t _current;
+      std::size_t _fill;
+      std::thread _writer;
+      std::mutex _lock;
+      std::condition_variable _cond;
+      int _pending;
+      std::size_t _pendingOffset;
+      std::size_t _pendingSize;
+      bool _stop;
+      int _error;
+
+      /**
+       * @brief Grow the mapping (and the file) to hold at least a size.
+       * @param size The size.
+       */
+      auto grow(std::size_t size) -> void;
+
+      /**
+       * @brief Hand the current buffer to the writer once it is idle and switch to the other one.
+       * @param size The number of bytes to write (aligned with O_DIRECT).
+       */
+      auto submit(std::size_t size) -> void;
+
+      /**
+       * @brief Wait until the writer is idle.
+       */
+      auto drain() -> void;
+
+      /**
+       * @brief Writer thread of the DIRECT mode.
+       */
+      auto writer() -> void;
+
+      /**
+       * @brief Release the file and the buffers.
+       */
+      auto release() -> void;
+  };
+
+} /* namespace net */
+
+#endif /* __FILESINK_H__ */
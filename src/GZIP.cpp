@@ -27,7 +27,20 @@ namespace utils {
    * @param compressionlevel Compression level.
    * @return Compressed data data.
    */
-  auto GZIP::compress(const string &str, const GZIPMethod &method, int compressionlevel) -> string {
+  auto GZIP::compress(std::string_view str, const GZIPMethod &method, int compressionlevel) -> string {
+    string outstring;
+    compress(str, method, outstring, compressionlevel);
+    return outstring;
+  }
+
+  /**
+   * @brief Compress data into a string whose capacity is reused.
+   * @param str Plain data.
+   * @param method Compression method.
+   * @param outstring Compressed data (replaced).
+   * @param compressionlevel Compression level.
+   */
+  auto GZIP::compress(std::string_view str, const GZIPMethod &method, string& outstring, int compressionlevel) -> void {
     z_stream zs;                        // z_stream is zlib's control structure
     memset(&zs, 0, sizeof(zs));
     if(method == GZIPMethod::DEFLATE) {
@@ -49,7 +62,7 @@ namespace utils {
 
     int ret;
     char outbuffer[32768];
-    string outstring;
+    outstring.clear();
 
     // retrieve the compressed bytes blockwise
     do {
@@ -71,8 +84,6 @@ namespace utils {
       oss << "Exception during zlib compression: (" << ret << ") " << zs.msg;
       throw(std::runtime_error(oss.str()));
     }
-
-    return outstring;
   }
 
   /**
@@ -81,7 +92,19 @@ namespace utils {
    * @param method Decompression method.
    * @return Decompressed data data.
    */
-  auto GZIP::decompress(const string &str, const GZIPMethod &method) -> string {
+  auto GZIP::decompress(std::string_view str, const GZIPMethod &method) -> string {
+    string outstring;
+    decompress(str, method, outstring);
+    return outstring;
+  }
+
+  /**
+   * @brief Decompress data into a string whose capacity is reused.
+   * @param str Compressed data.
+   * @param method Decompression method.
+   * @param outstring Decompressed data (replaced).
+   */
+  auto GZIP::decompress(std::string_view str, const GZIPMethod &method, string& outstring) -> void {
     z_stream zs;                        // z_stream is zlib's control structure
     memset(&zs, 0, sizeof(zs));
 
@@ -97,7 +120,7 @@ namespace utils {
 
     int ret;
     char outbuffer[32768];
-    string outstring;
+    outstring.clear();
 
     // get the decompressed bytes blockwise using repeated calls to inflate
     do {
@@ -121,8 +144,6 @@ namespace utils {
 	  << zs.msg;
       throw(std::runtime_error(oss.str()));
     }
-
-    return outstring;
   }
 
 
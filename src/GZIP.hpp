@@ -10,6 +10,7 @@
 #define __GZIP_H__
 
 #include <string>
+#include <string_view>
 #include <zlib.h>
 
 namespace utils {
@@ -32,7 +33,16 @@ namespace utils {
        * @param compressionlevel Compression level.
        * @return Compressed data data.
        */
-      static auto compress(const std::string &str, const GZIPMethod &method, int compressionlevel = Z_BEST_COMPRESSION) -> std::string;
+      static auto compress(std::string_view str, const GZIPMethod &method, int compressionlevel = Z_BEST_COMPRESSION) -> std::string;
+
+      /**
+       * @brief Compress data into a string whose capacity is reused.
+       * @param str Plain data.
+       * @param method Compression method.
+       * @param out Compressed data (replaced).
+       * @param compressionlevel Compression level.
+       */
+      static auto compress(std::string_view str, const GZIPMethod &method, std::string& out, int compressionlevel = Z_BEST_COMPRESSION) -> void;
 
      
       /**
@@ -41,7 +51,15 @@ namespace utils {
        * @param method Decompression method.
        * @return Decompressed data data.
        */
-     static auto decompress(const std::string &str, const GZIPMethod &method) -> std::string;
+     static auto decompress(std::string_view str, const GZIPMethod &method) -> std::string;
+
+      /**
+       * @brief Decompress data into a string whose capacity is reused.
+       * @param str Compressed data.
+       * @param method Decompression method.
+       * @param out Decompressed data (replaced).
+       */
+     static auto decompress(std::string_view str, const GZIPMethod &method, std::string& out) -> void;
   };
 
 } /* namespace utils */
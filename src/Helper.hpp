@@ -11,6 +11,7 @@
 
 
 #include <string>
+#include <string_view>
 #include <algorithm>
 #include <sstream>
 #include <vector>
@@ -22,6 +23,14 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include "HexDump.hpp"
+#include <thread>
+#include <random>
+#include <pthread.h>
+#include <sched.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace helper {
 
@@ -40,17 +49,14 @@ namespace helper {
       virtual ~Helper() = default;
 
       static auto generateHexString(std::size_t size) -> std::string {
-	static bool srand_init = false;
 	static const std::string hexdigit = "0123456789abcdef";
-	std::ostringstream oss;
-	if(!srand_init) {
-	  srand_init = true;
-	  srand(time(NULL));
-	}
-	for(std::size_t i = 0; i < size; ++i)
-	  oss << hexdigit.at(rand() % sizeof hexdigit);
-	oss << '\0';
-	return oss.str();
+	/* one generator per thread, the clients of the load workers are built concurrently */
+	thread_local std::mt19937 generator(std::random_device{}());
+	std::uniform_int_distribution<std::size_t> digit(0, hexdigit.size() - 1);
+	std::string hex(size, '0');
+	for(char& c : hex)
+	  c = hexdigit[digit(generator)];
+	return hex;
       }
 
       /**
@@ -86,35 +92,134 @@ namespace helper {
 	return s;
       }
 
+      /**
+       * @brief Trim a string view (without copy).
+       * @param str The string to trim.
+       * @param delim The delimitor.
+       * @return the trimed view.
+       */
+      static auto trim(std::string_view str, char delim = ' ') -> std::string_view {
+	std::string_view::size_type pos = str.find_first_not_of(delim);
+	if(pos == std::string_view::npos) return std::string_view();
+	return str.substr(pos, str.find_last_not_of(delim) - pos + 1);
+      }
+
       static auto http_label(bool ssl) -> std::string {
 	return std::string("http") + std::string((ssl ? "s://" : "://"));
       }
 
       /**
-       * @brief Encode an URL
+       * @brief Encode an URL.
+       * The unreserved characters (RFC 3986) and the characters of the except list are kept as is,
+       * the runs of unreserved characters are skipped with SIMD and the output is reserved only once.
        * @param value The URL to encode.
+       * @param except The characters that are not encoded.
        * @return the endoded URL.
        */
-      static auto urlEncode(const std::string &value, const std::string &except = "") -> std::string{
-	std::ostringstream escaped;
-	escaped.fill('0');
-	escaped << std::hex;
+      static auto urlEncode(const std::string &value, const std::string &except = "") -> std::string {
+	std::string out;
+	urlEncode(value, except, out);
+	return out;
+      }
+
+      /**
+       * @brief Encode an URL into a string whose capacity is reused.
+       * @param value The URL to encode.
+       * @param except The characters that are not encoded.
+       * @param out The endoded URL (replaced).
+       */
+      static auto urlEncode(std::string_view value, std::string_view except, std::string& out) -> void {
+	static const char* hexdigit = "0123456789ABCDEF";
+	unsigned char safe[256];
+	urlSafeTable(safe, except);
+	const unsigned char* begin = reinterpret_cast<const unsigned char*>(value.data());
+	const unsigned char* end = begin + value.size();
+	const unsigned char* p;
 
-	for (std::string::const_iterator i = value.begin(), n = value.end(); i != n; ++i) {
-	  std::string::value_type c = (*i);
+	/* first pass: count the characters to escape */
+	std::size_t escaped = 0;
+	for(p = begin; p != end; ++p) {
+	  p += urlUnreservedSpan(p, end - p);
+	  if(p == end) break;
+	  escaped += !safe[*p];
+	}
+	if(!escaped) {
+	  out.assign(value.data(), value.size());
+	  return;
+	}
 
-	  // Keep alphanumeric and other accepted characters intact
-	  if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~' || except.find(c) != std::string::npos) {
-            escaped << c;
+	/* second pass: fill the output */
+	out.resize(value.size() + (escaped << 1));
+	char* o = &out[0];
+	for(p = begin; p != end; ++p) {
+	  std::size_t run = urlUnreservedSpan(p, end - p);
+	  memcpy(o, p, run);
+	  o += run;
+	  p += run;
+	  if(p == end) break;
+	  if(safe[*p]) {
+	    *(o++) = static_cast<char>(*p);
             continue;
 	  }
+	  *(o++) = '%';
+	  *(o++) = hexdigit[*p >> 4];
+	  *(o++) = hexdigit[*p & 0x0f];
+	}
+      }
+
+      /**
+       * @brief Write a string as the content of a JSON string (quotes, backslashes and control characters escaped).
+       * @param os The output stream.
+       * @param value The string.
+       */
+      static auto jsonEscape(std::ostream& os, std::string_view value) -> void {
+	static const char* hexdigit = "0123456789abcdef";
+	for(char c : value) {
+	  switch(c) {
+	    case '"': os << "\\\""; break;
+	    case '\\': os << "\\\\"; break;
+	    case '\n': os << "\\n"; break;
+	    case '\r': os << "\\r"; break;
+	    case '\t': os << "\\t"; break;
+	    default:
+	      if(static_cast<unsigned char>(c) < 0x20)
+		os << "\\u00" << hexdigit[c >> 4] << hexdigit[c & 0x0f];
+	      else
+		os << c;
+	  }
+	}
+      }
 
-	  // Any other characters are percent-encoded
-	  escaped << std::uppercase;
-	  escaped << '%' << std::setw(2) << int((unsigned char) c);
-	  escaped << std::nouppercase;
-	}	
-	return escaped.str();
+      /**
+       * @brief Decode an URL.
+       * The malformed escape sequences are copied as is.
+       * @param value The URL to decode.
+       * @param plusAsSpace Decode '+' as a space (form url encoded).
+       * @return the decoded URL.
+       */
+      static auto urlDecode(const std::string &value, bool plusAsSpace = false) -> std::string {
+	static const unsigned char* unhex = urlUnhexTable();
+	std::string out;
+	out.resize(value.size());
+	const unsigned char* p = reinterpret_cast<const unsigned char*>(value.data());
+	const unsigned char* end = p + value.size();
+	char* o = &out[0];
+	while(p != end) {
+	  std::size_t run = urlUnreservedSpan(p, end - p);
+	  memcpy(o, p, run);
+	  o += run;
+	  p += run;
+	  if(p == end) break;
+	  if(*p == '%' && end - p > 2 && unhex[p[1]] != 0xff && unhex[p[2]] != 0xff) {
+	    *(o++) = static_cast<char>((unhex[p[1]] << 4) | unhex[p[2]]);
+	    p += 3;
+	  } else {
+	    *(o++) = (plusAsSpace && *p == '+') ? ' ' : static_cast<char>(*p);
+	    p++;
+	  }
+	}
+	out.resize(o - out.data());
+	return out;
       }
 
 
@@ -134,46 +239,66 @@ namespace helper {
 	return stream.str();
       }
 
+      /**
+       * @brief Dump a buffer in hex format.
+       * @param buffer The buffer.
+       * @param len The buffer length.
+       * @param print_raw Only prints the hex digits.
+       * @return The dump.
+       */
       static auto print_hex(unsigned char* buffer, int len, bool print_raw = false) -> std::string {
 	std::ostringstream oss;
-	int i = 0, max = 16, loop = len;
-	unsigned char *p = buffer;
-	char line [max + 3]; /* spaces + \0 */
-	memset(line, 0, sizeof(line));
-	while(loop--) {
-	  unsigned char c = *(p++);
-	  if(!print_raw) {
-	    oss << int_to_hex(c) << " ";
-	    /* only the visibles char */
-	    if(c >= 0x20 && c <= 0x7e) line[i] = c;
-	    /* else mask with '.' */
-	    else line[i] = 0x2e; /* . */
-	  } else oss << int_to_hex(c);
-	  
-	  /* next line */
-	  if(i == max) {
-	    if(!print_raw) oss << "  " << line << "\n";
-	    else oss << "\n";
-	    /* re init */
-	    i = 0;
-	    memset(line, 0, sizeof(line));
-	  }
-	  /* next */
-	  else i++;
-	  /* add a space in the midline */
-	  if(i == max / 2 && !print_raw) {
-	    oss << " ";
-	    line[i++] = 0x20;
-	  }
-	}
-	/* align 'line'*/
-	if(i != 0 && (i <= max || i <= len) && !print_raw) {
-	  while(i++ <= max) oss << "   "; /* 3 spaces ex: "00 " */
-	  oss << line;
-	}
+	HexDump dump(oss, print_raw);
+	dump.write(reinterpret_cast<const char*>(buffer), len);
+	dump.finish();
 	return oss.str();
       }
 
+      /**
+       * @brief Get the cores allowed to the process (its cpuset), read by the first call,
+       * before any pinning narrows the affinity of the calling thread.
+       * @return The allowed cores in ascending order.
+       */
+      static auto allowedCores() -> const std::vector<unsigned int>& {
+	static const std::vector<unsigned int> cores = []() {
+	  std::vector<unsigned int> allowed;
+	  cpu_set_t set;
+	  CPU_ZERO(&set);
+	  if(sched_getaffinity(0, sizeof(set), &set) == 0)
+	    for(unsigned int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+	      if(CPU_ISSET(cpu, &set)) allowed.push_back(cpu);
+	  return allowed;
+	}();
+	return cores;
+      }
+
+      /**
+       * @brief Get the n-th allowed core after a core, wrapping around the allowed cores.
+       * @param cpu The reference core.
+       * @param n The rank after the reference core.
+       * @return The core (cpu itself if no core is allowed).
+       */
+      static auto nextCore(unsigned int cpu, unsigned int n) -> unsigned int {
+	const std::vector<unsigned int>& cores = allowedCores();
+	if(cores.empty()) return cpu;
+	std::size_t first = static_cast<std::size_t>(std::lower_bound(cores.begin(), cores.end(), cpu) - cores.begin());
+	return cores[(first + n) % cores.size()];
+      }
+
+      /**
+       * @brief Pin the calling thread on a core (the threads it creates inherit the affinity).
+       * @param cpu The core, it must belong to the allowed cores.
+       * @return false on error.
+       */
+      static auto pinThread(unsigned int cpu) -> bool {
+	const std::vector<unsigned int>& cores = allowedCores();
+	if(!std::binary_search(cores.begin(), cores.end(), cpu)) return false;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+      }
+
       static auto toHumanStringSize(std::size_t size) -> std::string {
 	std::ostringstream sf;
 	double d = static_cast<double>(size);
@@ -187,7 +312,75 @@ namespace helper {
 	  sf << std::setprecision(2) << (d/SIZE_1GB) << " Gb";
 	return sf.str();
       }
-      
+
+    private:
+
+      /**
+       * @brief Build the 256 entries table of the characters kept as is by urlEncode.
+       * @param table The output table.
+       * @param except The characters that are not encoded.
+       */
+      static auto urlSafeTable(unsigned char table[256], std::string_view except) -> void {
+	for(int c = 0; c < 256; ++c)
+	  table[c] = ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+		      c == '-' || c == '_' || c == '.' || c == '~');
+	for(char c : except)
+	  table[static_cast<unsigned char>(c)] = 1;
+      }
+
+      /**
+       * @brief Get the table used to convert an hex digit to its value (0xff for the invalid digits).
+       * @return The 256 entries table.
+       */
+      static auto urlUnhexTable() -> const unsigned char* {
+	static unsigned char table[256];
+	memset(table, 0xff, sizeof(table));
+	for(int c = 0; c < 10; ++c) table['0' + c] = c;
+	for(int c = 0; c < 6; ++c) table['a' + c] = table['A' + c] = 10 + c;
+	return table;
+      }
+
+      /**
+       * @brief Get the length of the leading run of unreserved characters (RFC 3986).
+       * @param p The buffer.
+       * @param len The buffer length.
+       * @return The run length.
+       */
+      static auto urlUnreservedSpan(const unsigned char* p, std::size_t len) -> std::size_t {
+	std::size_t i = 0;
+#if defined(__SSE2__)
+	const __m128i d0 = _mm_set1_epi8('0' - 1), d9 = _mm_set1_epi8('9' + 1);
+	const __m128i la = _mm_set1_epi8('a' - 1), lz = _mm_set1_epi8('z' + 1);
+	const __m128i ua = _mm_set1_epi8('A' - 1), uz = _mm_set1_epi8('Z' + 1);
+	const __m128i dash = _mm_set1_epi8('-'), under = _mm_set1_epi8('_');
+	const __m128i dot = _mm_set1_epi8('.'), tilde = _mm_set1_epi8('~');
+	for(; i + 16 <= len; i += 16) {
+	  __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+	  /* the bytes >= 0x80 are negative and never match a range */
+	  __m128i m = _mm_and_si128(_mm_cmpgt_epi8(v, d0), _mm_cmplt_epi8(v, d9));
+	  m = _mm_or_si128(m, _mm_and_si128(_mm_cmpgt_epi8(v, la), _mm_cmplt_epi8(v, lz)));
+	  m = _mm_or_si128(m, _mm_and_si128(_mm_cmpgt_epi8(v, ua), _mm_cmplt_epi8(v, uz)));
+	  m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(v, dash), _mm_cmpeq_epi8(v, under)));
+	  m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(v, dot), _mm_cmpeq_epi8(v, tilde)));
+	  unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(m));
+	  if(mask != 0xffff)
+	    return i + __builtin_ctz(~mask);
+	}
+#endif
+	static const unsigned char* unreserved = urlUnreservedTable();
+	while(i < len && unreserved[p[i]]) ++i;
+	return i;
+      }
+
+      /**
+       * @brief Get the table of the unreserved characters (RFC 3986).
+       * @return The 256 entries table.
+       */
+      static auto urlUnreservedTable() -> const unsigned char* {
+	static unsigned char table[256];
+	urlSafeTable(table, "");
+	return table;
+      }
   };
 
 } /* namespace helper */
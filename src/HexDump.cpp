@@ -0,0 +1,184 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#include "HexDump.hpp"
+#include <cstring>
+#include <algorithm>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace helper {
+
+  /* row layout: "00000000  xx xx xx xx xx xx xx xx  xx xx xx xx xx xx xx xx  |................|\n" */
+  constexpr std::size_t ROW_OFFSET_DIGITS = 8;
+  constexpr std::size_t ROW_HEX           = ROW_OFFSET_DIGITS + 2;
+  constexpr std::size_t ROW_ASCII         = ROW_HEX + HEXDUMP_COLUMNS * 3 + 3;
+  constexpr std::size_t ROW_LENGTH        = ROW_ASCII + HEXDUMP_COLUMNS + 2;
+
+  static const char* hexdigit = "0123456789abcdef";
+
+  /**
+   * @brief Lookup tables shared by all the dumps.
+   */
+  struct HexDumpTables {
+      char pairs[256][2];
+      char ascii[256];
+      std::size_t columns[HEXDUMP_COLUMNS];
+      char blank[ROW_LENGTH];
+
+      HexDumpTables() {
+	for(int c = 0; c < 256; ++c) {
+	  pairs[c][0] = hexdigit[c >> 4];
+	  pairs[c][1] = hexdigit[c & 0x0f];
+	  /* only the visibles char, else mask with '.' */
+	  ascii[c] = (c >= 0x20 && c <= 0x7e) ? static_cast<char>(c) : '.';
+	}
+	/* add a space in the midline */
+	for(std::size_t i = 0; i < HEXDUMP_COLUMNS; ++i)
+	  columns[i] = ROW_HEX + i * 3 + (i >= HEXDUMP_COLUMNS / 2 ? 1 : 0);
+	memset(blank, ' ', sizeof(blank));
+	blank[ROW_ASCII - 1] = '|';
+	blank[ROW_LENGTH - 1] = '\n';
+      }
+  };
+
+  static const HexDumpTables tables;
+
+  /**
+   * @brief Expand 16 bytes to 32 hex digits.
+   * @param p The bytes.
+   * @param out The digits.
+   */
+  static inline auto expand16(const unsigned char* p, char* out) -> void {
+#if defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i alpha = _mm_set1_epi8('a' - '0' - 10);
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+    __m128i lo = _mm_and_si128(v, mask);
+    __m128i a = _mm_unpacklo_epi8(hi, lo);
+    __m128i b = _mm_unpackhi_epi8(hi, lo);
+    a = _mm_add_epi8(_mm_add_epi8(a, zero), _mm_and_si128(_mm_cmpgt_epi8(a, nine), alpha));
+    b = _mm_add_epi8(_mm_add_epi8(b, zero), _mm_and_si128(_mm_cmpgt_epi8(b, nine), alpha));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), a);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16), b);
+#else
+    for(std::size_t i = 0; i < HEXDUMP_COLUMNS; ++i)
+      memcpy(out + i * 2, tables.pairs[p[i]], 2);
+#endif
+  }
+
+  HexDump::HexDump(std::ostream& os, bool raw, std::size_t bufferSize) :
+    _os(os), _raw(raw), _buffer(bufferSize < ROW_LENGTH ? ROW_LENGTH : bufferSize), _used(0),
+    _pending(), _pendingLen(0), _offset(0) {
+  }
+
+  HexDump::~HexDump() {
+    flush();
+  }
+
+  /**
+   * @brief Get the number of bytes dumped.
+   * @return std::size_t
+   */
+  auto HexDump::offset() -> std::size_t {
+    return _offset + _pendingLen;
+  }
+
+  /**
+   * @brief Reset the offset and drop the pending partial row.
+   */
+  auto HexDump::reset() -> void {
+    _offset = 0;
+    _pendingLen = 0;
+  }
+
+  /**
+   * @brief Write the output buffer to the stream.
+   */
+  auto HexDump::flush() -> void {
+    if(_used) {
+      _os.write(_buffer.data(), _used);
+      _used = 0;
+    }
+  }
+
+  /**
+   * @brief Dump some data.
+   * @param data The data.
+   * @param len The data length.
+   */
+  auto HexDump::write(const char* data, std::size_t len) -> void {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    /* complete the partial row of the previous call */
+    if(_pendingLen) {
+      std::size_t n = std::min(len, HEXDUMP_COLUMNS - _pendingLen);
+      memcpy(_pending + _pendingLen, p, n);
+      _pendingLen += n;
+      p += n;
+      len -= n;
+      if(_pendingLen < HEXDUMP_COLUMNS) return;
+      _pendingLen = 0;
+      row(_pending, HEXDUMP_COLUMNS);
+    }
+    for(; len >= HEXDUMP_COLUMNS; p += HEXDUMP_COLUMNS, len -= HEXDUMP_COLUMNS)
+      row(p, HEXDUMP_COLUMNS);
+    memcpy(_pending, p, len);
+    _pendingLen = len;
+  }
+
+  /**
+   * @brief Dump the pending partial row and flush the output buffer.
+   */
+  auto HexDump::finish() -> void {
+    if(_pendingLen) {
+      row(_pending, _pendingLen);
+      _pendingLen = 0;
+    }
+    flush();
+    _os.flush();
+  }
+
+  /**
+   * @brief Append a row to the output buffer.
+   * @param p The row bytes.
+   * @param n The number of bytes (a partial row is padded).
+   */
+  auto HexDump::row(const unsigned char* p, std::size_t n) -> void {
+    if(_buffer.size() - _used < ROW_LENGTH) flush();
+    char* o = _buffer.data() + _used;
+    char digits[HEXDUMP_COLUMNS * 2];
+    if(n == HEXDUMP_COLUMNS)
+      expand16(p, digits);
+    else
+      for(std::size_t i = 0; i < n; ++i)
+	memcpy(digits + i * 2, tables.pairs[p[i]], 2);
+    if(_raw) {
+      memcpy(o, digits, n * 2);
+      o[n * 2] = '\n';
+      _used += n * 2 + 1;
+    } else {
+      memcpy(o, tables.blank, ROW_LENGTH);
+      std::size_t off = _offset;
+      for(std::size_t i = ROW_OFFSET_DIGITS; i; --i, off >>= 4)
+	o[i - 1] = hexdigit[off & 0x0f];
+      for(std::size_t i = 0; i < n; ++i) {
+	memcpy(o + tables.columns[i], digits + i * 2, 2);
+	o[ROW_ASCII + i] = tables.ascii[p[i]];
+      }
+      o[ROW_ASCII + n] = '|';
+      o[ROW_ASCII + n + 1] = '\n';
+      _used += ROW_ASCII + n + 2;
+    }
+    _offset += n;
+  }
+
+} /* namespace helper */
@@ -0,0 +1,83 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#ifndef __HEXDUMP_H__
+#define __HEXDUMP_H__
+
+#include <ostream>
+#include <vector>
+#include <cstddef>
+
+namespace helper {
+
+  constexpr std::size_t HEXDUMP_COLUMNS = 16;
+  constexpr std::size_t HEXDUMP_BUFFER = 0x40000;
+
+  /**
+   * @brief Streaming hex dump writer.
+   * The rows are built from lookup tables into a large output buffer and the partial
+   * rows are kept between two calls to write, so the offsets stay correct across the reads.
+   */
+  class HexDump {
+    public:
+      /**
+       * @param os The output stream.
+       * @param raw Only prints the hex digits (16 bytes per line).
+       * @param bufferSize The output buffer size.
+       */
+      HexDump(std::ostream& os, bool raw = false, std::size_t bufferSize = HEXDUMP_BUFFER);
+      ~HexDump();
+
+      /**
+       * @brief Dump some data.
+       * @param data The data.
+       * @param len The data length.
+       */
+      auto write(const char* data, std::size_t len) -> void;
+
+      /**
+       * @brief Dump the pending partial row and flush the output buffer.
+       */
+      auto finish() -> void;
+
+      /**
+       * @brief Reset the offset and drop the pending partial row.
+       */
+      auto reset() -> void;
+
+      /**
+       * @brief Get the number of bytes dumped.
+       * @return std::size_t
+       */
+      auto offset() -> std::size_t;
+
+    private:
+      std::ostream& _os;
+      bool _raw;
+      std::vector<char> _buffer;
+      std::size_t _used;
+      unsigned char _pending[HEXDUMP_COLUMNS];
+      std::size_t _pendingLen;
+      std::size_t _offset;
+
+      /**
+       * @brief Append a row to the output buffer.
+       * @param p The row bytes.
+       * @param n The number of bytes (a partial row is padded).
+       */
+      auto row(const unsigned char* p, std::size_t n) -> void;
+
+      /**
+       * @brief Write the output buffer to the stream.
+       */
+      auto flush() -> void;
+  };
+
+} /* namespace helper */
+
+#endif /* __HEXDUMP_H__ */
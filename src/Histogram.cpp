@@ -0,0 +1,240 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#include "Histogram.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+
+namespace helper {
+
+  constexpr std::size_t SUB_COUNT = std::size_t(1) << HISTOGRAM_SUB_BITS;
+  constexpr std::size_t HALF_COUNT = SUB_COUNT >> 1;
+  constexpr std::uint64_t MAX_VALUE = (std::uint64_t(1) << HISTOGRAM_MAX_BITS) - 1;
+  /* the values below SUB_COUNT are exact, then HALF_COUNT buckets per power of two */
+  constexpr std::size_t BUCKETS = SUB_COUNT + (HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS) * HALF_COUNT;
+
+  Histogram::Histogram() : _counts(BUCKETS, 0), _total(0), _min(std::numeric_limits<std::uint64_t>::max()),
+			   _max(0), _sum(0.0), _sum2(0.0) {
+  }
+
+  /**
+   * @brief Get the number of buckets.
+   * @return std::size_t
+   */
+  auto Histogram::buckets() -> std::size_t {
+    return BUCKETS;
+  }
+
+  /**
+   * @brief Get the bucket of a value.
+   * @param value The value.
+   * @return std::size_t
+   */
+  auto Histogram::bucket(std::uint64_t value) -> std::size_t {
+    return index(std::min(value, MAX_VALUE));
+  }
+
+  /**
+   * @brief Get the bucket of a value.
+   * @param value The value.
+   * @return std::size_t
+   */
+  auto Histogram::index(std::uint64_t value) -> std::size_t {
+    if(value < SUB_COUNT) return static_cast<std::size_t>(value);
+    unsigned int shift = (63 - __builtin_clzll(value)) - (HISTOGRAM_SUB_BITS - 1);
+    /* top is in [HALF_COUNT, SUB_COUNT) */
+    std::size_t top = static_cast<std::size_t>(value >> shift);
+    return SUB_COUNT + (shift - 1) * HALF_COUNT + (top - HALF_COUNT);
+  }
+
+  /**
+   * @brief Get the lowest value of a bucket.
+   * @param index The bucket.
+   * @return std::uint64_t
+   */
+  auto Histogram::lowest(std::size_t index) -> std::uint64_t {
+    if(index < SUB_COUNT) return index;
+    std::size_t shift = (index - SUB_COUNT) / HALF_COUNT + 1;
+    std::uint64_t top = (index - SUB_COUNT) % HALF_COUNT + HALF_COUNT;
+    return top << shift;
+  }
+
+  /**
+   * @brief Get the highest value of a bucket.
+   * @param index The bucket.
+   * @return std::uint64_t
+   */
+  auto Histogram::highest(std::size_t index) -> std::uint64_t {
+    if(index < SUB_COUNT) return index;
+    std::size_t shift = (index - SUB_COUNT) / HALF_COUNT + 1;
+    return lowest(index) + (std::uint64_t(1) << shift) - 1;
+  }
+
+  /**
+   * @brief Record a value.
+   * @param value The value.
+   * @param count The number of occurrences.
+   */
+  auto Histogram::record(std::uint64_t value, std::uint64_t count) -> void {
+    if(!count) return;
+    value = std::min(value, MAX_VALUE);
+    _counts[index(value)] += count;
+    _total += count;
+    _min = std::min(_min, value);
+    _max = std::max(_max, value);
+    double v = static_cast<double>(value);
+    _sum += v * count;
+    _sum2 += v * v * count;
+  }
+
+  /**
+   * @brief Record the values of a bucket (counted at the middle of the bucket).
+   * @param bucket The bucket.
+   * @param count The number of occurrences.
+   */
+  auto Histogram::recordBucket(std::size_t bucket, std::uint64_t count) -> void {
+    if(bucket < BUCKETS)
+      record(lowest(bucket) + (highest(bucket) - lowest(bucket)) / 2, count);
+  }
+
+  /**
+   * @brief Add all the values of another histogram.
+   * @param other The histogram.
+   */
+  auto Histogram::merge(const Histogram& other) -> void {
+    if(!other._total) return;
+    for(std::size_t i = 0; i < BUCKETS; ++i)
+      _counts[i] += other._counts[i];
+    _total += other._total;
+    _min = std::min(_min, other._min);
+    _max = std::max(_max, other._max);
+    _sum += other._sum;
+    _sum2 += other._sum2;
+  }
+
+  /**
+   * @brief Remove all the values.
+   */
+  auto Histogram::reset() -> void {
+    std::fill(_counts.begin(), _counts.end(), 0);
+    _total = 0;
+    _min = std::numeric_limits<std::uint64_t>::max();
+    _max = 0;
+    _sum = _sum2 = 0.0;
+  }
+
+  /**
+   * @brief Get the number of recorded values.
+   * @return std::uint64_t
+   */
+  auto Histogram::count() const -> std::uint64_t {
+    return _total;
+  }
+
+  /**
+   * @brief Get the smallest recorded value.
+   * @return std::uint64_t
+   */
+  auto Histogram::min() const -> std::uint64_t {
+    return _total ? _min : 0;
+  }
+
+  /**
+   * @brief Get the largest recorded value.
+   * @return std::uint64_t
+   */
+  auto Histogram::max() const -> std::uint64_t {
+    return _max;
+  }
+
+  /**
+   * @brief Get the mean of the recorded values.
+   * @return double
+   */
+  auto Histogram::mean() const -> double {
+    return _total ? _sum / _total : 0.0;
+  }
+
+  /**
+   * @brief Get the standard deviation of the recorded values.
+   * @return double
+   */
+  auto Histogram::stddev() const -> double {
+    if(!_total) return 0.0;
+    double m = mean();
+    return std::sqrt(std::max(0.0, _sum2 / _total - m * m));
+  }
+
+  /**
+   * @brief Get the value at a percentile (highest equivalent value of its bucket).
+   * @param percentile The percentile (0 to 100).
+   * @return std::uint64_t
+   */
+  auto Histogram::percentile(double percentile) const -> std::uint64_t {
+    if(!_total) return 0;
+    percentile = std::min(std::max(percentile, 0.0), 100.0);
+    std::uint64_t wanted = static_cast<std::uint64_t>(std::ceil(percentile / 100.0 * _total));
+    if(wanted == 0) wanted = 1;
+    std::uint64_t seen = 0;
+    for(std::size_t i = 0; i < BUCKETS; ++i) {
+      seen += _counts[i];
+      if(seen >= wanted) return std::min(highest(i), _max);
+    }
+    return _max;
+  }
+
+  /**
+   * @brief Export the full distribution with the HdrHistogram percentile format.
+   * @param os The output stream.
+   * @param scale The values are divided by this ratio (1e6 to print nanoseconds in milliseconds).
+   */
+  auto Histogram::exportDistribution(std::ostream& os, double scale) const -> void {
+    std::ios_base::fmtflags flags = os.flags();
+    std::streamsize precision = os.precision();
+    os << std::fixed << std::setw(12) << "Value" << " " << std::setw(14) << "Percentile" << " "
+       << std::setw(10) << "TotalCount" << " " << std::setw(14) << "1/(1-Percentile)" << "\n\n";
+    std::uint64_t seen = 0;
+    for(std::size_t i = 0; i < BUCKETS && seen < _total; ++i) {
+      if(!_counts[i]) continue;
+      seen += _counts[i];
+      double p = static_cast<double>(seen) / _total;
+      os << std::setw(12) << std::setprecision(3) << std::min(highest(i), _max) / scale << " "
+	 << std::setw(14) << std::setprecision(12) << p << " "
+	 << std::setw(10) << seen << " ";
+      if(seen < _total)
+	os << std::setw(14) << std::setprecision(2) << 1.0 / (1.0 - p) << "\n";
+      else
+	os << "\n";
+    }
+    os << std::setprecision(3)
+       << "#[Mean    = " << std::setw(12) << mean() / scale << ", StdDeviation   = " << std::setw(12) << stddev() / scale << "]\n"
+       << "#[Max     = " << std::setw(12) << _max / scale << ", Total count    = " << std::setw(12) << _total << "]\n"
+       << "#[Buckets = " << std::setw(12) << (HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1)
+       << ", SubBuckets     = " << std::setw(12) << SUB_COUNT << "]\n";
+    os.flags(flags);
+    os.precision(precision);
+  }
+
+  LiveHistogram::LiveHistogram() : _counts(new std::atomic<std::uint64_t>[BUCKETS]) {
+    for(std::size_t i = 0; i < BUCKETS; ++i)
+      _counts[i].store(0, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Copy the cumulative counts (any thread).
+   * @param counts The counts, resized to Histogram::buckets().
+   */
+  auto LiveHistogram::snapshot(std::vector<std::uint64_t>& counts) const -> void {
+    counts.resize(BUCKETS);
+    for(std::size_t i = 0; i < BUCKETS; ++i)
+      counts[i] = _counts[i].load(std::memory_order_relaxed);
+  }
+
+} /* namespace helper */
@@ -0,0 +1,175 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#ifndef __HISTOGRAM_H__
+#define __HISTOGRAM_H__
+
+#include <ostream>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+namespace helper {
+
+  /* 2^(HISTOGRAM_SUB_BITS-1) buckets per power of two: 0.2% relative precision */
+  constexpr unsigned int HISTOGRAM_SUB_BITS = 10;
+  /* larger values are clamped (2^40 ns is about 18 minutes) */
+  constexpr unsigned int HISTOGRAM_MAX_BITS = 40;
+
+  /**
+   * @brief HDR-like histogram: log-bucketed with linear sub-buckets, constant time
+   * record, fixed memory and a bounded relative error over the whole range.
+   */
+  class Histogram {
+    public:
+      Histogram();
+
+      /**
+       * @brief Record a value.
+       * @param value The value.
+       * @param count The number of occurrences.
+       */
+      auto record(std::uint64_t value, std::uint64_t count = 1) -> void;
+
+      /**
+       * @brief Add all the values of another histogram.
+       * @param other The histogram.
+       */
+      auto merge(const Histogram& other) -> void;
+
+      /**
+       * @brief Remove all the values.
+       */
+      auto reset() -> void;
+
+      /**
+       * @brief Get the number of recorded values.
+       * @return std::uint64_t
+       */
+      auto count() const -> std::uint64_t;
+
+      /**
+       * @brief Get the smallest recorded value.
+       * @return std::uint64_t
+       */
+      auto min() const -> std::uint64_t;
+
+      /**
+       * @brief Get the largest recorded value.
+       * @return std::uint64_t
+       */
+      auto max() const -> std::uint64_t;
+
+      /**
+       * @brief Get the mean of the recorded values.
+       * @return double
+       */
+      auto mean() const -> double;
+
+      /**
+       * @brief Get the standard deviation of the recorded values.
+       * @return double
+       */
+      auto stddev() const -> double;
+
+      /**
+       * @brief Get the value at a percentile (highest equivalent value of its bucket).
+       * @param percentile The percentile (0 to 100).
+       * @return std::uint64_t
+       */
+      auto percentile(double percentile) const -> std::uint64_t;
+
+      /**
+       * @brief Record the values of a bucket (counted at the middle of the bucket).
+       * @param bucket The bucket.
+       * @param count The number of occurrences.
+       */
+      auto recordBucket(std::size_t bucket, std::uint64_t count) -> void;
+
+      /**
+       * @brief Get the number of buckets.
+       * @return std::size_t
+       */
+      static auto buckets() -> std::size_t;
+
+      /**
+       * @brief Get the bucket of a value.
+       * @param value The value.
+       * @return std::size_t
+       */
+      static auto bucket(std::uint64_t value) -> std::size_t;
+
+      /**
+       * @brief Export the full distribution with the HdrHistogram percentile format.
+       * @param os The output stream.
+       * @param scale The values are divided by this ratio (1e6 to print nanoseconds in milliseconds).
+       */
+      auto exportDistribution(std::ostream& os, double scale = 1.0) const -> void;
+
+    private:
+      std::vector<std::uint64_t> _counts;
+      std::uint64_t _total;
+      std::uint64_t _min;
+      std::uint64_t _max;
+      double _sum;
+      double _sum2;
+
+      /**
+       * @brief Get the bucket of a value.
+       * @param value The value.
+       * @return std::size_t
+       */
+      static auto index(std::uint64_t value) -> std::size_t;
+
+      /**
+       * @brief Get the lowest value of a bucket.
+       * @param index The bucket.
+       * @return std::uint64_t
+       */
+      static auto lowest(std::size_t index) -> std::uint64_t;
+
+      /**
+       * @brief Get the highest value of a bucket.
+       * @param index The bucket.
+       * @return std::uint64_t
+       */
+      static auto highest(std::size_t index) -> std::uint64_t;
+  };
+
+  /**
+   * @brief Histogram written by a single thread and read by others without locks.
+   * The counts are cumulative, the readers compute their own deltas from snapshots.
+   */
+  class LiveHistogram {
+    public:
+      LiveHistogram();
+
+      /**
+       * @brief Record a value (owner thread only, no atomic read-modify-write).
+       * @param value The value.
+       */
+      auto record(std::uint64_t value) -> void {
+	std::atomic<std::uint64_t>& c = _counts[Histogram::bucket(value)];
+	c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      }
+
+      /**
+       * @brief Copy the cumulative counts (any thread).
+       * @param counts The counts, resized to Histogram::buckets().
+       */
+      auto snapshot(std::vector<std::uint64_t>& counts) const -> void;
+
+    private:
+      std::unique_ptr<std::atomic<std::uint64_t>[]> _counts;
+  };
+
+} /* namespace helper */
+
+#endif /* __HISTOGRAM_H__ */
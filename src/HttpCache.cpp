@@ -0,0 +1,302 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#include "HttpCache.hpp"
+#include "HttpClient.hpp"
+#include <fstream>
+#include <sstream>
+#include <atomic>
+#include <ctime>
+#include <cstring>
+#include <charconv>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+namespace net {
+  namespace http {
+
+    using std::string;
+    using std::string_view;
+
+    static constexpr string_view CACHE_MAGIC = "httpu-cache 1";
+
+    /**
+     * @brief Trim the spaces of a value.
+     * @param s The value.
+     * @return std::string_view
+     */
+    static auto trim(string_view s) -> string_view {
+      while(!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+      while(!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+      return s;
+    }
+
+    /**
+     * @brief Parse a number of seconds.
+     * @param s The value.
+     * @param value The number.
+     * @return false if the value is not a number.
+     */
+    static auto seconds(string_view s, std::int64_t& value) -> bool {
+      return !s.empty() && std::from_chars(s.data(), s.data() + s.size(), value).ec == std::errc();
+    }
+
+    /**
+     * @brief Get the freshness lifetime of a response from Cache-Control and Age.
+     * @param hdr The response headers.
+     * @param maxAge The lifetime in seconds, -1 to always revalidate.
+     * @return false if the response must not be stored (no-store).
+     */
+    static auto lifetime(HttpHeader& hdr, std::int64_t& maxAge) -> bool {
+      bool noCache = false;
+      maxAge = -1;
+      for(string_view value : hdr.get("Cache-Control")) {
+	while(!value.empty()) {
+	  std::size_t comma = value.find(',');
+	  string_view directive = trim(value.substr(0, comma));
+	  value = comma == string_view::npos ? string_view() : value.substr(comma + 1);
+	  if(directive.size() == 8 && !strncasecmp(directive.data(), "no-store", 8))
+	    return false;
+	  if(directive.size() == 8 && !strncasecmp(directive.data(), "no-cache", 8))
+	    noCache = true;
+	  else if(directive.size() > 8 && !strncasecmp(directive.data(), "max-age=", 8))
+	    seconds(directive.substr(8), maxAge);
+	}
+      }
+      std::int64_t age;
+      if(maxAge >= 0 && seconds(hdr.value("Age"), age)) maxAge = std::max<std::int64_t>(0, maxAge - age);
+      if(noCache) maxAge = -1;
+      return true;
+    }
+
+    /**
+     * @brief Write a file atomically (temporary file and rename).
+     * @param path The file path.
+     * @param parts The content.
+     * @return false on error.
+     */
+    static auto replace(const string& path, std::initializer_list<string_view> parts) -> bool {
+      static std::atomic<unsigned int> counter(0);
+      string tmp = path + ".tmp." + std::to_string(::getpid()) + "." + std::to_string(counter++);
+      int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if(fd == -1) return false;
+      bool ok = true;
+      for(string_view part : parts) {
+	while(ok && !part.empty()) {
+	  ssize_t w = ::write(fd, part.data(), part.size());
+	  if(w < 0 && errno == EINTR) continue;
+	  ok = w > 0;
+	  if(ok) part.remove_prefix(static_cast<std::size_t>(w));
+	}
+      }
+      ok = ::close(fd) == 0 && ok && ::rename(tmp.c_str(), path.c_str()) == 0;
+      if(!ok) ::unlink(tmp.c_str());
+      return ok;
+    }
+
+    CacheBody::CacheBody() : _data(nullptr), _size(0), _mapped(false) {
+    }
+
+    CacheBody::CacheBody(void* data, std::size_t size) : _data(data), _size(size), _mapped(true) {
+    }
+
+    CacheBody::CacheBody(CacheBody&& other) : _data(other._data), _size(other._size), _mapped(other._mapped) {
+      other._data = nullptr;
+      other._size = 0;
+      other._mapped = false;
+    }
+
+    CacheBody& CacheBody::operator=(CacheBody&& other) {
+      if(this != &other) {
+	if(_data != nullptr) ::munmap(_data, _size);
+	_data = other._data;
+	_size = other._size;
+	_mapped = other._mapped;
+	other._data = nullptr;
+	other._size = 0;
+	other._mapped = false;
+      }
+      return *this;
+    }
+
+    CacheBody::~CacheBody() {
+      if(_data != nullptr) ::munmap(_data, _size);
+    }
+
+    /**
+     * @brief Get the body.
+     * @return The body, valid as long as the mapping.
+     */
+    auto CacheBody::view() const -> string_view {
+      return _data == nullptr ? string_view() : string_view(static_cast<const char*>(_data), _size);
+    }
+
+    HttpCache::HttpCache(const string& directory) : _directory(directory) {
+      if(_directory.empty()) _directory = ".";
+      if(::mkdir(_directory.c_str(), 0755) == -1 && errno != EEXIST)
+	throw HttpClientException("Unable to create the cache directory " + _directory + ": " + strerror(errno));
+    }
+
+    /**
+     * @brief Get the path of an entry file.
+     * @param key The request key.
+     * @param suffix The file suffix (.meta or .body).
+     * @return std::string
+     */
+    auto HttpCache::path(string_view key, string_view suffix) const -> string {
+      /* FNV-1a, stable between the runs */
+      std::uint64_t h = 0xcbf29ce484222325ULL;
+      for(unsigned char c : key) {
+	h ^= c;
+	h *= 0x100000001b3ULL;
+      }
+      char name[17];
+      snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(h));
+      return _directory + "/" + name + string(suffix);
+    }
+
+    /**
+     * @brief Find the entry of a key.
+     * @param key The request key.
+     * @param entry The entry.
+     * @return false if the key is not cached.
+     */
+    auto HttpCache::lookup(string_view key, CacheEntry& entry) const -> bool {
+      std::ifstream ifs(path(key, ".meta"), std::ios::binary);
+      if(!ifs.is_open()) return false;
+      string line;
+      if(!std::getline(ifs, line) || line != CACHE_MAGIC) return false;
+      entry = CacheEntry{ "", 0, -1, "", "", "", 0 };
+      std::size_t header = 0;
+      while(std::getline(ifs, line)) {
+	std::size_t space = line.find(' ');
+	string_view name = string_view(line).substr(0, space);
+	string_view value = space == string::npos ? string_view() : string_view(line).substr(space + 1);
+	std::int64_t n = 0;
+	if(name == "key") entry.key = value;
+	else if(name == "stored") seconds(value, entry.stored);
+	else if(name == "max-age") seconds(value, entry.maxAge);
+	else if(name == "etag") entry.etag = value;
+	else if(name == "last-modified") entry.lastModified = value;
+	else if(name == "size" && seconds(value, n)) entry.size = static_cast<std::size_t>(n);
+	else if(name == "header" && seconds(value, n)) {
+	  header = static_cast<std::size_t>(n);
+	  break;
+	}
+      }
+      entry.header.resize(header);
+      ifs.read(entry.header.data(), static_cast<std::streamsize>(header));
+      /* a hash collision is a miss */
+      return ifs.gcount() == static_cast<std::streamsize>(header) && header && entry.key == key;
+    }
+
+    /**
+     * @brief Test if an entry can be used without revalidation.
+     * @param entry The entry.
+     * @return bool
+     */
+    auto HttpCache::fresh(const CacheEntry& entry) -> bool {
+      return entry.maxAge > 0 && static_cast<std::int64_t>(::time(nullptr)) - entry.stored < entry.maxAge;
+    }
+
+    /**
+     * @brief Add the conditional headers revalidating an entry.
+     * @param entry The entry.
+     * @param headers The request headers.
+     */
+    auto HttpCache::conditional(const CacheEntry& entry, std::map<string, string>& headers) -> void {
+      if(!entry.etag.empty()) headers["If-None-Match"] = entry.etag;
+      if(!entry.lastModified.empty()) headers["If-Modified-Since"] = entry.lastModified;
+    }
+
+    /**
+     * @brief Store a response if it is cacheable (200 without no-store nor Vary: *, with a lifetime or a validator).
+     * @param key The request key.
+     * @param hdr The response headers.
+     * @param body The decoded body.
+     * @return true if stored.
+     */
+    auto HttpCache::store(string_view key, HttpHeader& hdr, string_view body) -> bool {
+      /* Vary: * never matches a later request, the other fields are part of the key */
+      if(hdr.code() != 200 || hdr.value("Vary").find('*') != string_view::npos) return false;
+      CacheEntry entry = { string(key), static_cast<std::int64_t>(::time(nullptr)), -1,
+			   string(hdr.value("ETag")), string(hdr.value("Last-Modified")), string(hdr.raw()), body.size() };
+      if(!lifetime(hdr, entry.maxAge)) {
+	/* no-store also evicts the previous response */
+	::unlink(path(key, ".meta").c_str());
+	::unlink(path(key, ".body").c_str());
+	return false;
+      }
+      /* nothing to reuse without a lifetime or a validator */
+      if(entry.maxAge <= 0 && entry.etag.empty() && entry.lastModified.empty()) return false;
+      /* the body first, a new body under an old metadata fails the size check of map */
+      return replace(path(key, ".body"), { body }) && save(entry);
+    }
+
+    /**
+     * @brief Refresh an entry from a 304 response (storage time, lifetime and validators).
+     * @param entry The entry.
+     * @param hdr The 304 response headers.
+     */
+    auto HttpCache::refresh(CacheEntry& entry, HttpHeader& hdr) -> void {
+      entry.stored = static_cast<std::int64_t>(::time(nullptr));
+      std::int64_t maxAge;
+      if(hdr.contains("Cache-Control") && lifetime(hdr, maxAge)) entry.maxAge = maxAge;
+      if(hdr.contains("ETag")) entry.etag = hdr.value("ETag");
+      if(hdr.contains("Last-Modified")) entry.lastModified = hdr.value("Last-Modified");
+      save(entry);
+    }
+
+    /**
+     * @brief Write the metadata of an entry.
+     * @param entry The entry.
+     * @return false on error.
+     */
+    auto HttpCache::save(const CacheEntry& entry) -> bool {
+      std::ostringstream oss;
+      oss << CACHE_MAGIC << "\n";
+      oss << "key " << entry.key << "\n";
+      oss << "stored " << entry.stored << "\n";
+      oss << "max-age " << entry.maxAge << "\n";
+      oss << "etag " << entry.etag << "\n";
+      oss << "last-modified " << entry.lastModified << "\n";
+      oss << "size " << entry.size << "\n";
+      oss << "header " << entry.header.size() << "\n";
+      string meta = oss.str();
+      return replace(path(entry.key, ".meta"), { meta, entry.header });
+    }
+
+    /**
+     * @brief Map the body of an entry.
+     * @param entry The entry.
+     * @return The mapping (empty if the body is missing or truncated).
+     */
+    auto HttpCache::map(const CacheEntry& entry) const -> CacheBody {
+      int fd = ::open(path(entry.key, ".body").c_str(), O_RDONLY);
+      if(fd == -1) return CacheBody();
+      struct stat st;
+      if(::fstat(fd, &st) == -1 || static_cast<std::size_t>(st.st_size) != entry.size) {
+	::close(fd);
+	return CacheBody();
+      }
+      if(entry.size == 0) {
+	::close(fd);
+	return CacheBody(nullptr, 0);
+      }
+      void* data = ::mmap(nullptr, entry.size, PROT_READ, MAP_PRIVATE, fd, 0);
+      ::close(fd);
+      if(data == MAP_FAILED) return CacheBody();
+      ::madvise(data, entry.size, MADV_SEQUENTIAL);
+      return CacheBody(data, entry.size);
+    }
+
+  } /* namespace http */
+} /* namespace net */
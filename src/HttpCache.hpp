@@ -0,0 +1,165 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#ifndef __HTTPCACHE_H__
+#define __HTTPCACHE_H__
+
+#include "HttpHeader.hpp"
+#include <string>
+#include <string_view>
+#include <map>
+#include <cstdint>
+
+namespace net {
+  namespace http {
+
+    /**
+     * @brief Origin of the last response of a client.
+     */
+    enum class CacheStatus : unsigned char {
+	NONE = 0,    /* cache disabled, request or response not cacheable */
+	MISS,        /* fetched from the network and stored */
+	HIT,         /* fresh entry, no network at all */
+	REVALIDATED  /* stale entry confirmed by a 304 */
+    };
+
+    /**
+     * @brief One cached response (the metadata, the body stays on disk).
+     */
+    struct CacheEntry {
+	/**
+	 * @param key The request key (URL).
+	 * @param stored The time of the storage or of the last revalidation (seconds since the epoch).
+	 * @param maxAge The freshness lifetime in seconds, -1 to always revalidate.
+	 * @param etag The ETag validator (empty if none).
+	 * @param lastModified The Last-Modified validator (empty if none).
+	 * @param header The raw response headers.
+	 * @param size The body size.
+	 */
+	std::string key;
+	std::int64_t stored;
+	std::int64_t maxAge;
+	std::string etag;
+	std::string lastModified;
+	std::string header;
+	std::size_t size;
+    };
+
+    /**
+     * @brief Read-only memory mapping of a cached body.
+     */
+    class CacheBody {
+      public:
+	CacheBody();
+	CacheBody(void* data, std::size_t size);
+	CacheBody(CacheBody&& other);
+	CacheBody& operator=(CacheBody&& other);
+	CacheBody(const CacheBody&) = delete;
+	CacheBody& operator=(const CacheBody&) = delete;
+	~CacheBody();
+
+	/**
+	 * @brief Get the body.
+	 * @return The body, valid as long as the mapping.
+	 */
+	auto view() const -> std::string_view;
+
+	/**
+	 * @brief Test if a body is mapped.
+	 */
+	explicit operator bool() const { return _mapped; }
+
+      private:
+	void* _data;
+	std::size_t _size;
+	bool _mapped;
+    };
+
+    /**
+     * @brief On-disk cache of the GET responses (private cache semantics).
+     * Each entry is a metadata file and a body file named from a hash of the URL, both
+     * replaced atomically. The freshness comes from Cache-Control (max-age minus Age,
+     * no-cache, no-store), a stale entry is revalidated with If-None-Match and
+     * If-Modified-Since and a 304 refreshes its metadata only.
+     */
+    class HttpCache {
+      public:
+	/**
+	 * @param directory The cache directory (created if missing).
+	 */
+	HttpCache(const std::string& directory);
+	virtual ~HttpCache() = default;
+
+	/**
+	 * @brief Find the entry of a key.
+	 * @param key The request key.
+	 * @param entry The entry.
+	 * @return false if the key is not cached.
+	 */
+	auto lookup(std::string_view key, CacheEntry& entry) const -> bool;
+
+	/**
+	 * @brief Test if an entry can be used without revalidation.
+	 * @param entry The entry.
+	 * @return bool
+	 */
+	static auto fresh(const CacheEntry& entry) -> bool;
+
+	/**
+	 * @brief Add the conditional headers revalidating an entry.
+	 * @param entry The entry.
+	 * @param headers The request headers.
+	 */
+	static auto conditional(const CacheEntry& entry, std::map<std::string, std::string>& headers) -> void;
+
+	/**
+	 * @brief Store a response if it is cacheable (200 without no-store nor Vary: *, with a lifetime or a validator).
+	 * @param key The request key.
+	 * @param hdr The response headers.
+	 * @param body The decoded body.
+	 * @return true if stored.
+	 */
+	auto store(std::string_view key, HttpHeader& hdr, std::string_view body) -> bool;
+
+	/**
+	 * @brief Refresh an entry from a 304 response (storage time, lifetime and validators).
+	 * @param entry The entry.
+	 * @param hdr The 304 response headers.
+	 */
+	auto refresh(CacheEntry& entry, HttpHeader& hdr) -> void;
+
+	/**
+	 * @brief Map the body of an entry.
+	 * @param entry The entry.
+	 * @return The mapping (empty if the body is missing or truncated).
+	 */
+	auto map(const CacheEntry& entry) const -> CacheBody;
+
+      private:
+	std::string _directory;
+
+	/**
+	 * @brief Get the path of an entry file.
+	 * @param key The request key.
+	 * @param suffix The file suffix (.meta or .body).
+	 * @return std::string
+	 */
+	auto path(std::string_view key, std::string_view suffix) const -> std::string;
+
+	/**
+	 * @brief Write the metadata of an entry.
+	 * @param entry The entry.
+	 * @return false on error.
+	 */
+	auto save(const CacheEntry& entry) -> bool;
+    };
+
+  } /* namespace http */
+} /* namespace net */
+
+#endif /* __HTTPCACHE_H__ */
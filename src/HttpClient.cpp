@@ -14,8 +14,16 @@
 #include <unistd.h>
 #include <map>
 #include <vector>
+#include <optional>
+#include <charconv>
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
 #include "Helper.hpp"
 #include "GZIP.hpp"
+#include "PerfCounters.hpp"
+#include "Trace.hpp"
+#include "BodyFraming.hpp"
 
 namespace net {
   namespace http {
@@ -25,12 +33,14 @@ namespace net {
     using std::map;
     using std::vector;
     using std::string;
+    using std::string_view;
     using std::size_t;
     using std::stringstream;
     using std::ifstream;
     using net::EasySocket;
     using net::http::HttpHeader;
     using helper::Helper;
+    using helper::HexDump;
     using utils::GZIP;
     using utils::GZIPMethod;
 
@@ -39,250 +49,713 @@ namespace net {
     constexpr size_t CHUNK = 1024;
 
 
+    /* the name is built once, not for each lookup */
     #define addDefaultHeader(oss, name, value) do {			\
-      if(_connect.headers.find(name) == _connect.headers.end())		\
-	oss << name << ": " << value << "\r\n";				\
+      static const string header(name);				\
+      if(_connect->headers.find(header) == _connect->headers.end())	\
+	oss << header << ": " << value << "\r\n";			\
     } while(0)
 
-    HttpClient::HttpClient(const string& appname) : _appname(appname), _socket(), 
-						     _port(80), _page("/"), 
-                                                     _content(), _hdr(), _plain(""), _connect(), 
-                                                     _boundary(_appname + Helper::generateHexString(16)) {
+    HttpClient::HttpClient(const string& appname) : _arena(), _appname(appname), _socket(), _host(&_arena),
+						     _port(80), _page("/", &_arena),
+						     _content(&_arena), _hdr(&_arena), _plain(""), _connect(nullptr),
+						     _boundary(_appname + Helper::generateHexString(16)), _query(&_arena), _downloaded(0),
+						     _cache(nullptr), _cached(), _sink(nullptr), _conditional(), _status(CacheStatus::NONE),
+						     _received(), _transformed(), _except(), _key(), _openHost(), _openPort(0) {
     }
     HttpClient::~HttpClient() {
       _socket.disconnect();
     }
 
+    /**
+     * @brief Close the connection and release the state of the previous request (header, body and arena).
+     */
+    auto HttpClient::reset() -> void {
+      _socket.disconnect();
+      release();
+    }
+
+    /**
+     * @brief Release the state of the previous request, the connection stays open for the next one
+     * (in low-memory mode the arena and the buffers are given back).
+     */
+    auto HttpClient::release() -> void {
+      /* everything allocated from the arena must be gone before its reset */
+      _hdr.release();
+      std::pmr::string(&_arena).swap(_host);
+      std::pmr::string(&_arena).swap(_page);
+      std::pmr::string(&_arena).swap(_query);
+      std::pmr::vector<char>(&_arena).swap(_content);
+      _plain.clear();
+      /* the low-memory mode trades the reuse of the buffers for the footprint of the idle clients */
+      if(EasySocket::lowMemory()) {
+	_arena.release();
+	string().swap(_plain);
+	string().swap(_received);
+	string().swap(_transformed);
+      } else
+	_arena.reset();
+      _cached = CacheBody();
+      _downloaded = 0;
+    }
+
     /**
      * @brief Test if the SSL is set.
      */
     auto HttpClient::ssl() -> bool {
       return _socket.ssl();
     }
+    /**
+     * @brief Get the peak memory used by the last connection.
+     * @return std::size_t
+     */
+    auto HttpClient::memoryPeak() -> std::size_t {
+      return _socket.memoryPeak();
+    }
+
+    /**
+     * @brief Test if the handshake of the last connection resumed a previous TLS session.
+     * @return bool
+     */
+    auto HttpClient::sessionReused() -> bool {
+      return _socket.sessionReused();
+    }
+
+    /**
+     * @brief Get the socket descriptor of the open connection.
+     * @return The descriptor, -1 if the connection is closed.
+     */
+    auto HttpClient::fd() -> int {
+      return _socket.fd();
+    }
+
+    /**
+     * @brief Get the phases timings of the last request.
+     * @return Timings&
+     */
+    auto HttpClient::timings() -> Timings& {
+      return _socket.timings();
+    }
+
+    /**
+     * @brief Get a TCP_INFO sample of the last connection (see EasySocket::tcpInfo).
+     * @param point The sampling point.
+     * @return const TcpSample&
+     */
+    auto HttpClient::tcpInfo(TcpPoint point) const -> const TcpSample& {
+      return _socket.tcpInfo(point);
+    }
+
+    /**
+     * @brief Get the kernel timestamps of the last request (see EasySocket::timestamping).
+     * @return const KernelStamps&
+     */
+    auto HttpClient::stamps() const -> const KernelStamps& {
+      return _socket.stamps();
+    }
+
+    /**
+     * @brief Write the last request information using a curl -w like format.
+     * @param os The output stream.
+     * @param format The format.
+     */
+    auto HttpClient::writeOut(std::ostream& os, string_view format) -> void {
+      const Timings& t = _socket.timings();
+      const TcpSample& tcp = _socket.tcpInfo(TcpPoint::CLOSE);
+      /* curl names first, then the httpu phases */
+      const std::pair<string_view, TimingPhase> times[] = {
+	{ "time_namelookup", TimingPhase::DNS },
+	{ "time_connect", TimingPhase::CONNECT },
+	{ "time_appconnect", TimingPhase::TLS },
+	{ "time_pretransfer", TimingPhase::TLS },
+	{ "time_written", TimingPhase::WRITTEN },
+	{ "time_starttransfer", TimingPhase::FIRST_BYTE },
+	{ "time_headers", TimingPhase::HEADERS },
+	{ "time_body", TimingPhase::BODY },
+	{ "time_decompress", TimingPhase::DECOMPRESS },
+	{ "time_total", TimingPhase::DECOMPRESS }
+      };
+      const std::pair<string_view, size_t> sizes[] = {
+	{ "http_code", _hdr.code() },
+	{ "size_header", _hdr.length() },
+	{ "size_download", _downloaded },
+	{ "size_plain", body().empty() && _sink ? _sink->written() : body().size() },
+	/* sampled at the close, 0 without --tcp-info */
+	{ "tcp_rtt", tcp.rtt },
+	{ "tcp_retransmits", tcp.retransmits },
+	{ "tcp_cwnd", tcp.cwnd },
+	{ "tcp_delivery_rate", tcp.deliveryRate },
+	{ "tcp_bytes_acked", tcp.bytesAcked }
+      };
+      /* kernel timestamps, 0 without --timestamps */
+      const KernelStamps& k = _socket.stamps();
+      const std::pair<string_view, std::int64_t> kernel[] = {
+	{ "time_kernel_send", Timestamping::sendDelay(k) },
+	{ "time_network", Timestamping::networkTime(k) },
+	{ "time_kernel_receive", Timestamping::receiveDelay(k) }
+      };
+      /* the host and the page come from the user, escaped inside the JSON */
+      auto url = [this](std::ostream& o, bool json) -> std::ostream& {
+	o << Helper::http_label(_socket.ssl());
+	if(json) Helper::jsonEscape(o, _host);
+	else o << _host;
+	o << ":" << _port;
+	if(json) Helper::jsonEscape(o, _page);
+	else o << _page;
+	return o;
+      };
+      auto time = [&t](const std::pair<string_view, TimingPhase>& v) -> double {
+	/* time_appconnect is 0 without TLS, as curl does */
+	return v.first == "time_appconnect" && !t.has(TimingPhase::TLS) ? 0.0 : t.at(v.second);
+      };
+      auto variable = [&](string_view name) -> bool {
+	os << std::fixed << std::setprecision(6);
+	for(const auto& v : times)
+	  if(v.first == name) {
+	    os << time(v);
+	    return true;
+	  }
+	for(const auto& v : kernel)
+	  if(v.first == name) {
+	    os << std::max<std::int64_t>(v.second, 0) / 1e9;
+	    return true;
+	  }
+	for(const auto& v : sizes)
+	  if(v.first == name) {
+	    os << v.second;
+	    return true;
+	  }
+	if(name == "url_effective") {
+	  url(os, false);
+	  return true;
+	}
+	if(name == "json") {
+	  os << "{";
+	  for(const auto& v : times)
+	    os << "\"" << v.first << "\":" << time(v) << ",";
+	  for(const auto& v : kernel)
+	    os << "\"" << v.first << "\":" << std::max<std::int64_t>(v.second, 0) / 1e9 << ",";
+	  for(const auto& v : sizes)
+	    os << "\"" << v.first << "\":" << v.second << ",";
+	  os << "\"url_effective\":\"";
+	  url(os, true) << "\"}";
+	  return true;
+	}
+	return false;
+      };
+      std::ios_base::fmtflags flags = os.flags();
+      std::streamsize precision = os.precision();
+      for(size_t i = 0; i < format.size(); ++i) {
+	char c = format[i];
+	if(c == '%' && i + 1 < format.size() && format[i + 1] == '%') {
+	  os << '%';
+	  ++i;
+	} else if(c == '%' && i + 1 < format.size() && format[i + 1] == '{') {
+	  size_t end = format.find('}', i + 2);
+	  if(end == string_view::npos || !variable(format.substr(i + 2, end - i - 2))) {
+	    os << c;
+	    continue;
+	  }
+	  i = end;
+	} else if(c == '\\' && i + 1 < format.size()) {
+	  char e = format[++i];
+	  os << (e == 'n' ? '\n' : e == 'r' ? '\r' : e == 't' ? '\t' : e);
+	} else
+	  os << c;
+      }
+      os.flags(flags);
+      os.precision(precision);
+    }
+
     /**
      * @brief Build the content type header.
+     * @param oss The output stream.
      * @param content The query contain content.
      * @param isGet Is get method?
-     * @return The content type.
      */
-    auto HttpClient::makeContentType(bool content, bool isGET) -> std::string {
-      std::ostringstream oss;
-      if(!_connect.multiparts.empty())
-        addDefaultHeader(oss, "Content-Type", "multipart/form-data; boundary=---------------------------" << _boundary);      
-      else if(_connect.isform)
+    auto HttpClient::makeContentType(std::ostream& oss, bool content, bool isGET) -> void {
+      if(!_connect->multiparts.empty())
+	addDefaultHeader(oss, "Content-Type", "multipart/form-data; boundary=---------------------------" << _boundary);
+      else if(_connect->isform)
 	addDefaultHeader(oss, "Content-Type", "application/x-www-form-urlencoded");
-      else if(_connect.gzip)
+      else if(_connect->gzip)
 	addDefaultHeader(oss, "Content-Type", "application/javascript");
       else if(content && !isGET) {
 	addDefaultHeader(oss, "Content-Type", "text/html");
       }
-      return oss.str();
     }
- 
+
     /**
      * @brief Build the query request.
-     * @return The query.
+     * @return The query (valid until the next reset).
      */
-    auto HttpClient::makeQuery() -> string {
-      bool isGET = (_connect.method == "GET");
-      string h = _connect.host;
-      string content =  Helper::fromCharVector(_content);
+    auto HttpClient::makeQuery() -> string_view {
+      bool isGET = (_connect->method == "GET");
+      const std::pmr::string& h = _host;
+      string_view content(_content.data(), _content.size());
       bool deflate = false;
       bool gzip = false;
       // if(h.back() != '/') h += "/";
-      std::ostringstream oss;
-      oss << _connect.method << " " << Helper::http_label(_socket.ssl()) << h <<  _page;
-      if(isGET) oss << _connect.urlencode ? Helper::urlEncode(content) : content;
+      _query.clear();
+      helper::ArenaStream oss(_query);
+      oss << _connect->method << " " << Helper::http_label(_socket.ssl()) << h <<  _page;
+      if(isGET) {
+	if(_connect->urlencode) {
+	  _except.assign("?=&").append(_connect->uexcept);
+	  Helper::urlEncode(content, _except, _transformed);
+	  oss << _transformed;
+	} else
+	  oss << content;
+      }
       oss << " HTTP/1.1\r\n";
-      addDefaultHeader(oss, "Host",  h + (_port != 80 ? ":"+std::to_string(_port) : ""));
+      if(_port != 80) addDefaultHeader(oss, "Host", h << ":" << _port);
+      else addDefaultHeader(oss, "Host", h);
       addDefaultHeader(oss, "User-Agent", _appname);
       addDefaultHeader(oss, "Accept", "application/json,text/javascript,text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8");
       addDefaultHeader(oss, "Accept-Language", "q=0.8,en-US;q=0.5,en;q=0.3");
-      for(map<string, string>::const_iterator it = _connect.headers.begin(); it != _connect.headers.end(); ++it) {
+      for(map<string, string>::const_iterator it = _connect->headers.begin(); it != _connect->headers.end(); ++it) {
 	oss << it->first << ": " << it->second << "\r\n";
         if(it->first == "Accept-Encoding") {
           gzip = (it->second.find("gzip") != string::npos);
           deflate = (it->second.find("deflate") != string::npos);
         }
       }
-      if(_connect.gzip && !deflate && !gzip)
+      if(_connect->gzip && !deflate && !gzip)
         deflate = true;
-      
-      for(vector<string>::const_iterator it = _connect.cookies.begin(); it != _connect.cookies.end(); ++it)
+
+      for(vector<string>::const_iterator it = _connect->cookies.begin(); it != _connect->cookies.end(); ++it)
 	oss << "Cookie: " << (*it) << "\r\n";
 
-      oss << makeContentType(!content.empty(), isGET); 
-      string body;
-      if(gzip)
-        body = GZIP::compress(content, GZIPMethod::GZ);
-      else if(deflate)
-        body = GZIP::compress(content, GZIPMethod::DEFLATE);
-      else if(_connect.urlencode) {
-        body = Helper::urlEncode(content, _connect.uexcept);
+      makeContentType(oss, !content.empty(), isGET);
+      /* the body is only copied when it is transformed, into a buffer kept between the requests */
+      string_view body = content;
+      if(gzip || deflate) {
+	GZIP::compress(content, gzip ? GZIPMethod::GZ : GZIPMethod::DEFLATE, _transformed);
+	body = _transformed;
+      } else if(_connect->urlencode) {
+	Helper::urlEncode(content, _connect->uexcept, _transformed);
+	body = _transformed;
       }
-      else 
-        body = content;
 
-      std::stringstream ss_boundary;
+      constexpr string_view boundaryDashes = "-----------------------------";
       size_t extra_length = 0;
-      ss_boundary.str("");
-      if(!_connect.multiparts.empty()) {
-        ss_boundary << "-----------------------------" << _boundary << "\r\n";
-        for(map<string, string>::const_iterator it = _connect.multiparts.begin(); it != _connect.multiparts.end(); ++it)
-          ss_boundary << it->first << ": " << it->second << "\r\n";
-        ss_boundary << "\r\n";
-        ss_boundary << body << "\r\n";
-        std::string footer = "-----------------------------" + _boundary + "--\r\n\r\n";
-        ss_boundary << footer;
-        extra_length = footer.size() + 2;
+      if(!_connect->multiparts.empty()) {
+	/* footer: dashes + boundary + "--\r\n\r\n" and the "\r\n" after the body */
+	extra_length = boundaryDashes.size() + _boundary.size() + 6 + 2;
       }
 
 
       if(gzip || deflate) {
 	addDefaultHeader(oss, "Accept-Encoding", "gzip, deflate");
 	if(!content.empty() && !isGET)
-	  addDefaultHeader(oss, "Content-Encoding", std::string(gzip ? "gzip" : "deflate"));
+	  addDefaultHeader(oss, "Content-Encoding", (gzip ? "gzip" : "deflate"));
       }
       if(!content.empty() && !isGET)
-	addDefaultHeader(oss, "Content-Length", std::to_string(body.size() + extra_length));
-      addDefaultHeader(oss, "Connection", "close\r\n");
-      if(!_connect.multiparts.empty()) oss << ss_boundary.str();
-      else {
-        if(!content.empty() && !isGET)
-	  oss << body;
-	else
-	  oss << "\r\n";
+	addDefaultHeader(oss, "Content-Length", (body.size() + extra_length));
+      /* keep-alive is the default of HTTP/1.1 */
+      if(!_connect->keep_alive) addDefaultHeader(oss, "Connection", "close");
+      /* the empty line ends the headers, nothing may follow a body-less request on a kept connection */
+      oss << "\r\n";
+      if(!_connect->multiparts.empty()) {
+	oss << boundaryDashes << _boundary << "\r\n";
+	for(map<string, string>::const_iterator it = _connect->multiparts.begin(); it != _connect->multiparts.end(); ++it)
+	  oss << it->first << ": " << it->second << "\r\n";
+	oss << "\r\n";
+	oss << body << "\r\n";
+	oss << boundaryDashes << _boundary << "--\r\n\r\n";
       }
-      return oss.str();
+      else if(!content.empty() && !isGET)
+	oss << body;
+      return _query;
     }
 
     /**
-     * @brief Connect the socket.
-     * @param connect The connect context
+     * @brief Prepare a new request: decode the host value and build the content.
+     * @param connect The connect context (must stay valid until the next call).
      */
-    auto HttpClient::connect(const HttpClientConnect& connect) -> void {
-      _connect = connect;
-      bool isGET = (_connect.method == "GET");
-      if(_connect.host.empty()) {
+    auto HttpClient::prepare(const HttpClientConnect& connect) -> void {
+      release();
+      _connect = &connect;
+      bool isGET = (_connect->method == "GET");
+      if(_connect->host.empty()) {
 	throw HttpClientException("Unable to start the client without host!");
       }
-      _socket.ssl(_connect.ssl);
+      if(_connect->ssl != _socket.ssl()) _socket.disconnect();
+      _socket.ssl(_connect->ssl);
+      _socket.budget(_connect->memory_budget);
       /* decode the host value */
       _port = !_socket.ssl() ? 80 : 443;
+      string_view host = _connect->host;
       _page = "/";
       /* get the page value */
-      size_t found = _connect.host.find("/");
+      size_t found = host.find("/");
       if(found != string::npos) {
-	_page = _connect.host.substr(found);
-	_connect.host = _connect.host.substr(0, found);
+	_page = host.substr(found);
+	host = host.substr(0, found);
       }
-      /* get the port value */
-      found = _connect.host.find(":");
+      /* get the port value (after the brackets of an IPv6 literal) */
+      found = host.find(':', !host.empty() && host.front() == '[' ? host.find(']') : 0);
       if(found != string::npos) {
-	_port = std::atoi(_connect.host.substr(found + 1).c_str());
-	_connect.host = _connect.host.substr(0, found);
+	_port = std::atoi(string(host.substr(found + 1)).c_str());
+	host = host.substr(0, found);
       }
-      if(_connect.is_params->is_open()) {
-	std::streamsize size = _connect.is_params->tellg();
-	_connect.is_params->seekg(0, std::ios::beg);
-	_content.clear();
+      _host = host;
+      if(_connect->is_params->is_open()) {
+	_connect->is_params->clear();
+	_connect->is_params->seekg(0, std::ios::end);
+	std::streamsize size = _connect->is_params->tellg();
+	_connect->is_params->seekg(0, std::ios::beg);
 	_content.resize(size);
-	_connect.is_params->read(_content.data(), size);
-      } else {
-	string s;
-	if(!_connect.params.empty()) {
-	  s = isGET ? "?" : "";
-	  for(map<string, string>::const_iterator it = _connect.params.begin(); it != _connect.params.end(); ++it)
-	    s += it->first + "=" + it->second + "&";
-	  if(s.at(s.size() - 1) == '&') s.erase(s.size() - 1);
-	  _content = Helper::toCharVector(s);
+	_connect->is_params->read(_content.data(), size);
+      } else if(!_connect->params.empty()) {
+	auto append = [this](string_view s) { _content.insert(_content.end(), s.begin(), s.end()); };
+	if(isGET) _content.push_back('?');
+	for(map<string, string>::const_iterator it = _connect->params.begin(); it != _connect->params.end(); ++it) {
+	  if(it != _connect->params.begin()) _content.push_back('&');
+	  append(it->first);
+	  _content.push_back('=');
+	  append(it->second);
 	}
       }
-      string content = Helper::fromCharVector(_content);
-      cout << "Use location: " << Helper::http_label(_connect.ssl) << _connect.host << (isGET && !_content.empty() ? content : "") << endl; 
-      cout << "Query " << _connect.method << " " << Helper::http_label(_connect.ssl) << _connect.host << _page << endl;
-      if(!_content.empty()) cout << "Whith content " << Helper::toHumanStringSize(content.size()) << endl;
-      /* establishes a connection with the remote host */
-      _socket.connect(_connect.host, _port);
-      /* Send the request */
-      string output = makeQuery();
-      if(_connect.print_query)
-	cout << "Query: " << endl << "***" << endl << output << endl << "***" << endl;
-      _socket << output;
-      cout << "Wait for response ..." << endl;
-      /* wait a second for processing. */
-      sleep(1);
-
-      std::ostringstream oss;
-      for(;;) {
-	/* store the response and build headers list */
-	string readdata;
-	_socket >> readdata;
+    }
+
+    /**
+     * @brief Build the query of a request without sending it.
+     * @param connect The connect context (must stay valid until the next call).
+     * @return The query (valid until the next request).
+     */
+    auto HttpClient::query(const HttpClientConnect& connect) -> string_view {
+      prepare(connect);
+      return makeQuery();
+    }
+
+    /**
+     * @brief Connect the socket, through the cache if set (GET without params file only).
+     * @param connect The connect context (must stay valid until the next call).
+     */
+    auto HttpClient::connect(const HttpClientConnect& connect) -> void {
+      _status = CacheStatus::NONE;
+      if(_cache == nullptr || connect.method != "GET" || connect.is_params->is_open()) {
+	fetch(connect);
+	return;
+      }
+      prepare(connect);
+      /* every request header that can differ is part of the key, so that the variants named by Vary
+	 and the credentials of -H or the cookies never share an entry */
+      string& key = _key;
+      key.assign(Helper::http_label(_connect->ssl)).append(_host).append(":").append(std::to_string(_port)).append(_page)
+	.append(_content.data(), _content.size()).append(connect.gzip ? "\tgzip" : "");
+      for(const auto& header : connect.headers)
+	key.append("\t").append(header.first).append(": ").append(header.second);
+      for(const string& cookie : connect.cookies)
+	key.append("\tCookie: ").append(cookie);
+      CacheEntry entry;
+      bool found = _cache->lookup(key, entry);
+      if(found && HttpCache::fresh(entry)) {
+	/* no network at all */
+	_socket.timings().start();
+	if(serve(entry)) {
+	  _status = CacheStatus::HIT;
+	  return;
+	}
+	found = false;
+      }
+      const HttpClientConnect* request = &connect;
+      if(found) {
+	_conditional = connect;
+	HttpCache::conditional(entry, _conditional.headers);
+	request = &_conditional;
+      }
+      fetch(*request);
+      if(found && _hdr.code() == 304) {
+	_cache->refresh(entry, _hdr);
+	if(serve(entry)) {
+	  _status = CacheStatus::REVALIDATED;
+	  return;
+	}
+	/* the body vanished, fetched again without the validators */
+	fetch(connect);
+      }
+      /* a body streamed to the sink is not kept */
+      if((_sink == nullptr || _sink->written() == _plain.size()) && _cache->store(key, _hdr, _plain))
+	_status = CacheStatus::MISS;
+    }
+
+    /**
+     * @brief Test if the server keeps the connection open after the response.
+     * @return bool
+     */
+    auto HttpClient::keepAlive() -> bool {
+      if(_hdr.equals("Connection", "close")) return false;
+      /* HTTP/1.0 closes unless asked otherwise */
+      return _hdr.raw().compare(0, 8, "HTTP/1.0") != 0 || _hdr.equals("Connection", "keep-alive");
+    }
+
+    /**
+     * @brief Replace the response with a cached entry.
+     * @param entry The entry.
+     * @return false if the body cannot be mapped.
+     */
+    auto HttpClient::serve(const CacheEntry& entry) -> bool {
+      CacheBody body = _cache->map(entry);
+      if(!body) return false;
+      _cached = std::move(body);
+      _hdr.clear();
+      _hdr.append(entry.header);
+      _plain.clear();
+      if(_sink) {
+	_sink->open(_cached.view().size());
+	_sink->write(_cached.view());
+	_sink->close();
+      }
+      _socket.timings().mark(TimingPhase::DECOMPRESS);
+      return true;
+    }
+
+    /**
+     * @brief Send the request and read the whole response.
+     * @param connect The connect context (must stay valid until the next call).
+     */
+    auto HttpClient::fetch(const HttpClientConnect& connect) -> void {
+      if(PerfCounters::enabled()) PerfCounters::thread().begin();
+      prepare(connect);
+      bool isGET = (_connect->method == "GET");
+      string_view content(_content.data(), _content.size());
+      if(!_connect->print_nothing) {
+	cout << "Use location: " << Helper::http_label(_connect->ssl) << _host << (isGET && !_content.empty() ? content : "") << endl;
+	cout << "Query " << _connect->method << " " << Helper::http_label(_connect->ssl) << _host << _page << endl;
+	if(!_content.empty()) cout << "Whith content " << Helper::toHumanStringSize(content.size()) << endl;
+      }
+      /* the spans of the request are traced even when it fails */
+      struct TraceGuard {
+	  EasySocket& socket;
+	  ~TraceGuard() { if(Trace::enabled()) Trace::request(socket.timings()); }
+      } tracer { _socket };
+      /* establishes a connection with the remote host (or reuses the kept one), closed when the response
+	 is read unless it can be kept for the next request */
+      struct SocketCloser {
+	  EasySocket& socket;
+	  bool keep;
+	  ~SocketCloser() { if(keep) socket.keep(); else socket.disconnect(); }
+      } closer { _socket, false };
+      bool reused = send(_connect->keep_alive);
+      if(!_connect->print_nothing)
+	cout << "Wait for response ..." << endl;
+
+      std::pmr::string response(&_arena);
+      std::optional<HexDump> dump;
+      if(_connect->print_hex) dump.emplace(cout);
+      /* store the response and build headers list (the read buffer is kept between the requests) */
+      string& readdata = _received;
+      /* the response ends at the last byte of its framing, not when the server closes */
+      BodyFraming framing;
+      bool streaming = false, stray = false;
+      size_t streamed = 0;
+      while(!(_hdr.done() && framing.done())) {
+	try {
+	  PerfScope perf(PerfPhase::WAIT);
+	  _socket >> readdata;
+	} catch(const EasySocketException&) {
+	  if(!reused || !response.empty()) throw;
+	  readdata.clear();
+	}
+	/* the server closed the idle connection before reading the request, sent again once on a new one */
+	if(readdata.empty() && reused && response.empty()) {
+	  reused = send(false);
+	  continue;
+	}
         if(readdata.empty()) break;
-	if(!_hdr.done()) _hdr.append(readdata);
-	oss << readdata;
-	if(_connect.print_raw_resp)
+	string_view data = readdata;
+	size_t head = 0;
+	if(!_hdr.done()) {
+	  PerfScope perf(PerfPhase::HEADERS);
+	  _hdr.append(readdata);
+	  if(!_hdr.done()) head = data.size();
+	  else {
+	    _socket.timings().mark(TimingPhase::HEADERS);
+	    head = _hdr.length() - response.size();
+	    framing.start(_hdr, _connect->method == "HEAD");
+	    /* the identity bodies go straight to the sink, without being buffered */
+	    streaming = _sink != nullptr && !_hdr.equals("Transfer-Encoding", "chunked") && !_hdr.contains("Content-Encoding");
+	    if(streaming) {
+	      response.append(readdata.data(), head);
+	      data.remove_prefix(head);
+	      head = 0;
+	      _sink->open(static_cast<size_t>(framing.remaining()));
+	    }
+	  }
+	}
+	/* the bytes after the end of the body (if any) are dropped, with the connection */
+	if(_hdr.done()) {
+	  size_t end = head + framing.feed(data.substr(head));
+	  stray = stray || end < data.size();
+	  data = data.substr(0, end);
+	}
+	if(streaming) {
+	  _sink->write(data);
+	  streamed += data.size();
+	} else
+	  response += data;
+	/* a streamed body only holds the receive buffer */
+	_socket.account(readdata.capacity() + response.size());
+	if(_connect->print_raw_resp)
 	  cout << readdata << endl;
-        if(_connect.print_hex) {
-          cout << Helper::print_hex((unsigned char*)readdata.c_str(), readdata.size());
-          cout << "\n";
-        }
+	if(dump)
+	  dump->write(readdata.data(), readdata.size());
+      }
+      _socket.timings().mark(TimingPhase::BODY);
+      if(dump) dump->finish();
+      closer.keep = _connect->keep_alive && !stray && framing.done() && framing.end() != BodyEnd::CLOSE && keepAlive();
+      if(streaming) {
+	_sink->close();
+	_downloaded = streamed;
+	_socket.timings().mark(TimingPhase::DECOMPRESS);
+	return;
       }
-      string str = oss.str();     
-      string readdata = str.substr(_hdr.length());
-      readdata = readdata.substr(0, readdata.size() - 2);
+      string_view body = string_view(response).substr(_hdr.length());
+      _downloaded = body.size();
+      /* the body is delimited by Content-Length, else by the chunks or the end of the connection */
+      size_t length = 0;
+      string_view cl = _hdr.value("Content-Length");
+      if(!cl.empty() && std::from_chars(cl.data(), cl.data() + cl.size(), length).ec == std::errc() && length < body.size())
+	body = body.substr(0, length);
 
-      // cout << "==" << readdata <<"==" << readdata.size()<< endl << endl;
       /* Test if the body response is chuncked */
-      oss.str("");
+      std::pmr::string plain(&_arena);
       if(_hdr.equals("Transfer-Encoding", "chunked")) {
-	if(_connect.print_chunk)
+	body = body.substr(0, body.size() - 2);
+	if(_connect->print_chunk)
 	  cout << "Chunked response ..." << endl;
-	size_t chunk = 0, count = 0;
-	do {
-	  string w = readdata;
-	  size_t found = w.find("\r\n");
-	  if(found == 0) {
-	    w = w.substr(2);
-	    found = w.find("\r\n");
-	    if(found != string::npos) found += 2;
-	  }
-	  if(found != string::npos) {
-	    stringstream ss;
-	    string v = Helper::trim(Helper::trim(Helper::trim(readdata.substr(0, found), '\r'), '\n'));
-	    ss << std::hex << v;
-	    ss >> chunk;
-	    if(_connect.print_chunk)
-	      cout << (++count) << " chunk bloc size " << chunk << " (0x" << v << ") - " << Helper::toHumanStringSize(chunk) << endl;
-	    readdata = readdata.substr(found + 2);
-            /*if(chunk > readdata.size()) {
-              std::ostringstream er;
-              er << "The chunk size (" << Helper::toHumanStringSize(chunk) << ") is greater than the response length (" << Helper::toHumanStringSize(readdata.size()) << ")";
-              throw HttpClientException(er.str());
-	    }*/
-            if(!_connect.gzip) {
-
-	      oss << readdata.substr(0, chunk);
-	      readdata = readdata.substr(chunk);
-            } else {
-	      readdata = readdata.substr(0, readdata.size() - 3);
-	      oss << readdata;
-	    }
-	  }
-	} while(chunk && !_connect.gzip);
+	PerfScope perf(PerfPhase::CHUNKS);
+	decodeChunked(body, plain, _connect->gzip, _connect->print_chunk ? &cout : nullptr);
       } else
-	oss << readdata;
-      /* test support of gzip content */
-      _plain = oss.str();
-      //cout << Helper::print_hex((unsigned char*)_plain.c_str(), _plain.size());
-      //cout << "\n";
-      if(_hdr.equals("Content-Encoding", "gzip")) {
-	string t = _plain;
-        _plain = GZIP::decompress(t, GZIPMethod::GZ);
-      } else if(_hdr.equals("Content-Encoding", "deflate")) {
-	string t = _plain;
-        _plain = GZIP::decompress(t, GZIPMethod::DEFLATE);
+	plain += body;
+      /* test support of gzip content (a HEAD, 204 or 304 response has no body to inflate) */
+      PerfScope perf(PerfPhase::INFLATE);
+      if(plain.empty())
+	_plain.clear();
+      else if(_hdr.equals("Content-Encoding", "gzip"))
+	GZIP::decompress(plain, GZIPMethod::GZ, _plain);
+      else if(_hdr.equals("Content-Encoding", "deflate"))
+	GZIP::decompress(plain, GZIPMethod::DEFLATE, _plain);
+      else
+	_plain.assign(plain.data(), plain.size());
+      _socket.account(readdata.capacity() + response.size() + plain.size() + _plain.size());
+      if(_sink) {
+	_sink->open(_plain.size());
+	_sink->write(_plain);
+	_sink->close();
+      }
+      _socket.timings().mark(TimingPhase::DECOMPRESS);
+    }
+
+    /**
+     * @brief Connect the socket (or reuse the open connection to the same host) and send the query.
+     * @param reuse Reuse the open connection if possible.
+     * @return true if the open connection was reused.
+     */
+    auto HttpClient::send(bool reuse) -> bool {
+      /* the brackets of an IPv6 literal stay in the Host header only */
+      string_view host = _host;
+      if(host.size() > 2 && host.front() == '[' && host.back() == ']') host = host.substr(1, host.size() - 2);
+      bool reused = reuse && _socket.isOpen() && _port == _openPort && host == _openHost && _socket.reuse();
+      if(!reused) {
+	_socket.disconnect();
+	_socket.connect(host, _port);
+	_openHost.assign(host.data(), host.size());
+	_openPort = _port;
+      }
+      string_view output = makeQuery();
+      if(_connect->print_query)
+	cout << "Query: " << endl << "***" << endl << output << endl << "***" << endl;
+      try {
+	PerfScope perf(PerfPhase::WRITE);
+	_socket << output;
+	_socket.flush();
+      } catch(const EasySocketException&) {
+	/* the server closed the idle connection meanwhile, sent again once on a new one */
+	if(!reused) throw;
+	return send(false);
       }
+      _socket.timings().mark(TimingPhase::WRITTEN);
+      return reused;
+    }
+
+    /**
+     * @brief Send the request and read the response headers, the body is then streamed with read
+     * (the connection stays open until the next request or reset).
+     * @param connect The connect context (must stay valid until the next call).
+     * @param body The beginning of the body, received with the headers.
+     */
+    auto HttpClient::open(const HttpClientConnect& connect, string& body) -> void {
+      prepare(connect);
+      body.clear();
+      try {
+	/* the body is streamed by the caller, the end of the response is not known here */
+	send(false);
+	std::pmr::string response(&_arena);
+	string& readdata = _received;
+	while(!_hdr.done()) {
+	  _socket >> readdata;
+	  if(readdata.empty())
+	    throw HttpClientException("Connection closed before the end of the headers");
+	  _hdr.append(readdata);
+	  response += readdata;
+	  _socket.account(readdata.capacity() + response.size());
+	}
+	_socket.timings().mark(TimingPhase::HEADERS);
+	body.assign(response, _hdr.length());
+	_downloaded = body.size();
+      } catch(...) {
+	_socket.disconnect();
+	throw;
+      }
+    }
+
+    /**
+     * @brief Read the next part of the body opened by open, as received (chunks and compression
+     * are not decoded).
+     * @param data The data, empty at the end of the stream.
+     */
+    auto HttpClient::read(string& data) -> void {
+      _socket >> data;
+      _socket.account(data.capacity());
+      _downloaded += data.size();
+    }
+
+    /**
+     * @brief Decode a chunked body.
+     * @param body The body (without the headers).
+     * @param plain The decoded body.
+     * @param gzip Only the first chunk is used (gzip mode).
+     * @param info Prints the chunk info (if not null).
+     */
+    auto HttpClient::decodeChunked(string_view body, std::pmr::string& plain, bool gzip, std::ostream* info) -> void {
+      size_t chunk = 0, count = 0;
+      do {
+	string_view w = body;
+	size_t found = w.find("\r\n");
+	if(found == 0) {
+	  w = w.substr(2);
+	  found = w.find("\r\n");
+	  if(found != string::npos) found += 2;
+	}
+	/* truncated body */
+	if(found == string::npos) break;
+	string_view v = Helper::trim(Helper::trim(Helper::trim(body.substr(0, found), '\r'), '\n'));
+	chunk = 0;
+	std::from_chars(v.data(), v.data() + v.size(), chunk, 16);
+	if(info)
+	  *info << (++count) << " chunk bloc size " << chunk << " (0x" << v << ") - " << Helper::toHumanStringSize(chunk) << endl;
+	body = body.substr(found + 2);
+	if(!gzip) {
+	  plain += body.substr(0, chunk);
+	  body = body.substr(chunk);
+	} else {
+	  body = body.substr(0, body.size() - 3);
+	  plain += body;
+	}
+      } while(chunk && !gzip);
     }
 
     /**
@@ -290,9 +763,44 @@ namespace net {
      * @return string
      */
     auto HttpClient::getPlainText() -> string& {
+      /* copied from the mapping only when asked */
+      if(_cached && _plain.empty()) _plain.assign(_cached.view());
       return _plain;
     }
 
+    /**
+     * @brief Get the body, mapped from the cache or decoded from the response.
+     * @return The body, valid until the next request.
+     */
+    auto HttpClient::body() const -> string_view {
+      return _cached ? _cached.view() : string_view(_plain);
+    }
+
+    /**
+     * @brief Set the response cache of the next requests.
+     * @param cache The cache (nullptr to disable, must outlive the client).
+     */
+    auto HttpClient::cache(HttpCache* cache) -> void {
+      _cache = cache;
+    }
+
+    /**
+     * @brief Set the output file of the decoded body of the next requests, the identity
+     * bodies are streamed to it without being kept in memory.
+     * @param sink The sink (nullptr to disable, must outlive the client).
+     */
+    auto HttpClient::sink(FileSink* sink) -> void {
+      _sink = sink;
+    }
+
+    /**
+     * @brief Get the origin of the last response.
+     * @return CacheStatus
+     */
+    auto HttpClient::cacheStatus() const -> CacheStatus {
+      return _status;
+    }
+
     /**
      * @brief Get the HTTP header (from the response)
      * @return HttpHeader
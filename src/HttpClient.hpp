@@ -11,6 +11,9 @@
 
 #include "EasySocket.hpp"
 #include "HttpHeader.hpp"
+#include "HttpCache.hpp"
+#include "FileSink.hpp"
+#include "Arena.hpp"
 #include <exception>
 #include <map>
 #include <fstream>
@@ -46,7 +49,10 @@ namespace net {
 	 * @param print_query Print the query.
 	 * @param print_chunk Print the chunk info.
 	 * @param print_raw_resp Print the whole response.
+	 * @param print_nothing Only prints the errors.
 	 * @param print_hex Prints the response in hex format
+	 * @param memory_budget The per-connection memory budget (0 for no limit).
+	 * @param keep_alive Keep the connection open for the next request to the same host (else Connection: close).
 	 */
 	std::string host;
 	std::string method;
@@ -65,6 +71,8 @@ namespace net {
 	bool print_raw_resp;
 	bool print_nothing;
 	bool print_hex;
+	std::size_t memory_budget;
+	bool keep_alive;
     };
 
     class HttpClient {
@@ -78,6 +86,31 @@ namespace net {
 	 */
 	auto getPlainText() -> std::string&;
 
+	/**
+	 * @brief Get the body, mapped from the cache or decoded from the response.
+	 * @return The body, valid until the next request.
+	 */
+	auto body() const -> std::string_view;
+
+	/**
+	 * @brief Set the response cache of the next requests.
+	 * @param cache The cache (nullptr to disable, must outlive the client).
+	 */
+	auto cache(HttpCache* cache) -> void;
+
+	/**
+	 * @brief Set the output file of the decoded body of the next requests, the identity
+	 * bodies are streamed to it without being kept in memory.
+	 * @param sink The sink (nullptr to disable, must outlive the client).
+	 */
+	auto sink(FileSink* sink) -> void;
+
+	/**
+	 * @brief Get the origin of the last response.
+	 * @return CacheStatus
+	 */
+	auto cacheStatus() const -> CacheStatus;
+
 	/**
 	 * @brief Get the HTTP header (from the response)
 	 * @return HttpHeader
@@ -85,42 +118,182 @@ namespace net {
 	auto getHttpHeader() -> HttpHeader&;
 
 	/**
-	 * @brief Connect the socket.
-	 * @param connect The connect context
+	 * @brief Connect the socket, through the cache if set (GET without params file only).
+	 * @param connect The connect context (must stay valid until the next call).
 	 */
 	auto connect(const HttpClientConnect& connect) -> void;
 
+	/**
+	 * @brief Send the request and read the response headers, the body is then streamed with read
+	 * (the connection stays open until the next request or reset).
+	 * @param connect The connect context (must stay valid until the next call).
+	 * @param body The beginning of the body, received with the headers.
+	 */
+	auto open(const HttpClientConnect& connect, std::string& body) -> void;
+
+	/**
+	 * @brief Read the next part of the body opened by open, as received (chunks and compression
+	 * are not decoded).
+	 * @param data The data, empty at the end of the stream.
+	 */
+	auto read(std::string& data) -> void;
+
+	/**
+	 * @brief Close the connection and release the state of the previous request (header, body and arena).
+	 */
+	auto reset() -> void;
+
+	/**
+	 * @brief Release the state of the previous request, the connection stays open for the next one
+	 * (in low-memory mode the arena and the buffers are given back).
+	 */
+	auto release() -> void;
+
+	/**
+	 * @brief Build the query of a request without sending it.
+	 * @param connect The connect context (must stay valid until the next call).
+	 * @return The query (valid until the next request).
+	 */
+	auto query(const HttpClientConnect& connect) -> std::string_view;
+
+	/**
+	 * @brief Decode a chunked body.
+	 * @param body The body (without the headers).
+	 * @param plain The decoded body.
+	 * @param gzip Only the first chunk is used (gzip mode).
+	 * @param info Prints the chunk info (if not null).
+	 */
+	static auto decodeChunked(std::string_view body, std::pmr::string& plain, bool gzip, std::ostream* info = nullptr) -> void;
+
 	/**
 	 * @brief Test if the SSL is set.
 	 */
 	auto ssl() -> bool;
 
+	/**
+	 * @brief Get the peak memory used by the last connection.
+	 * @return std::size_t
+	 */
+	auto memoryPeak() -> std::size_t;
+
+	/**
+	 * @brief Test if the handshake of the last connection resumed a previous TLS session.
+	 * @return bool
+	 */
+	auto sessionReused() -> bool;
+
+	/**
+	 * @brief Get the socket descriptor of the open connection.
+	 * @return The descriptor, -1 if the connection is closed.
+	 */
+	auto fd() -> int;
+
+	/**
+	 * @brief Get the phases timings of the last request.
+	 * @return Timings&
+	 */
+	auto timings() -> Timings&;
+
+	/**
+	 * @brief Get a TCP_INFO sample of the last connection (see EasySocket::tcpInfo).
+	 * @param point The sampling point.
+	 * @return const TcpSample&
+	 */
+	auto tcpInfo(TcpPoint point) const -> const TcpSample&;
+
+	/**
+	 * @brief Get the kernel timestamps of the last request (see EasySocket::timestamping).
+	 * @return const KernelStamps&
+	 */
+	auto stamps() const -> const KernelStamps&;
+
+	/**
+	 * @brief Write the last request information using a curl -w like format.
+	 * The variables are %{name} (time_namelookup, time_connect, time_appconnect, time_pretransfer,
+	 * time_written, time_starttransfer, time_headers, time_body, time_decompress, time_total,
+	 * time_kernel_send, time_network, time_kernel_receive,
+	 * http_code, size_header, size_download, size_plain, tcp_rtt, tcp_retransmits, tcp_cwnd,
+	 * tcp_delivery_rate, tcp_bytes_acked, url_effective), %{json} for all of them,
+	 * %% for a '%' and the \n, \r and \t escapes.
+	 * @param os The output stream.
+	 * @param format The format.
+	 */
+	auto writeOut(std::ostream& os, std::string_view format) -> void;
+
       private:
+	helper::Arena _arena;
 	std::string _appname;
 	EasySocket _socket;
-	std::string _host;
+	std::pmr::string _host;
 	bool _gzip;
 	int _port;
-	std::string _page;
-	std::vector<char> _content;
+	std::pmr::string _page;
+	std::pmr::vector<char> _content;
 	HttpHeader _hdr;
 	std::string _plain;
-	HttpClientConnect _connect;
+	const HttpClientConnect* _connect;
 	std::string _boundary;
+	std::pmr::string _query;
+	std::size_t _downloaded;
+	HttpCache* _cache;
+	CacheBody _cached;
+	FileSink* _sink;
+	HttpClientConnect _conditional;
+	CacheStatus _status;
+	/* buffers kept between the requests, so that the steady state reuses their capacity */
+	std::string _received;
+	std::string _transformed;
+	std::string _except;
+	std::string _key;
+	/* host and port of the open connection */
+	std::string _openHost;
+	int _openPort;
+
+	/**
+	 * @brief Prepare a new request: decode the host value and build the content.
+	 * @param connect The connect context (must stay valid until the next call).
+	 */
+	auto prepare(const HttpClientConnect& connect) -> void;
+
+	/**
+	 * @brief Connect the socket (or reuse the open connection to the same host) and send the query.
+	 * @param reuse Reuse the open connection if possible.
+	 * @return true if the open connection was reused.
+	 */
+	auto send(bool reuse) -> bool;
+
+	/**
+	 * @brief Send the request and read the whole response.
+	 * @param connect The connect context (must stay valid until the next call).
+	 */
+	auto fetch(const HttpClientConnect& connect) -> void;
+
+	/**
+	 * @brief Test if the server keeps the connection open after the response.
+	 * @return bool
+	 */
+	auto keepAlive() -> bool;
+
+	/**
+	 * @brief Replace the response with a cached entry.
+	 * @param entry The entry.
+	 * @return false if the body cannot be mapped.
+	 */
+	auto serve(const CacheEntry& entry) -> bool;
 
 	/**
 	 * @brief Build the query request.
-	 * @return The query.
+	 * @return The query (valid until the next reset).
 	 */
-	auto makeQuery() -> std::string;
+	auto makeQuery() -> std::string_view;
 
 	/**
 	 * @brief Build the content type header.
+	 * @param oss The output stream.
 	 * @param content The query contain content.
 	 * @param isGet Is get method?
-	 * @return The content type.
 	 */
-	auto makeContentType(bool content, bool isGET) -> std::string;
+	auto makeContentType(std::ostream& oss, bool content, bool isGET) -> void;
     };
 
   } /* namespace http */
@@ -10,19 +10,88 @@
 #include <algorithm>
 #include <iterator>
 #include <iostream>
+#include <array>
 
 namespace net {
   namespace http {
 
-    using std::istringstream;
-    using std::vector;
     using std::string;
+    using std::string_view;
     using std::size_t;
-    using std::istream_iterator;
-    using helper::vstring;
-    using helper::Helper;
 
-    HttpHeader::HttpHeader() : _done(false), _code(0), _reason(""), _content(), _hdrs(), _length(0) {
+    constexpr size_t KNOWN_COUNT = static_cast<size_t>(HttpHeaderId::UNKNOWN);
+    constexpr size_t KNOWN_HASH_SIZE = 32;
+    constexpr size_t UNKNOWN_SLOTS = 16;
+
+    /* must follow the HttpHeaderId order */
+    constexpr std::array<string_view, KNOWN_COUNT> knownNames = {
+      "accept-ranges", "age", "cache-control", "connection", "content-disposition",
+      "content-encoding", "content-length", "content-range", "content-type", "date",
+      "etag", "expires", "keep-alive", "last-modified", "location",
+      "retry-after", "server", "set-cookie", "transfer-encoding", "vary",
+      "www-authenticate"
+    };
+
+    constexpr auto lower(char c) -> unsigned char {
+      return static_cast<unsigned char>((c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c);
+    }
+
+    constexpr auto iequals(string_view a, string_view b) -> bool {
+      if(a.size() != b.size()) return false;
+      for(size_t i = 0; i < a.size(); ++i)
+	if(lower(a[i]) != lower(b[i])) return false;
+      return true;
+    }
+
+    /**
+     * @brief Perfect hash of the well-known names (see the static_assert below).
+     * @param s The name (not empty).
+     * @return The hash.
+     */
+    constexpr auto knownHash(string_view s) -> size_t {
+      return (s.size() + lower(s[0]) * 4 + lower(s[s.size() - 1]) * 5 + lower(s[s.size() / 2])) & (KNOWN_HASH_SIZE - 1);
+    }
+
+    constexpr auto knownTable() -> std::array<unsigned char, KNOWN_HASH_SIZE> {
+      std::array<unsigned char, KNOWN_HASH_SIZE> table = {};
+      for(size_t i = 0; i < KNOWN_HASH_SIZE; ++i)
+	table[i] = static_cast<unsigned char>(HttpHeaderId::UNKNOWN);
+      for(size_t i = 0; i < KNOWN_COUNT; ++i)
+	table[knownHash(knownNames[i])] = static_cast<unsigned char>(i);
+      return table;
+    }
+
+    constexpr auto knownPerfect() -> bool {
+      std::array<unsigned char, KNOWN_HASH_SIZE> table = knownTable();
+      for(size_t i = 0; i < KNOWN_COUNT; ++i)
+	if(table[knownHash(knownNames[i])] != i) return false;
+      return true;
+    }
+
+    static_assert(knownPerfect(), "the well-known header names hash is not perfect");
+    constexpr std::array<unsigned char, KNOWN_HASH_SIZE> knownIds = knownTable();
+
+    /**
+     * @brief Case insensitive FNV-1a hash of the unknown names.
+     * @param s The name.
+     * @return The hash.
+     */
+    static inline auto hash(string_view s) -> size_t {
+      size_t h = 2166136261u;
+      for(char c : s) h = (h ^ lower(c)) * 16777619u;
+      return h;
+    }
+
+    static inline auto trim(string_view s) -> string_view {
+      size_t b = s.find_first_not_of(" \t\r");
+      if(b == string_view::npos) return string_view();
+      return s.substr(b, s.find_last_not_of(" \t\r") - b + 1);
+    }
+
+    HttpHeader::HttpHeader(std::pmr::memory_resource* resource) : _resource(resource), _done(false), _code(0), _reason(),
+								  _content(resource), _length(0), _fields(resource), _names(resource),
+								  _chains(resource), _known(), _slots(resource) {
+      std::fill(std::begin(_known), std::end(_known), -1);
     }
 
     HttpHeader::~HttpHeader() {
@@ -30,15 +99,45 @@ namespace net {
     }
 
     /**
-     * @brief Clear the headers contexts.
+     * @brief Get the identifier of a header name (case insensitive).
+     * @param name The header name.
+     * @return The identifier or HttpHeaderId::UNKNOWN.
+     */
+    auto HttpHeader::id(string_view name) -> HttpHeaderId {
+      if(name.empty()) return HttpHeaderId::UNKNOWN;
+      unsigned char i = knownIds[knownHash(name)];
+      if(i != static_cast<unsigned char>(HttpHeaderId::UNKNOWN) && iequals(knownNames[i], name))
+	return static_cast<HttpHeaderId>(i);
+      return HttpHeaderId::UNKNOWN;
+    }
+
+    /**
+     * @brief Clear the headers contexts (the memory is kept for the next response).
      */
     auto HttpHeader::clear() -> void {
       _done = false;
       _code = 0;
       _length = 0;
-      _reason = "";
-      _content.str("");
-      _hdrs.clear();
+      _reason = string_view();
+      _content.clear();
+      _fields.clear();
+      _names.clear();
+      _chains.clear();
+      std::fill(std::begin(_known), std::end(_known), -1);
+      std::fill(_slots.begin(), _slots.end(), -1);
+    }
+
+    /**
+     * @brief Clear the headers contexts and give the memory back to the resource.
+     * Must be called before the reset of an arena resource.
+     */
+    auto HttpHeader::release() -> void {
+      clear();
+      std::pmr::string(_resource).swap(_content);
+      HttpHeaderFields(_resource).swap(_fields);
+      HttpHeaderNames(_resource).swap(_names);
+      std::pmr::vector<std::pair<int, int>>(_resource).swap(_chains);
+      std::pmr::vector<int>(_resource).swap(_slots);
     }
 
     /**
@@ -65,11 +164,19 @@ namespace net {
       return _length;
     }
 
+    /**
+     * @brief Get the raw headers, as received (with the final empty line).
+     * @return The headers, valid until the next clear.
+     */
+    auto HttpHeader::raw() const -> string_view {
+      return string_view(_content).substr(0, _done ? _length : 0);
+    }
+
     /**
      * @biref Get the response reason.
      * @return The reason.
      */
-    auto HttpHeader::reason() -> string {
+    auto HttpHeader::reason() -> string_view {
       return _reason;
     }
 
@@ -77,113 +184,155 @@ namespace net {
      * @brief Append data to decode.
      * @param data The data.
      */
-    auto HttpHeader::append(const string& data) -> void {
-      if(!_done) {
-	_content << data;
-	string s = _content.str();
-	size_t found = s.find("\r\n\r\n");
-	/* get all the headers */
-	if (found!=string::npos) {
-	  _done = true;
-	  /* only preserve the headers */
-	  s = s.substr(0, found);
-	  _length = s.size() + 4;
-	  /* prepare for header parsing */
-	  vstring tokens = Helper::split(s, '\n');
-	  for(vstring::const_iterator it = tokens.begin(); it != tokens.end(); ++it) {
-	    string line = *it;
-	    /* extract the code and the reason */
-	    if(_code == 0 && (found = line.find("HTTP/")) != string::npos) {
-	      line = line.substr(found + 9);
-	      found = line.find(" ");
-	      if(found != string::npos) {
-		_code = std::atoi(line.substr(0, found).c_str());
-		_reason = Helper::trim(Helper::trim(line.substr(found+1)), '\r');
-	      }
-	      /* now extract the headers */
-	    } else if(_code != 0) {
-	      found = line.find(":");
-	      if(found != string::npos) {
-		string key = line.substr(0, found);
-		string val = Helper::trim(Helper::trim(line.substr(found+1)), '\r');
-		auto it = find(key);
-		if(it != _hdrs.end()) {
-		  //std::cout << "Update key '" << key << "' with value '" << val << "'" << std::endl;
-		  it->second.push_back(val);
-		}
-		else {
-		  vstring vs;
-		  vs.push_back(val);
-		  //std::cout << "Add key '" << key << "' with value '" << val << "'" << std::endl;
-		  _hdrs.push_back(std::make_pair(key, vs));
-		}
-	      }
-	    }
-	  }
+    auto HttpHeader::append(string_view data) -> void {
+      if(_done) return;
+      /* the terminator may straddle the previous data */
+      size_t from = _content.size() < 3 ? 0 : _content.size() - 3;
+      _content.append(data.data(), data.size());
+      size_t found = _content.find("\r\n\r\n", from);
+      /* get all the headers */
+      if(found != string::npos) {
+	_done = true;
+	_length = found + 4;
+	/* the views point into _content, which is no more modified until the next clear */
+	parse(string_view(_content).substr(0, found));
+      }
+    }
+
+    /**
+     * @brief Parse the headers lines.
+     * @param s The headers without the final empty line.
+     */
+    auto HttpHeader::parse(string_view s) -> void {
+      while(!s.empty()) {
+	size_t eol = s.find('\n');
+	string_view line = s.substr(0, eol);
+	s = eol == string_view::npos ? string_view() : s.substr(eol + 1);
+	if(!line.empty() && line.back() == '\r') line.remove_suffix(1);
+	/* extract the code and the reason */
+	if(_code == 0) {
+	  size_t found = line.find("HTTP/");
+	  if(found == string_view::npos) continue;
+	  line = line.substr(found);
+	  found = line.find(' ');
+	  if(found == string_view::npos) continue;
+	  line = trim(line.substr(found + 1));
+	  for(found = 0; found < line.size() && line[found] >= '0' && line[found] <= '9'; ++found)
+	    _code = _code * 10 + (line[found] - '0');
+	  _reason = trim(line.substr(found));
+	  /* now extract the headers */
+	} else {
+	  size_t found = line.find(':');
+	  if(found != string_view::npos)
+	    add(trim(line.substr(0, found)), trim(line.substr(found + 1)));
 	}
       }
     }
-      
+
+    /**
+     * @brief Add a field to the index.
+     * @param name The header name.
+     * @param value The header value.
+     */
+    auto HttpHeader::add(string_view name, string_view value) -> void {
+      int field = static_cast<int>(_fields.size());
+      _fields.push_back({ name, value, -1 });
+      int k = find(name);
+      if(k != -1) {
+	_fields[_chains[k].second].next = field;
+	_chains[k].second = field;
+	return;
+      }
+      k = static_cast<int>(_names.size());
+      _names.push_back(name);
+      _chains.push_back(std::make_pair(field, field));
+      HttpHeaderId i = id(name);
+      if(i != HttpHeaderId::UNKNOWN) {
+	_known[static_cast<size_t>(i)] = k;
+	return;
+      }
+      /* keep the open addressing table at most half full */
+      if((_names.size() << 1) > _slots.size()) {
+	_slots.assign(_slots.empty() ? UNKNOWN_SLOTS : _slots.size() << 1, -1);
+	for(size_t n = 0; n < _names.size(); ++n)
+	  if(id(_names[n]) == HttpHeaderId::UNKNOWN)
+	    _slots[slot(_names[n])] = static_cast<int>(n);
+      } else
+	_slots[slot(name)] = k;
+    }
+
+    /**
+     * @brief Find the open addressing slot of an unknown key.
+     * @param key The key to find.
+     * @return The slot index (empty slot if the key is absent).
+     */
+    auto HttpHeader::slot(string_view key) const -> size_t {
+      size_t mask = _slots.size() - 1;
+      size_t i = hash(key) & mask;
+      while(_slots[i] != -1 && !iequals(_names[_slots[i]], key))
+	i = (i + 1) & mask;
+      return i;
+    }
 
     /**
      * @brief Find an entry from the key.
      * @param key The key to find.
-     * @return The value.
+     * @return The index in the keys list or -1.
      */
-    auto HttpHeader::find(const string& key) -> HttpHeadersIterator {
-      auto it = std::find_if(_hdrs.begin(), _hdrs.end(),
-			     [&key](const HttpHeaderItem& element){ return element.first == key;} );
-      return it;
+    auto HttpHeader::find(string_view key) const -> int {
+      HttpHeaderId i = id(key);
+      if(i != HttpHeaderId::UNKNOWN)
+	return _known[static_cast<size_t>(i)];
+      return _slots.empty() ? -1 : _slots[slot(key)];
     }
 
     /**
-     * @brief Test if the key is present or not.
+     * @brief Test if the key is present or not (case insensitive).
      * @param key The header key.
      * @return true if the key is present.
      */
-    auto HttpHeader::contains(const string& key) -> bool {
-      return find(key) != _hdrs.end();
+    auto HttpHeader::contains(string_view key) const -> bool {
+      return find(key) != -1;
     }
 
     /**
-     * @brief Test if the key is present and if the value match.
+     * @brief Test if the key is present and if one value match (case insensitive).
      * @param key The header key.
      * @param value The header value.
      * @return true if the key is present and match.
      */
-    auto HttpHeader::equals(const std::string& key, const std::string& value) -> bool {
-      auto it = find(key);
-      if(it != _hdrs.end()) {
-	if(std::find(it->second.begin(), it->second.end(), value) != it->second.end())
-	  return true;
-      }
+    auto HttpHeader::equals(string_view key, string_view value) const -> bool {
+      for(string_view v : get(key))
+	if(iequals(v, value)) return true;
       return false;
     }
 
     /**
-     * @brief Get the keys list.
-     * @return The list of keys.
+     * @brief Get the keys list (in order of appearance).
+     * @return The list of keys, valid until the next clear.
      */
-    auto HttpHeader::keys() -> vstring {
-      vstring v;
-      for(HttpHeadersConstIterator it = _hdrs.begin(); it != _hdrs.end(); ++it) {
-	string i = it->first;
-	v.push_back(i);
-      }
-      return v;
+    auto HttpHeader::keys() const -> const HttpHeaderNames& {
+      return _names;
     }
 
     /**
-     * @brief Get the specific header value.
+     * @brief Get the specific header values (case insensitive).
      * @param key The header key.
-     * @return The value.
-     */
-    auto HttpHeader::get(const string& key) -> vstring {
-      vstring v;
-      auto it = find(key);
-      if(it != _hdrs.end())
-	v = it->second;
-      return v;
+     * @return The values, valid until the next clear.
+     */
+    auto HttpHeader::get(string_view key) const -> HttpHeaderValues {
+      int k = find(key);
+      return HttpHeaderValues(&_fields, k == -1 ? -1 : _chains[k].first);
+    }
+
+    /**
+     * @brief Get the first value of a specific header (case insensitive).
+     * @param key The header key.
+     * @return The value or an empty view.
+     */
+    auto HttpHeader::value(string_view key) const -> string_view {
+      int k = find(key);
+      return k == -1 ? string_view() : _fields[_chains[k].first].value;
     }
 
   } /* namespace http */
@@ -11,26 +11,104 @@
 
 #include "Helper.hpp"
 #include <utility>
+#include <string_view>
+#include <memory_resource>
 
 namespace net {
   namespace http {
 
+    /**
+     * @brief Identifiers of the well-known header names.
+     */
+    enum class HttpHeaderId : unsigned char {
+	ACCEPT_RANGES = 0,
+	AGE,
+	CACHE_CONTROL,
+	CONNECTION,
+	CONTENT_DISPOSITION,
+	CONTENT_ENCODING,
+	CONTENT_LENGTH,
+	CONTENT_RANGE,
+	CONTENT_TYPE,
+	DATE,
+	ETAG,
+	EXPIRES,
+	KEEP_ALIVE,
+	LAST_MODIFIED,
+	LOCATION,
+	RETRY_AFTER,
+	SERVER,
+	SET_COOKIE,
+	TRANSFER_ENCODING,
+	VARY,
+	WWW_AUTHENTICATE,
+	UNKNOWN
+    };
+
     class HttpHeader {
       public:
 
-	HttpHeader();
+	/**
+	 * @param resource The memory resource used by the receive buffer and the index.
+	 */
+	HttpHeader(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 	~HttpHeader();
+	HttpHeader(const HttpHeader&) = delete;
+	HttpHeader& operator=(const HttpHeader&) = delete;
+
+	/**
+	 * @brief One header line, the views point into the receive buffer.
+	 */
+	struct HttpHeaderField {
+	    std::string_view name;
+	    std::string_view value;
+	    int next;
+	};
+	using HttpHeaderFields = std::pmr::vector<HttpHeaderField>;
+	using HttpHeaderNames = std::pmr::vector<std::string_view>;
+
+	/**
+	 * @brief Allocation-free range over the values of a key.
+	 */
+	class HttpHeaderValues {
+	  public:
+	    class const_iterator {
+	      public:
+		const_iterator(const HttpHeaderFields* fields, int index) : _fields(fields), _index(index) { }
+		auto operator*() const -> std::string_view { return (*_fields)[_index].value; }
+		auto operator++() -> const_iterator& { _index = (*_fields)[_index].next; return *this; }
+		auto operator!=(const const_iterator& o) const -> bool { return _index != o._index; }
+	      private:
+		const HttpHeaderFields* _fields;
+		int _index;
+	    };
+	    HttpHeaderValues(const HttpHeaderFields* fields, int first) : _fields(fields), _first(first) { }
+	    auto begin() const -> const_iterator { return const_iterator(_fields, _first); }
+	    auto end() const -> const_iterator { return const_iterator(_fields, -1); }
+	    auto empty() const -> bool { return _first == -1; }
+	  private:
+	    const HttpHeaderFields* _fields;
+	    int _first;
+	};
 
-	using HttpHeaderItem = std::pair<std::string, helper::vstring>;
-	using HttpHeaders = std::vector<HttpHeaderItem>;
-	using HttpHeadersIterator = HttpHeaders::iterator;
-	using HttpHeadersConstIterator = HttpHeaders::const_iterator;
-      
 	/**
-	 * @brief Clear the headers contexts.
+	 * @brief Get the identifier of a header name (case insensitive).
+	 * @param name The header name.
+	 * @return The identifier or HttpHeaderId::UNKNOWN.
+	 */
+	static auto id(std::string_view name) -> HttpHeaderId;
+
+	/**
+	 * @brief Clear the headers contexts (the memory is kept for the next response).
 	 */
 	auto clear() -> void;
 
+	/**
+	 * @brief Clear the headers contexts and give the memory back to the resource.
+	 * Must be called before the reset of an arena resource.
+	 */
+	auto release() -> void;
+
 	/**
 	 * @brief Test if all the headers are sent.
 	 * @return true if done.
@@ -41,35 +119,42 @@ namespace net {
 	 * @brief Append data to decode.
 	 * @param data The data.
 	 */
-	auto append(const std::string& data) -> void;
-      
+	auto append(std::string_view data) -> void;
+
 	/**
-	 * @brief Get the specific header value.
+	 * @brief Get the specific header values (case insensitive).
 	 * @param key The header key.
-	 * @return The value.
+	 * @return The values, valid until the next clear.
 	 */
-	auto get(const std::string& key) -> helper::vstring;
+	auto get(std::string_view key) const -> HttpHeaderValues;
 
 	/**
-	 * @brief Test if the key is present or not.
+	 * @brief Get the first value of a specific header (case insensitive).
+	 * @param key The header key.
+	 * @return The value or an empty view.
+	 */
+	auto value(std::string_view key) const -> std::string_view;
+
+	/**
+	 * @brief Test if the key is present or not (case insensitive).
 	 * @param key The header key.
 	 * @return true if the key is present.
 	 */
-	auto contains(const std::string& key) -> bool;
+	auto contains(std::string_view key) const -> bool;
 
 	/**
-	 * @brief Test if the key is present and if the value match.
+	 * @brief Test if the key is present and if one value match (case insensitive).
 	 * @param key The header key.
 	 * @param value The header value.
 	 * @return true if the key is present and match.
 	 */
-	auto equals(const std::string& key, const std::string& value) -> bool;
+	auto equals(std::string_view key, std::string_view value) const -> bool;
 
 	/**
-	 * @brief Get the keys list.
-	 * @return The list of keys.
+	 * @brief Get the keys list (in order of appearance).
+	 * @return The list of keys, valid until the next clear.
 	 */
-	auto keys() -> helper::vstring;
+	auto keys() const -> const HttpHeaderNames&;
 
 	/**
 	 * @biref Get the response code.
@@ -81,7 +166,7 @@ namespace net {
 	 * @biref Get the response reason.
 	 * @return The reason.
 	 */
-	auto reason() -> std::string;
+	auto reason() -> std::string_view;
 
 	/**
 	 * @brief Get the header length.
@@ -89,21 +174,52 @@ namespace net {
 	 */
 	auto length() -> std::size_t;
 
+	/**
+	 * @brief Get the raw headers, as received (with the final empty line).
+	 * @return The headers, valid until the next clear.
+	 */
+	auto raw() const -> std::string_view;
+
 
       private:
+	std::pmr::memory_resource* _resource;
 	bool _done;
 	unsigned int _code;
-	std::string _reason;
-	std::stringstream _content;
-	HttpHeaders _hdrs;
+	std::string_view _reason;
+	std::pmr::string _content;
 	std::size_t _length;
+	HttpHeaderFields _fields;
+	HttpHeaderNames _names;
+	std::pmr::vector<std::pair<int, int>> _chains;
+	int _known[static_cast<std::size_t>(HttpHeaderId::UNKNOWN)];
+	std::pmr::vector<int> _slots;
+
+	/**
+	 * @brief Parse the headers lines.
+	 * @param s The headers without the final empty line.
+	 */
+	auto parse(std::string_view s) -> void;
+
+	/**
+	 * @brief Add a field to the index.
+	 * @param name The header name.
+	 * @param value The header value.
+	 */
+	auto add(std::string_view name, std::string_view value) -> void;
 
 	/**
 	 * @brief Find an entry from the key.
 	 * @param key The key to find.
-	 * @return The value.
+	 * @return The index in the keys list or -1.
+	 */
+	auto find(std::string_view key) const -> int;
+
+	/**
+	 * @brief Find the open addressing slot of an unknown key.
+	 * @param key The key to find.
+	 * @return The slot index (empty slot if the key is absent).
 	 */
-	auto find(const std::string& key) -> HttpHeadersIterator;
+	auto slot(std::string_view key) const -> std::size_t;
     };
 
   } /* namespace http */
@@ -0,0 +1,382 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#include "LoadRunner.hpp"
+#include "PerfCounters.hpp"
+#include "Trace.hpp"
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <iomanip>
+#include <cstdlib>
+#include <condition_variable>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace net {
+  namespace http {
+
+    using clock = std::chrono::steady_clock;
+    using helper::Histogram;
+
+    /* events handled by one wait of an idle worker */
+    constexpr int LOAD_EVENTS = 64;
+
+    /**
+     * @brief Increment a counter owned by the calling thread (no atomic read-modify-write).
+     * @param c The counter.
+     * @param n The increment.
+     */
+    static inline auto bump(std::atomic<std::uint64_t>& c, std::uint64_t n = 1) -> void {
+      c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    LoadStats::LoadStats() : requests(0), errors(0), bytes(0), latency() {
+      for(std::atomic<std::uint64_t>& c : codes) c.store(0, std::memory_order_relaxed);
+    }
+
+    LoadRunner::LoadRunner(const std::string& appname, const HttpClientConnect& connect, const LoadConfig& config)
+      : _appname(appname), _connect(connect), _config(config), _latency(), _service(), _requests(0), _errors(0),
+	_bytes(0), _resumed(0), _closed(0), _threads(0), _held(0), _residentBase(0), _residentHeld(0), _elapsed(0.0),
+	_lastError(), _tcp(), _network(), _receiveDelay(), _stats() {
+      if(_config.rate <= 0.0) throw HttpClientException("Invalid load rate");
+      if(_config.connections == 0) _config.connections = 1;
+      _threads = std::min(_config.connections, _config.threads ? _config.threads : LOAD_THREADS);
+    }
+
+    /**
+     * @brief Get the resident memory of the process.
+     * @return The size in bytes, 0 if unknown.
+     */
+    static auto resident() -> std::size_t {
+      std::ifstream statm("/proc/self/statm");
+      std::size_t pages = 0, rss = 0;
+      if(!(statm >> pages >> rss)) return 0;
+      return rss * static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    }
+
+    /**
+     * @brief Raise the soft limit of open files up to the hard one for the held connections.
+     * @param files The number of files needed.
+     */
+    static auto raiseFileLimit(rlim_t files) -> void {
+      struct rlimit limit;
+      if(::getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur >= files) return;
+      limit.rlim_cur = limit.rlim_max == RLIM_INFINITY ? files : std::min(files, limit.rlim_max);
+      ::setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    /**
+     * @brief Run the load until the end of the duration.
+     */
+    auto LoadRunner::run() -> void {
+      std::mutex lock;
+      std::condition_variable held;
+      unsigned int finished = 0;
+      bool release = false;
+      std::vector<std::thread> workers;
+      /* the descriptors of the connections, the epoll instances and the files of the process */
+      raiseFileLimit(static_cast<rlim_t>(_config.connections) + _threads + 64);
+      _residentBase = resident();
+      const clock::time_point start = clock::now();
+      const clock::time_point end = start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(_config.duration));
+      /* each connection owns every n-th slot of the global schedule */
+      const std::chrono::duration<double> interval(_config.connections / _config.rate);
+      _stats.reset(new LoadStats[_threads]);
+      std::atomic<bool> stop(false);
+      std::thread reporting;
+      if(_config.interval > 0.0)
+	reporting = std::thread(&LoadRunner::reporter, this, std::cref(stop));
+      for(unsigned int w = 0; w < _threads; ++w) {
+	workers.emplace_back([this, w, start, end, interval, &lock, &held, &finished, &release]() {
+	    LoadStats& stats = _stats[w];
+	    /* a busy-polling worker must not share its core, the first one belongs to the main thread */
+	    if(_config.cpu >= 0) {
+	      unsigned int cpu = helper::Helper::nextCore(static_cast<unsigned int>(_config.cpu), 1 + w);
+	      if(!helper::Helper::pinThread(cpu)) {
+		std::lock_guard<std::mutex> guard(lock);
+		std::cerr << "Unable to pin the worker " << (w + 1) << " on the core " << cpu << std::endl;
+	      }
+	    }
+	    Trace::track(w + 1, "worker " + std::to_string(w + 1));
+	    std::ifstream params;
+	    if(!_config.paramsFile.empty())
+	      params.open(_config.paramsFile, std::ios::binary | std::ios::ate);
+	    HttpClientConnect cnx = _connect;
+	    cnx.is_params = &params;
+	    cnx.print_query = cnx.print_chunk = cnx.print_raw_resp = cnx.print_hex = false;
+	    cnx.print_nothing = true;
+	    /* the connections w, w + threads, w + 2 * threads... */
+	    std::vector<std::unique_ptr<HttpClient>> clients;
+	    for(unsigned int c = w; c < _config.connections; c += _threads)
+	      clients.emplace_back(new HttpClient(_appname));
+	    /* the idle connections are only watched for a close of the server */
+	    int ep = ::epoll_create1(EPOLL_CLOEXEC);
+	    struct epoll_event events[LOAD_EVENTS];
+	    Histogram latency, service;
+	    TcpInfo tcp;
+	    Histogram network, receiveDelay;
+	    std::uint64_t requests = 0, errors = 0, bytes = 0, resumed = 0, closed = 0;
+	    std::string lastError;
+	    /* until the intended time, the events only drop the closed connections */
+	    auto idle = [&](clock::time_point until) {
+	      while(ep != -1) {
+		int ms = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(until - clock::now()).count());
+		if(ms <= 0) break;
+		int n = ::epoll_wait(ep, events, LOAD_EVENTS, ms);
+		for(int e = 0; e < n; ++e) {
+		  HttpClient& client = *clients[events[e].data.u32];
+		  ::epoll_ctl(ep, EPOLL_CTL_DEL, client.fd(), nullptr);
+		  client.reset();
+		  closed++;
+		}
+	      }
+	      /* the rest of the millisecond */
+	      std::this_thread::sleep_until(until);
+	    };
+	    bool over = false;
+	    for(std::uint64_t k = 0; !over; ++k) {
+	      for(std::uint32_t i = 0; i < clients.size(); ++i) {
+		const unsigned int c = w + i * _threads;
+		const clock::duration offset = std::chrono::duration_cast<clock::duration>(interval * (static_cast<double>(c) / _config.connections));
+		clock::time_point intended = start + offset + std::chrono::duration_cast<clock::duration>(interval * static_cast<double>(k));
+		/* the intended times of a worker are increasing */
+		if(intended >= end) {
+		  over = true;
+		  break;
+		}
+		/* late requests are sent at once, their delay is part of the latency */
+		idle(intended);
+		HttpClient& client = *clients[i];
+		clock::time_point sent = clock::now();
+		std::size_t code = 0;
+		try {
+		  client.connect(cnx);
+		  std::size_t size = client.getPlainText().size();
+		  bytes += size;
+		  bump(stats.bytes, size);
+		  code = std::min<std::size_t>(client.getHttpHeader().code() / 100, LOAD_CODES - 1);
+		  if(client.sessionReused()) resumed++;
+		} catch(const std::exception& e) {
+		  errors++;
+		  bump(stats.errors);
+		  lastError = e.what();
+		}
+		clock::time_point done = clock::now();
+		tcp.add(client.tcpInfo(TcpPoint::CLOSE));
+		if(EasySocket::timestamping()) {
+		  std::int64_t n = Timestamping::networkTime(client.stamps()), r = Timestamping::receiveDelay(client.stamps());
+		  if(n >= 0) network.record(n);
+		  if(r >= 0) receiveDelay.record(r);
+		}
+		requests++;
+		std::uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(done - intended).count();
+		latency.record(ns);
+		service.record(std::chrono::duration_cast<std::chrono::nanoseconds>(done - sent).count());
+		stats.latency.record(ns);
+		bump(stats.codes[code]);
+		bump(stats.requests);
+		/* the kept connection only holds its socket (and its TLS state) until its next request */
+		client.release();
+		if(ep != -1 && client.fd() != -1) {
+		  struct epoll_event ev;
+		  ev.events = EPOLLIN | EPOLLRDHUP;
+		  ev.data.u32 = i;
+		  /* already watched if the connection was reused */
+		  ::epoll_ctl(ep, EPOLL_CTL_ADD, client.fd(), &ev);
+		}
+	      }
+	    }
+	    if(PerfCounters::enabled()) PerfCounters::thread().flush();
+	    std::size_t open = 0;
+	    for(const std::unique_ptr<HttpClient>& client : clients)
+	      if(client->fd() != -1) open++;
+	    {
+	      std::unique_lock<std::mutex> guard(lock);
+	      _latency.merge(latency);
+	      _service.merge(service);
+	      _tcp.merge(tcp);
+	      _network.merge(network);
+	      _receiveDelay.merge(receiveDelay);
+	      _requests += requests;
+	      _errors += errors;
+	      _bytes += bytes;
+	      _resumed += resumed;
+	      _closed += closed;
+	      _held += open;
+	      if(!lastError.empty()) _lastError = lastError;
+	      /* the connections are held until the memory is measured */
+	      finished++;
+	      held.notify_all();
+	      held.wait(guard, [&release]() { return release; });
+	    }
+	    if(ep != -1) ::close(ep);
+	  });
+      }
+      {
+	std::unique_lock<std::mutex> guard(lock);
+	held.wait(guard, [this, &finished]() { return finished == _threads; });
+	_elapsed = std::chrono::duration<double>(clock::now() - start).count();
+	_residentHeld = resident();
+	release = true;
+	held.notify_all();
+      }
+      for(std::thread& t : workers) t.join();
+      if(reporting.joinable()) {
+	stop = true;
+	reporting.join();
+      }
+    }
+
+    /**
+     * @brief Snapshot the workers every interval and print the deltas until stop is set.
+     * @param stop The stop flag.
+     */
+    auto LoadRunner::reporter(const std::atomic<bool>& stop) -> void {
+      enum class Format { TEXT, CSV, JSONL } format = Format::TEXT;
+      std::ofstream file;
+      if(!_config.statsFile.empty()) {
+	file.open(_config.statsFile);
+	if(!file.is_open()) {
+	  std::cerr << "Unable to open the file " << _config.statsFile << std::endl;
+	  return;
+	}
+	const std::string& f = _config.statsFile;
+	format = f.size() > 4 && f.compare(f.size() - 4, 4, ".csv") == 0 ? Format::CSV : Format::JSONL;
+      }
+      std::ostream& os = file.is_open() ? static_cast<std::ostream&>(file) : std::cout;
+      os << std::fixed << std::setprecision(3);
+      if(format == Format::CSV)
+	os << "time,requests,errors,rate,bytes,no_response,1xx,2xx,3xx,4xx,5xx,p50_ms,p99_ms,p99.9_ms,max_ms" << std::endl;
+      const char* names[LOAD_CODES] = { "no_response", "1xx", "2xx", "3xx", "4xx", "5xx" };
+      const std::chrono::duration<double> period(_config.interval);
+      const clock::time_point start = clock::now();
+      std::uint64_t last[3 + LOAD_CODES] = {}, now[3 + LOAD_CODES];
+      std::vector<std::uint64_t> lastCounts(Histogram::buckets(), 0), counts, worker;
+      clock::time_point tick = start, previous = start;
+      for(bool done = false; !done;) {
+	tick += std::chrono::duration_cast<clock::duration>(period);
+	while(!(done = stop.load()) && clock::now() < tick)
+	  std::this_thread::sleep_for(std::min<clock::duration>(tick - clock::now(), std::chrono::milliseconds(50)));
+	/* sum the cumulative counters of the workers, then keep the delta */
+	std::fill(std::begin(now), std::end(now), 0);
+	counts.assign(Histogram::buckets(), 0);
+	for(unsigned int w = 0; w < _threads; ++w) {
+	  const LoadStats& s = _stats[w];
+	  now[0] += s.requests.load(std::memory_order_relaxed);
+	  now[1] += s.errors.load(std::memory_order_relaxed);
+	  now[2] += s.bytes.load(std::memory_order_relaxed);
+	  for(std::size_t c = 0; c < LOAD_CODES; ++c)
+	    now[3 + c] += s.codes[c].load(std::memory_order_relaxed);
+	  s.latency.snapshot(worker);
+	  for(std::size_t i = 0; i < counts.size(); ++i) counts[i] += worker[i];
+	}
+	Histogram interval;
+	for(std::size_t i = 0; i < counts.size(); ++i)
+	  interval.recordBucket(i, counts[i] - lastCounts[i]);
+	std::uint64_t delta[3 + LOAD_CODES];
+	for(std::size_t i = 0; i < 3 + LOAD_CODES; ++i) delta[i] = now[i] - last[i];
+	std::copy(std::begin(now), std::end(now), std::begin(last));
+	lastCounts.swap(counts);
+	const clock::time_point snapshot = clock::now();
+	const double t = std::chrono::duration<double>(snapshot - start).count();
+	const double seconds = std::max(1e-9, std::chrono::duration<double>(snapshot - previous).count());
+	previous = snapshot;
+	const double p50 = interval.percentile(50.0) / 1e6, p99 = interval.percentile(99.0) / 1e6;
+	const double p999 = interval.percentile(99.9) / 1e6, max = interval.max() / 1e6;
+	if(format == Format::CSV) {
+	  os << t << "," << delta[0] << "," << delta[1] << "," << delta[0] / seconds << "," << delta[2];
+	  for(std::size_t c = 0; c < LOAD_CODES; ++c) os << "," << delta[3 + c];
+	  os << "," << p50 << "," << p99 << "," << p999 << "," << max << std::endl;
+	} else if(format == Format::JSONL) {
+	  os << "{\"time\":" << t << ",\"requests\":" << delta[0] << ",\"errors\":" << delta[1]
+	     << ",\"rate\":" << delta[0] / seconds << ",\"bytes\":" << delta[2];
+	  for(std::size_t c = 0; c < LOAD_CODES; ++c) os << ",\"" << names[c] << "\":" << delta[3 + c];
+	  os << ",\"p50_ms\":" << p50 << ",\"p99_ms\":" << p99 << ",\"p99.9_ms\":" << p999 << ",\"max_ms\":" << max << "}" << std::endl;
+	} else {
+	  os << "[" << std::setw(8) << t << " s] " << delta[0] << " req (" << delta[0] / seconds << " req/s), "
+	     << delta[1] << " err, " << helper::Helper::toHumanStringSize(delta[2]);
+	  for(std::size_t c = 0; c < LOAD_CODES; ++c)
+	    if(delta[3 + c]) os << ", " << names[c] << " " << delta[3 + c];
+	  os << ", p50 " << p50 << " ms, p99 " << p99 << " ms, p99.9 " << p999 << " ms, max " << max << " ms" << std::endl;
+	}
+      }
+    }
+
+    /**
+     * @brief Print the latency percentiles of a histogram in milliseconds.
+     * @param os The output stream.
+     * @param h The histogram.
+     */
+    static auto percentiles(std::ostream& os, const Histogram& h) -> void {
+      for(const char* p : { "50", "90", "99", "99.9", "99.99" })
+	os << "  p" << std::left << std::setw(6) << p << std::right << std::setw(12) << h.percentile(std::atof(p)) / 1e6 << " ms" << std::endl;
+      os << "  " << std::left << std::setw(7) << "max" << std::right << std::setw(12) << h.max() / 1e6 << " ms" << std::endl;
+      os << "  " << std::left << std::setw(7) << "mean" << std::right << std::setw(12) << h.mean() / 1e6 << " ms" << std::endl;
+    }
+
+    /**
+     * @brief Print the summary (rate, errors, latency percentiles, TCP_INFO and kernel timestamps if sampled).
+     * @param os The output stream.
+     */
+    auto LoadRunner::report(std::ostream& os) const -> void {
+      std::ios_base::fmtflags flags = os.flags();
+      std::streamsize precision = os.precision();
+      os << std::fixed << std::setprecision(3);
+      os << "Open-loop load: " << _config.rate << " req/s for " << _config.duration << " s on "
+	 << _config.connections << " connection(s), " << _threads << " thread(s)" << std::endl;
+      os << "Requests: " << _requests << " (errors " << _errors << "), achieved "
+	 << (_elapsed > 0.0 ? _requests / _elapsed : 0.0) << " req/s, "
+	 << helper::Helper::toHumanStringSize(_bytes) << " received" << std::endl;
+      if(_connect.ssl && EasySocket::lowMemory())
+	os << "TLS sessions resumed: " << _resumed << std::endl;
+      os << "Connections held at the end: " << _held << " (closed by the server while idle: " << _closed << ")";
+      if(_held && _residentHeld > _residentBase)
+	os << ", resident memory " << helper::Helper::toHumanStringSize(_residentHeld - _residentBase) << " above the start ("
+	   << helper::Helper::toHumanStringSize((_residentHeld - _residentBase) / _held) << " per connection)";
+      os << std::endl;
+      if(!_lastError.empty())
+	os << "Last error: " << _lastError << std::endl;
+      os << "Latency (from the intended send time):" << std::endl;
+      percentiles(os, _latency);
+      os << "Service time (from the actual send time):" << std::endl;
+      percentiles(os, _service);
+      if(EasySocket::tcpInfo()) _tcp.report(os);
+      if(EasySocket::timestamping()) {
+	os << "Network and server time (kernel stamps, " << _network.count() << " request(s)):" << std::endl;
+	percentiles(os, _network);
+	os << "Kernel to httpu delay of the first response byte:" << std::endl;
+	percentiles(os, _receiveDelay);
+      }
+      os.flags(flags);
+      os.precision(precision);
+    }
+
+    /**
+     * @brief Get the latency measured from the intended send times, in nanoseconds.
+     * @return const helper::Histogram&
+     */
+    auto LoadRunner::latency() const -> const Histogram& {
+      return _latency;
+    }
+
+    /**
+     * @brief Get the service time measured from the actual send times, in nanoseconds.
+     * @return const helper::Histogram&
+     */
+    auto LoadRunner::service() const -> const Histogram& {
+      return _service;
+    }
+
+  } /* namespace http */
+} /* namespace net */
@@ -0,0 +1,138 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#ifndef __LOADRUNNER_H__
+#define __LOADRUNNER_H__
+
+#include "HttpClient.hpp"
+#include "Histogram.hpp"
+#include "TcpInfo.hpp"
+#include <ostream>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+
+namespace net {
+  namespace http {
+
+    struct LoadConfig {
+	/**
+	 * @param rate The target rate in requests per second (for all the connections).
+	 * @param duration The duration in seconds.
+	 * @param connections The number of connections, kept open between their requests.
+	 * @param paramsFile The params file, opened by each worker (empty if none).
+	 * @param interval The period of the live statistics in seconds (0 to disable).
+	 * @param statsFile The live statistics file, CSV if it ends with .csv, JSON lines else (empty for stdout).
+	 * @param cpu The core of the main thread, the workers use the next allowed cores (-1 to disable the pinning).
+	 * @param threads The number of worker threads sharing the connections (0 for one per connection, at most LOAD_THREADS).
+	 */
+	double rate;
+	double duration;
+	unsigned int connections;
+	std::string paramsFile;
+	double interval;
+	std::string statsFile;
+	int cpu;
+	unsigned int threads;
+    };
+
+    /* default maximum of worker threads, the other connections are shared among them */
+    constexpr unsigned int LOAD_THREADS = 64;
+
+    /* status classes: no response, 1xx to 5xx */
+    constexpr std::size_t LOAD_CODES = 6;
+
+    /**
+     * @brief Counters of one worker thread, written by its thread only and read by the reporter
+     * without locks, padded so that the workers do not share cache lines.
+     */
+    struct alignas(64) LoadStats {
+	LoadStats();
+	std::atomic<std::uint64_t> requests;
+	std::atomic<std::uint64_t> errors;
+	std::atomic<std::uint64_t> bytes;
+	std::atomic<std::uint64_t> codes[LOAD_CODES];
+	helper::LiveHistogram latency;
+    };
+
+    /**
+     * @brief Open-loop constant-rate load generator (wrk2 style).
+     * The requests are scheduled at fixed intended send times and the latency is measured
+     * from the intended time, so a stalled server is not hidden by the coordinated omission
+     * of a closed loop. The service time (from the actual send) is recorded as well.
+     * Each worker thread owns a share of the connections: their requests are sent in schedule
+     * order and the idle connections are watched with epoll, so that the ones closed by the
+     * server are dropped (and reconnected by their next request) while the others are held.
+     */
+    class LoadRunner {
+      public:
+	/**
+	 * @param appname The application name (User-Agent).
+	 * @param connect The request, copied for each worker with the printing disabled.
+	 * @param config The load configuration.
+	 */
+	LoadRunner(const std::string& appname, const HttpClientConnect& connect, const LoadConfig& config);
+	virtual ~LoadRunner() = default;
+
+	/**
+	 * @brief Run the load until the end of the duration.
+	 */
+	auto run() -> void;
+
+	/**
+	 * @brief Print the summary (rate, errors, latency percentiles, TCP_INFO and kernel timestamps if sampled).
+	 * @param os The output stream.
+	 */
+	auto report(std::ostream& os) const -> void;
+
+	/**
+	 * @brief Get the latency measured from the intended send times, in nanoseconds.
+	 * @return const helper::Histogram&
+	 */
+	auto latency() const -> const helper::Histogram&;
+
+	/**
+	 * @brief Get the service time measured from the actual send times, in nanoseconds.
+	 * @return const helper::Histogram&
+	 */
+	auto service() const -> const helper::Histogram&;
+
+      private:
+	std::string _appname;
+	const HttpClientConnect& _connect;
+	LoadConfig _config;
+	helper::Histogram _latency;
+	helper::Histogram _service;
+	std::uint64_t _requests;
+	std::uint64_t _errors;
+	std::uint64_t _bytes;
+	std::uint64_t _resumed;
+	std::uint64_t _closed;
+	unsigned int _threads;
+	std::size_t _held;
+	std::size_t _residentBase;
+	std::size_t _residentHeld;
+	double _elapsed;
+	std::string _lastError;
+	TcpInfo _tcp;
+	helper::Histogram _network;
+	helper::Histogram _receiveDelay;
+	std::unique_ptr<LoadStats[]> _stats;
+
+	/**
+	 * @brief Snapshot the workers every interval and print the deltas until stop is set.
+	 * @param stop The stop flag.
+	 */
+	auto reporter(const std::atomic<bool>& stop) -> void;
+    };
+
+  } /* namespace http */
+} /* namespace net */
+
+#endif /* __LOADRUNNER_H__ */
@@ -0,0 +1,197 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#include "PerfCounters.hpp"
+#include <mutex>
+#include <iomanip>
+#include <cstring>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+namespace net {
+
+  static const struct {
+      const char* name;
+      std::uint32_t type;
+      std::uint64_t config;
+  } events[PERF_EVENTS] = {
+    { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { "ctx-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+    { "task-clock-ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK }
+  };
+
+  static const char* phaseNames[PERF_PHASES] = {
+    "connect", "tls", "write", "wait", "headers", "chunks", "inflate", "output"
+  };
+
+  bool PerfCounters::_enabled = false;
+
+  /* process aggregate, filled by flush */
+  static std::mutex aggregateLock;
+  static PerfValues aggregateValues[PERF_PHASES];
+  static unsigned int aggregateAvailable = 0;
+
+  PerfCounters::PerfCounters() : _fds(), _leader(-1), _slots(), _opened(0), _request(), _total() {
+    for(std::size_t e = 0; e < PERF_EVENTS; ++e) {
+      struct perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = events[e].type;
+      attr.config = events[e].config;
+      /* the software events (context switches, CPU time) happen in the kernel */
+      attr.exclude_kernel = events[e].type == PERF_TYPE_HARDWARE ? 1 : 0;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP;
+      attr.disabled = _leader == -1 ? 1 : 0;
+      /* counts the calling thread on any CPU, in one group so that a single read gets them all */
+      _fds[e] = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, _leader, 0));
+      if(_fds[e] < 0 && !attr.exclude_kernel) {
+	/* user space only when the kernel side is denied */
+	attr.exclude_kernel = 1;
+	_fds[e] = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, _leader, 0));
+      }
+      if(_fds[e] < 0) continue;
+      if(_leader == -1) _leader = _fds[e];
+      _slots[e] = _opened++;
+    }
+    if(_leader != -1) {
+      ::ioctl(_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+      ::ioctl(_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+  }
+
+  PerfCounters::~PerfCounters() {
+    for(std::size_t e = 0; e < PERF_EVENTS; ++e)
+      if(_fds[e] >= 0 && _fds[e] != _leader) ::close(_fds[e]);
+    if(_leader >= 0) ::close(_leader);
+  }
+
+  /**
+   * @brief Enable the instrumentation (before the first request).
+   * @param enable The state.
+   */
+  auto PerfCounters::enable(bool enable) -> void {
+    _enabled = enable;
+  }
+
+  /**
+   * @brief Get the counters of the calling thread (opened on the first call).
+   * @return PerfCounters&
+   */
+  auto PerfCounters::thread() -> PerfCounters& {
+    static thread_local PerfCounters counters;
+    return counters;
+  }
+
+  /**
+   * @brief Read the current values.
+   * @param values The values.
+   */
+  auto PerfCounters::read(PerfValues& values) -> void {
+    std::uint64_t buffer[1 + PERF_EVENTS] = {};
+    if(_leader == -1 || ::read(_leader, buffer, sizeof(buffer)) <= 0) buffer[0] = 0;
+    for(std::size_t e = 0; e < PERF_EVENTS; ++e)
+      values.values[e] = _fds[e] >= 0 && _slots[e] < buffer[0] ? buffer[1 + _slots[e]] : 0;
+  }
+
+  /**
+   * @brief Start a new request (clears the per-request values).
+   */
+  auto PerfCounters::begin() -> void {
+    memset(_request, 0, sizeof(_request));
+  }
+
+  /**
+   * @brief Attribute a delta to a phase.
+   * @param phase The phase.
+   * @param from The values at the start of the phase.
+   * @param to The values at the end of the phase.
+   */
+  auto PerfCounters::add(PerfPhase phase, const PerfValues& from, const PerfValues& to) -> void {
+    std::size_t p = static_cast<std::size_t>(phase);
+    for(std::size_t e = 0; e < PERF_EVENTS; ++e) {
+      std::uint64_t delta = to.values[e] - from.values[e];
+      _request[p].values[e] += delta;
+      _total[p].values[e] += delta;
+    }
+  }
+
+  /**
+   * @brief Add the totals of this thread to the process aggregate.
+   */
+  auto PerfCounters::flush() -> void {
+    std::lock_guard<std::mutex> lock(aggregateLock);
+    for(std::size_t p = 0; p < PERF_PHASES; ++p)
+      for(std::size_t e = 0; e < PERF_EVENTS; ++e)
+	aggregateValues[p].values[e] += _total[p].values[e];
+    for(std::size_t e = 0; e < PERF_EVENTS; ++e)
+      if(_fds[e] >= 0) aggregateAvailable |= 1u << e;
+    memset(_total, 0, sizeof(_total));
+  }
+
+  /**
+   * @brief Print a phases table.
+   * @param os The output stream.
+   * @param phases The values.
+   * @param available The bitmask of the available events.
+   * @param divisor The values are divided by this number.
+   */
+  auto PerfCounters::table(std::ostream& os, const PerfValues* phases, unsigned int available, std::uint64_t divisor) -> void {
+    if(!available) {
+      os << "CPU counters unavailable (perf_event_open denied, see /proc/sys/kernel/perf_event_paranoid)" << std::endl;
+      return;
+    }
+    if(!divisor) divisor = 1;
+    os << std::left << std::setw(10) << "phase" << std::right;
+    for(std::size_t e = 0; e < PERF_EVENTS; ++e) os << std::setw(15) << events[e].name;
+    os << std::endl;
+    PerfValues total = {};
+    for(std::size_t p = 0; p <= PERF_PHASES; ++p) {
+      const PerfValues& v = p < PERF_PHASES ? phases[p] : total;
+      os << std::left << std::setw(10) << (p < PERF_PHASES ? phaseNames[p] : "total") << std::right;
+      for(std::size_t e = 0; e < PERF_EVENTS; ++e) {
+	if(p < PERF_PHASES) total.values[e] += v.values[e];
+	if(available & (1u << e)) os << std::setw(15) << v.values[e] / divisor;
+	else os << std::setw(15) << "n/a";
+      }
+      os << std::endl;
+    }
+  }
+
+  /**
+   * @brief Print the values of the last request of this thread.
+   * @param os The output stream.
+   */
+  auto PerfCounters::report(std::ostream& os) const -> void {
+    unsigned int available = 0;
+    for(std::size_t e = 0; e < PERF_EVENTS; ++e)
+      if(_fds[e] >= 0) available |= 1u << e;
+    os << "CPU counters of the request:" << std::endl;
+    table(os, _request, available, 1);
+  }
+
+  /**
+   * @brief Print the process aggregate (totals and per request means).
+   * @param os The output stream.
+   * @param requests The number of requests.
+   */
+  auto PerfCounters::aggregate(std::ostream& os, std::uint64_t requests) -> void {
+    std::lock_guard<std::mutex> lock(aggregateLock);
+    os << "CPU counters, total of " << requests << " request(s):" << std::endl;
+    table(os, aggregateValues, aggregateAvailable, 1);
+    if(requests > 1 && aggregateAvailable) {
+      os << "CPU counters, mean per request:" << std::endl;
+      table(os, aggregateValues, aggregateAvailable, requests);
+    }
+  }
+
+} /* namespace net */
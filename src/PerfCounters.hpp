@@ -0,0 +1,182 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#ifndef __PERFCOUNTERS_H__
+#define __PERFCOUNTERS_H__
+
+#include <ostream>
+#include <cstdint>
+#include <cstddef>
+
+namespace net {
+
+  /**
+   * @brief Phases of HttpClient::connect the counters are attributed to.
+   */
+  enum class PerfPhase : unsigned char {
+      CONNECT = 0, /* DNS and TCP connect */
+      TLS,         /* TLS handshake */
+      WRITE,       /* request written */
+      WAIT,        /* waiting for and reading the response */
+      HEADERS,     /* header parse */
+      CHUNKS,      /* chunk decode */
+      INFLATE,     /* decompression */
+      OUTPUT,      /* response printed */
+      COUNT
+  };
+
+  /**
+   * @brief Counted events.
+   */
+  enum class PerfEvent : unsigned char {
+      CYCLES = 0,
+      INSTRUCTIONS,
+      CACHE_MISSES,
+      CONTEXT_SWITCHES,
+      TASK_CLOCK, /* CPU time in ns, available without hardware counters */
+      COUNT
+  };
+
+  constexpr std::size_t PERF_PHASES = static_cast<std::size_t>(PerfPhase::COUNT);
+  constexpr std::size_t PERF_EVENTS = static_cast<std::size_t>(PerfEvent::COUNT);
+
+  struct PerfValues {
+      std::uint64_t values[PERF_EVENTS];
+  };
+
+  /**
+   * @brief Per-thread perf_event_open counters, attributed to the phases of the requests.
+   * The events that cannot be opened (no PMU in a VM, perf_event_paranoid) are reported as n/a.
+   */
+  class PerfCounters {
+    public:
+      PerfCounters();
+      ~PerfCounters();
+      PerfCounters(const PerfCounters&) = delete;
+      PerfCounters& operator=(const PerfCounters&) = delete;
+
+      /**
+       * @brief Enable the instrumentation (before the first request).
+       * @param enable The state.
+       */
+      static auto enable(bool enable) -> void;
+
+      /**
+       * @brief Test if the instrumentation is enabled.
+       * @return bool
+       */
+      static auto enabled() -> bool {
+	return _enabled;
+      }
+
+      /**
+       * @brief Get the counters of the calling thread (opened on the first call).
+       * @return PerfCounters&
+       */
+      static auto thread() -> PerfCounters&;
+
+      /**
+       * @brief Read the current values.
+       * @param values The values.
+       */
+      auto read(PerfValues& values) -> void;
+
+      /**
+       * @brief Start a new request (clears the per-request values).
+       */
+      auto begin() -> void;
+
+      /**
+       * @brief Attribute a delta to a phase.
+       * @param phase The phase.
+       * @param from The values at the start of the phase.
+       * @param to The values at the end of the phase.
+       */
+      auto add(PerfPhase phase, const PerfValues& from, const PerfValues& to) -> void;
+
+      /**
+       * @brief Add the totals of this thread to the process aggregate.
+       */
+      auto flush() -> void;
+
+      /**
+       * @brief Print the values of the last request of this thread.
+       * @param os The output stream.
+       */
+      auto report(std::ostream& os) const -> void;
+
+      /**
+       * @brief Print the process aggregate (totals and per request means).
+       * @param os The output stream.
+       * @param requests The number of requests.
+       */
+      static auto aggregate(std::ostream& os, std::uint64_t requests) -> void;
+
+    private:
+      static bool _enabled;
+      int _fds[PERF_EVENTS];
+      int _leader;
+      std::size_t _slots[PERF_EVENTS];
+      std::size_t _opened;
+      PerfValues _request[PERF_PHASES];
+      PerfValues _total[PERF_PHASES];
+
+      /**
+       * @brief Print a phases table.
+       * @param os The output stream.
+       * @param phases The values.
+       * @param available The bitmask of the available events.
+       * @param divisor The values are divided by this number.
+       */
+      static auto table(std::ostream& os, const PerfValues* phases, unsigned int available, std::uint64_t divisor) -> void;
+  };
+
+  /**
+   * @brief Attribute the counters spent in a scope to a phase (no-op when disabled).
+   */
+  class PerfScope {
+    public:
+      PerfScope(PerfPhase phase) : _phase(phase), _counters(nullptr), _from{} {
+	if(PerfCounters::enabled()) {
+	  _counters = &PerfCounters::thread();
+	  _counters->read(_from);
+	}
+      }
+      ~PerfScope() {
+	if(_counters) {
+	  PerfValues to;
+	  _counters->read(to);
+	  _counters->add(_phase, _from, to);
+	}
+      }
+
+      /**
+       * @brief Attribute the counters spent so far to the current phase and continue with another one.
+       * @param phase The next phase.
+       */
+      auto next(PerfPhase phase) -> void {
+	if(_counters) {
+	  PerfValues to;
+	  _counters->read(to);
+	  _counters->add(_phase, _from, to);
+	  _from = to;
+	}
+	_phase = phase;
+      }
+      PerfScope(const PerfScope&) = delete;
+      PerfScope& operator=(const PerfScope&) = delete;
+
+    private:
+      PerfPhase _phase;
+      PerfCounters* _counters;
+      PerfValues _from;
+  };
+
+} /* namespace net */
+
+#endif /* __PERFCOUNTERS_H__ */
@@ -0,0 +1,175 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#include "Prober.hpp"
+#include "Helper.hpp"
+#include "Trace.hpp"
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <unordered_map>
+#include <algorithm>
+
+namespace net {
+  namespace http {
+
+    using std::string;
+    using std::string_view;
+    using clock = std::chrono::steady_clock;
+
+    Prober::Prober(const string& appname, const HttpClientConnect& connect, const ProbeConfig& config)
+      : _appname(appname), _connect(connect), _config(config), _targets(), _sites(), _pending(0), _cursor(0),
+	_lock(), _cond(), _codes(), _elapsed(0.0) {
+      if(_config.connections == 0) _config.connections = PROBE_CONNECTIONS;
+      if(_config.perHost == 0) _config.perHost = PROBE_PER_HOST;
+      /* the body is never read */
+      _connect.method = _config.get ? "GET" : "HEAD";
+      _connect.gzip = false;
+      _connect.print_query = _connect.print_chunk = _connect.print_raw_resp = _connect.print_hex = false;
+      _connect.print_nothing = true;
+      load();
+    }
+
+    /**
+     * @brief Load the URL list.
+     */
+    auto Prober::load() -> void {
+      std::ifstream ifs(_config.urls);
+      if(!ifs.is_open()) throw HttpClientException("Unable to open the file " + _config.urls);
+      std::unordered_map<string, std::size_t> sites;
+      string line;
+      while(std::getline(ifs, line)) {
+	string_view url = helper::Helper::trim(helper::Helper::trim(string_view(line), '\r'));
+	if(url.empty() || url.front() == '#') continue;
+	Target target = { string(url), "", _connect.ssl, 0 };
+	if(url.substr(0, 7) == "http://") {
+	  url.remove_prefix(7);
+	  target.ssl = false;
+	} else if(url.substr(0, 8) == "https://") {
+	  url.remove_prefix(8);
+	  target.ssl = true;
+	}
+	target.host = url;
+	/* the cap applies to the scheme, host and port */
+	string key = (target.ssl ? "https://" : "http://") + string(url.substr(0, url.find('/')));
+	auto it = sites.emplace(key, _sites.size()).first;
+	if(it->second == _sites.size()) _sites.push_back(Site{ {}, 0 });
+	target.site = it->second;
+	_sites[target.site].pending.push_back(_targets.size());
+	_targets.push_back(std::move(target));
+      }
+      _pending = _targets.size();
+    }
+
+    /**
+     * @brief Probe all the URLs.
+     * @param os The output stream of the lines.
+     */
+    auto Prober::run(std::ostream& os) -> void {
+      const clock::time_point start = clock::now();
+      std::vector<std::thread> workers;
+      const std::size_t count = std::min<std::size_t>(_config.connections, _targets.size());
+      for(std::size_t w = 0; w < count; ++w)
+	workers.emplace_back([this, &os, w]() {
+	    Trace::track(static_cast<std::uint32_t>(w + 1), "probe " + std::to_string(w + 1));
+	    std::ifstream params;
+	    HttpClientConnect cnx = _connect;
+	    cnx.is_params = &params;
+	    HttpClient client(_appname);
+	    std::size_t index;
+	    while(take(index)) {
+	      std::size_t code = 0;
+	      string line = probe(client, cnx, index, code);
+	      std::lock_guard<std::mutex> guard(_lock);
+	      os << line << std::endl;
+	      _codes[code]++;
+	      _sites[_targets[index].site].active--;
+	      _cond.notify_all();
+	    }
+	  });
+      for(std::thread& t : workers) t.join();
+      _elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    }
+
+    /**
+     * @brief Take the next URL whose host is under its cap (round robin over the hosts),
+     * waiting while all the pending ones are capped.
+     * @param index The index of the URL.
+     * @return false when all the URLs are taken.
+     */
+    auto Prober::take(std::size_t& index) -> bool {
+      std::unique_lock<std::mutex> lock(_lock);
+      for(;;) {
+	if(_pending == 0) return false;
+	for(std::size_t n = 0; n < _sites.size(); ++n) {
+	  Site& site = _sites[_cursor];
+	  _cursor = (_cursor + 1) % _sites.size();
+	  if(site.pending.empty() || site.active >= _config.perHost) continue;
+	  index = site.pending.front();
+	  site.pending.pop_front();
+	  site.active++;
+	  _pending--;
+	  return true;
+	}
+	_cond.wait(lock);
+      }
+    }
+
+    /**
+     * @brief Probe one URL.
+     * @param client The client of the worker.
+     * @param connect The request of the worker.
+     * @param index The index of the URL.
+     * @param code The status class (0 without response).
+     * @return The line of the URL.
+     */
+    auto Prober::probe(HttpClient& client, HttpClientConnect& connect, std::size_t index, std::size_t& code) -> string {
+      const Target& target = _targets[index];
+      connect.host = target.host;
+      connect.ssl = target.ssl;
+      std::ostringstream oss;
+      const clock::time_point sent = clock::now();
+      try {
+	string body;
+	/* returns with the headers, the rest of a GET is dropped with the connection */
+	client.open(connect, body);
+	double ms = std::chrono::duration<double, std::milli>(clock::now() - sent).count();
+	HttpHeader& hdr = client.getHttpHeader();
+	code = std::min<std::size_t>(hdr.code() / 100, PROBE_CODES - 1);
+	oss << hdr.code() << "\t" << std::fixed << std::setprecision(3) << ms << "\t" << target.url;
+	for(const string& field : _config.fields)
+	  oss << "\t" << field << ": " << hdr.value(field);
+      } catch(const std::exception& e) {
+	double ms = std::chrono::duration<double, std::milli>(clock::now() - sent).count();
+	code = 0;
+	oss << "ERR\t" << std::fixed << std::setprecision(3) << ms << "\t" << target.url << "\t" << e.what();
+      }
+      client.reset();
+      return oss.str();
+    }
+
+    /**
+     * @brief Print the summary (URLs, rate, status classes and errors).
+     * @param os The output stream.
+     */
+    auto Prober::report(std::ostream& os) const -> void {
+      std::ios_base::fmtflags flags = os.flags();
+      std::streamsize precision = os.precision();
+      os << std::fixed << std::setprecision(3);
+      os << "Probed " << _targets.size() << " URL(s) of " << _sites.size() << " host(s) in " << _elapsed << " s ("
+	 << (_elapsed > 0.0 ? _targets.size() / _elapsed : 0.0) << " URL/s) with " << _connect.method << std::endl;
+      os << "Status: 1xx " << _codes[1] << ", 2xx " << _codes[2] << ", 3xx " << _codes[3] << ", 4xx " << _codes[4]
+	 << ", 5xx " << _codes[5] << ", errors " << _codes[0] << std::endl;
+      os.flags(flags);
+      os.precision(precision);
+    }
+
+  } /* namespace http */
+} /* namespace net */
@@ -0,0 +1,134 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#ifndef __PROBER_H__
+#define __PROBER_H__
+
+#include "HttpClient.hpp"
+#include <ostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+namespace net {
+  namespace http {
+
+    /* default number of concurrent probes */
+    constexpr unsigned int PROBE_CONNECTIONS = 64;
+    /* default number of concurrent probes of the same host */
+    constexpr unsigned int PROBE_PER_HOST = 6;
+    /* status classes: no response, 1xx to 5xx */
+    constexpr std::size_t PROBE_CODES = 6;
+
+    struct ProbeConfig {
+	/**
+	 * @param urls The file of the URLs, one per line ('#' starts a comment, http:// and https:// select the transport).
+	 * @param connections The number of concurrent probes (0 for PROBE_CONNECTIONS).
+	 * @param perHost The number of concurrent probes of the same host and port (0 for PROBE_PER_HOST).
+	 * @param get Send a GET aborted once the headers are received instead of a HEAD.
+	 * @param fields The response headers printed after the status.
+	 */
+	std::string urls;
+	unsigned int connections;
+	unsigned int perHost;
+	bool get;
+	std::vector<std::string> fields;
+    };
+
+    /**
+     * @brief Headers-only sweep of a list of URLs.
+     * Each URL is probed with a HEAD (or a GET whose connection is reset as soon as the
+     * headers are complete, for the servers answering HEAD differently), the body is never
+     * read. The probes run concurrently with a cap per host and one compact line is printed
+     * per URL as it completes: the status, the time in milliseconds, the URL and the
+     * selected headers.
+     */
+    class Prober {
+      public:
+	/**
+	 * @param appname The application name (User-Agent).
+	 * @param connect The request template (headers, cookies, TLS), the host is replaced by each URL.
+	 * @param config The probe configuration.
+	 */
+	Prober(const std::string& appname, const HttpClientConnect& connect, const ProbeConfig& config);
+	virtual ~Prober() = default;
+
+	/**
+	 * @brief Probe all the URLs.
+	 * @param os The output stream of the lines.
+	 */
+	auto run(std::ostream& os) -> void;
+
+	/**
+	 * @brief Print the summary (URLs, rate, status classes and errors).
+	 * @param os The output stream.
+	 */
+	auto report(std::ostream& os) const -> void;
+
+      private:
+	/**
+	 * @brief One URL of the list.
+	 */
+	struct Target {
+	    std::string url;   /* as listed */
+	    std::string host;  /* host[:port]/path as given to --host */
+	    bool ssl;
+	    std::size_t site;  /* index of the scheme, host and port in _sites */
+	};
+
+	/**
+	 * @brief URLs of the same scheme, host and port, under the per host cap.
+	 */
+	struct Site {
+	    std::deque<std::size_t> pending;
+	    unsigned int active;
+	};
+
+	std::string _appname;
+	HttpClientConnect _connect;
+	ProbeConfig _config;
+	std::vector<Target> _targets;
+	std::vector<Site> _sites;
+	std::size_t _pending;
+	std::size_t _cursor;
+	std::mutex _lock;
+	std::condition_variable _cond;
+	std::uint64_t _codes[PROBE_CODES];
+	double _elapsed;
+
+	/**
+	 * @brief Load the URL list.
+	 */
+	auto load() -> void;
+
+	/**
+	 * @brief Take the next URL whose host is under its cap (round robin over the hosts),
+	 * waiting while all the pending ones are capped.
+	 * @param index The index of the URL.
+	 * @return false when all the URLs are taken.
+	 */
+	auto take(std::size_t& index) -> bool;
+
+	/**
+	 * @brief Probe one URL.
+	 * @param client The client of the worker.
+	 * @param connect The request of the worker.
+	 * @param index The index of the URL.
+	 * @param code The status class (0 without response).
+	 * @return The line of the URL.
+	 */
+	auto probe(HttpClient& client, HttpClientConnect& connect, std::size_t index, std::size_t& code) -> std::string;
+    };
+
+  } /* namespace http */
+} /* namespace net */
+
+#endif /* __PROBER_H__ */
@@ -0,0 +1,325 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#include "SSLMemPool.hpp"
+#include "Helper.hpp"
+#include <openssl/crypto.h>
+#include <atomic>
+#include <mutex>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <new>
+
+namespace net {
+
+  using helper::Helper;
+
+  constexpr std::size_t POOL_CLASSES    = 12;        /* 16 bytes to 32 KB */
+  constexpr std::size_t POOL_MIN_SHIFT  = 4;
+  constexpr std::size_t POOL_SLAB       = 0x10000;
+  constexpr std::size_t POOL_LARGE      = POOL_CLASSES;
+  constexpr std::uint32_t POOL_MAGIC    = 0x55504f4c;
+
+  /* the header keeps the 16 bytes alignment expected by malloc users */
+  struct alignas(16) PoolBlock {
+      std::uint32_t cls;
+      std::uint32_t magic;
+      std::size_t size;
+  };
+
+  struct PoolFree {
+      PoolFree* next;
+  };
+
+  struct PoolClassStats {
+      std::atomic<std::size_t> allocs;
+      std::atomic<std::size_t> frees;
+      std::atomic<std::size_t> used;
+      std::atomic<std::size_t> peak;
+  };
+
+  /**
+   * @brief Counters of one thread, written by this thread only (no shared cache line on the
+   * allocation path) and summed by the report. A block freed by another thread is counted by
+   * the freeing one, so only the sums are meaningful.
+   */
+  struct PoolCounters {
+      PoolClassStats classes[POOL_CLASSES + 1];
+      std::atomic<std::size_t> reserved;
+      std::atomic<std::size_t> inUse;
+      PoolCounters* next;
+  };
+
+  static std::atomic<bool> poolInstalled(false);
+  /* the counters of all the threads, never freed (like the slabs) */
+  static std::atomic<PoolCounters*> poolCounters(nullptr);
+
+  /* blocks given back by the threads that exited */
+  static std::mutex depotLock;
+  static PoolFree* depot[POOL_CLASSES];
+
+  /**
+   * @brief Add to a counter of the calling thread (no read-modify-write, the thread is the only writer).
+   * @param c The counter.
+   * @param n The value, modulo 2^64 (a negative value is subtracted).
+   */
+  static inline auto bump(std::atomic<std::size_t>& c, std::size_t n) -> void {
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  static inline auto classSize(std::size_t cls) -> std::size_t {
+    return std::size_t(1) << (cls + POOL_MIN_SHIFT);
+  }
+
+  static inline auto classOf(std::size_t size) -> std::size_t {
+    std::size_t cls = 0;
+    while(cls < POOL_CLASSES && classSize(cls) < size) ++cls;
+    return cls;
+  }
+
+  /**
+   * @brief Free lists of one thread (trivially destructible, so it stays usable while the thread exits).
+   */
+  struct ThreadPool {
+      PoolFree* lists[POOL_CLASSES];
+      bool dead;
+      PoolCounters* counters;
+
+      /**
+       * @brief Get the counters of the thread, registered on the first call.
+       * @return PoolCounters* (nullptr if they cannot be allocated).
+       */
+      auto stats() -> PoolCounters* {
+	if(!counters) {
+	  void* p = ::malloc(sizeof(PoolCounters));
+	  if(!p) return nullptr;
+	  counters = new(p) PoolCounters();
+	  std::lock_guard<std::mutex> lock(depotLock);
+	  counters->next = poolCounters.load(std::memory_order_relaxed);
+	  poolCounters.store(counters, std::memory_order_release);
+	}
+	return counters;
+      }
+
+      /**
+       * @brief Give all the free blocks to the depot.
+       */
+      auto flush() -> void {
+	std::lock_guard<std::mutex> lock(depotLock);
+	for(std::size_t cls = 0; cls < POOL_CLASSES; ++cls) {
+	  while(lists[cls]) {
+	    PoolFree* f = lists[cls];
+	    lists[cls] = f->next;
+	    f->next = depot[cls];
+	    depot[cls] = f;
+	  }
+	}
+      }
+
+      /**
+       * @brief Refill a free list from the depot or from a new slab.
+       * @param cls The size class.
+       */
+      auto refill(std::size_t cls) -> void {
+	{
+	  std::lock_guard<std::mutex> lock(depotLock);
+	  if(depot[cls]) {
+	    /* a dead thread only takes one block at a time */
+	    if(dead) {
+	      lists[cls] = depot[cls];
+	      depot[cls] = depot[cls]->next;
+	      lists[cls]->next = nullptr;
+	    } else {
+	      lists[cls] = depot[cls];
+	      depot[cls] = nullptr;
+	    }
+	    return;
+	  }
+	}
+	std::size_t block = sizeof(PoolBlock) + classSize(cls);
+	std::size_t count = POOL_SLAB / block;
+	if(!count || dead) count = 1;
+	char* slab = static_cast<char*>(::malloc(block * count));
+	if(!slab) return;
+	if(PoolCounters* c = stats()) bump(c->reserved, block * count);
+	for(std::size_t i = count; i; --i) {
+	  PoolFree* f = reinterpret_cast<PoolFree*>(slab + (i - 1) * block);
+	  f->next = lists[cls];
+	  lists[cls] = f;
+	}
+      }
+  };
+
+  static thread_local ThreadPool threadPool;
+
+  /**
+   * @brief Flush the free lists of the thread to the depot when it exits.
+   */
+  struct ThreadPoolGuard {
+      ~ThreadPoolGuard() {
+	threadPool.flush();
+	threadPool.dead = true;
+      }
+  };
+
+  static thread_local ThreadPoolGuard threadPoolGuard;
+
+  static inline auto account(std::size_t cls, std::size_t size, bool alloc) -> void {
+    PoolCounters* c = threadPool.stats();
+    if(!c) return;
+    PoolClassStats& s = c->classes[cls];
+    if(alloc) {
+      bump(s.allocs, 1);
+      std::size_t used = s.used.load(std::memory_order_relaxed) + 1;
+      s.used.store(used, std::memory_order_relaxed);
+      /* signed, a thread freeing the blocks of another one goes below 0 */
+      if(static_cast<std::ptrdiff_t>(used) > static_cast<std::ptrdiff_t>(s.peak.load(std::memory_order_relaxed)))
+	s.peak.store(used, std::memory_order_relaxed);
+      bump(c->inUse, size);
+    } else {
+      bump(s.frees, 1);
+      bump(s.used, static_cast<std::size_t>(-1));
+      bump(c->inUse, 0 - size);
+    }
+  }
+
+  static auto poolMalloc(std::size_t size, const char* file, int line) -> void* {
+    (void)file;
+    (void)line;
+    std::size_t cls = classOf(size);
+    PoolBlock* b;
+    if(cls == POOL_LARGE) {
+      b = static_cast<PoolBlock*>(::malloc(sizeof(PoolBlock) + size));
+      if(!b) return nullptr;
+      if(PoolCounters* c = threadPool.stats()) bump(c->reserved, sizeof(PoolBlock) + size);
+    } else {
+      ThreadPool& tp = threadPool;
+      if(!tp.lists[cls]) {
+	(void)threadPoolGuard;
+	tp.refill(cls);
+      }
+      PoolFree* f = tp.lists[cls];
+      if(!f) return nullptr;
+      tp.lists[cls] = f->next;
+      b = reinterpret_cast<PoolBlock*>(f);
+    }
+    b->cls = static_cast<std::uint32_t>(cls);
+    b->magic = POOL_MAGIC;
+    b->size = size;
+    account(cls, size, true);
+    return b + 1;
+  }
+
+  static auto poolFree(void* ptr, const char* file, int line) -> void {
+    (void)file;
+    (void)line;
+    if(!ptr) return;
+    PoolBlock* b = static_cast<PoolBlock*>(ptr) - 1;
+    std::size_t cls = b->cls;
+    account(cls, b->size, false);
+    b->magic = 0;
+    if(cls == POOL_LARGE) {
+      if(PoolCounters* c = threadPool.stats()) bump(c->reserved, 0 - (sizeof(PoolBlock) + b->size));
+      ::free(b);
+      return;
+    }
+    ThreadPool& tp = threadPool;
+    PoolFree* f = reinterpret_cast<PoolFree*>(b);
+    f->next = tp.lists[cls];
+    tp.lists[cls] = f;
+    if(tp.dead) tp.flush();
+  }
+
+  static auto poolRealloc(void* ptr, std::size_t size, const char* file, int line) -> void* {
+    if(!ptr) return poolMalloc(size, file, line);
+    if(!size) {
+      poolFree(ptr, file, line);
+      return nullptr;
+    }
+    PoolBlock* b = static_cast<PoolBlock*>(ptr) - 1;
+    /* the block is large enough, only the accounting changes */
+    if(b->cls != POOL_LARGE && classSize(b->cls) >= size) {
+      if(PoolCounters* c = threadPool.stats()) bump(c->inUse, size - b->size);
+      b->size = size;
+      return ptr;
+    }
+    void* n = poolMalloc(size, file, line);
+    if(!n) return nullptr;
+    memcpy(n, ptr, std::min(size, b->size));
+    poolFree(ptr, file, line);
+    return n;
+  }
+
+  /**
+   * @brief Install the OpenSSL memory hooks, must be called before any other OpenSSL call.
+   * @return false if OpenSSL has already allocated some memory.
+   */
+  auto SSLMemPool::install() -> bool {
+    if(poolInstalled) return true;
+    if(!CRYPTO_set_mem_functions(poolMalloc, poolRealloc, poolFree))
+      return false;
+    poolInstalled = true;
+    return true;
+  }
+
+  /**
+   * @brief Test if the hooks are installed.
+   * @return bool
+   */
+  auto SSLMemPool::installed() -> bool {
+    return poolInstalled;
+  }
+
+  /**
+   * @brief Get the number of bytes reserved by the pools (slabs and large blocks).
+   * @return std::size_t
+   */
+  auto SSLMemPool::reserved() -> std::size_t {
+    std::size_t total = 0;
+    for(PoolCounters* c = poolCounters.load(std::memory_order_acquire); c; c = c->next)
+      total += c->reserved.load(std::memory_order_relaxed);
+    return total;
+  }
+
+  /**
+   * @brief Get the number of bytes currently used by OpenSSL.
+   * @return std::size_t
+   */
+  auto SSLMemPool::inUse() -> std::size_t {
+    std::size_t total = 0;
+    for(PoolCounters* c = poolCounters.load(std::memory_order_acquire); c; c = c->next)
+      total += c->inUse.load(std::memory_order_relaxed);
+    return total;
+  }
+
+  /**
+   * @brief Print the usage of the pools.
+   * @param os The output stream.
+   */
+  auto SSLMemPool::report(std::ostream& os) -> void {
+    os << "OpenSSL memory pools: reserved " << Helper::toHumanStringSize(reserved())
+       << ", in use " << Helper::toHumanStringSize(inUse()) << std::endl;
+    for(std::size_t cls = 0; cls <= POOL_CLASSES; ++cls) {
+      std::size_t allocs = 0, frees = 0, used = 0, peak = 0;
+      for(PoolCounters* c = poolCounters.load(std::memory_order_acquire); c; c = c->next) {
+	const PoolClassStats& s = c->classes[cls];
+	allocs += s.allocs.load(std::memory_order_relaxed);
+	frees += s.frees.load(std::memory_order_relaxed);
+	used += s.used.load(std::memory_order_relaxed);
+	peak += s.peak.load(std::memory_order_relaxed);
+      }
+      if(!allocs) continue;
+      if(cls == POOL_LARGE) os << " - large";
+      else os << " - " << classSize(cls);
+      /* the peak is the sum of the peaks of the threads, an upper bound of the process peak */
+      os << ": allocs " << allocs << ", frees " << frees << ", live " << used << ", peak " << peak << std::endl;
+    }
+  }
+
+} /* namespace net */
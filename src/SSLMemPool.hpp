@@ -0,0 +1,59 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#ifndef __SSLMEMPOOL_H__
+#define __SSLMEMPOOL_H__
+
+#include <ostream>
+#include <cstddef>
+
+namespace net {
+
+  /**
+   * @brief Per-thread size-class pools used by OpenSSL through CRYPTO_set_mem_functions.
+   * The blocks are carved from slabs which are never given back to the system, the freed
+   * blocks go to the free lists of the calling thread and to a shared depot when it exits.
+   */
+  class SSLMemPool {
+    public:
+      SSLMemPool() = delete;
+
+      /**
+       * @brief Install the OpenSSL memory hooks, must be called before any other OpenSSL call.
+       * @return false if OpenSSL has already allocated some memory.
+       */
+      static auto install() -> bool;
+
+      /**
+       * @brief Test if the hooks are installed.
+       * @return bool
+       */
+      static auto installed() -> bool;
+
+      /**
+       * @brief Print the usage of the pools.
+       * @param os The output stream.
+       */
+      static auto report(std::ostream& os) -> void;
+
+      /**
+       * @brief Get the number of bytes reserved by the pools (slabs and large blocks).
+       * @return std::size_t
+       */
+      static auto reserved() -> std::size_t;
+
+      /**
+       * @brief Get the number of bytes currently used by OpenSSL.
+       * @return std::size_t
+       */
+      static auto inUse() -> std::size_t;
+  };
+
+} /* namespace net */
+
+#endif /* __SSLMEMPOOL_H__ */
@@ -0,0 +1,134 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#include "SlabPool.hpp"
+#include "Helper.hpp"
+#include <atomic>
+#include <mutex>
+
+namespace net {
+
+  using helper::Helper;
+
+  /**
+   * @brief Counters of one thread, never freed so that the report still sees the exited threads.
+   */
+  struct SlabCounters {
+      std::atomic<std::size_t> total;
+      std::atomic<std::size_t> borrowed;
+      std::atomic<std::size_t> peak;
+      SlabCounters* next;
+  };
+
+  static std::mutex slabRegistryLock;
+  static std::atomic<SlabCounters*> slabCounters(nullptr);
+
+  /**
+   * @brief Add to a counter of the calling thread (the thread is the only writer).
+   * @param c The counter.
+   * @param n The value, modulo 2^64.
+   */
+  static inline auto bump(std::atomic<std::size_t>& c, std::size_t n) -> void {
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Free slabs of one thread, linked through their first bytes.
+   */
+  struct SlabCache {
+      char* free;
+      SlabCounters* counters;
+
+      SlabCache() : free(nullptr), counters(new SlabCounters()) {
+	std::lock_guard<std::mutex> lock(slabRegistryLock);
+	counters->next = slabCounters.load(std::memory_order_relaxed);
+	slabCounters.store(counters, std::memory_order_release);
+      }
+
+      ~SlabCache() {
+	while(free) {
+	  char* slab = free;
+	  free = *reinterpret_cast<char**>(slab);
+	  delete[] slab;
+	  bump(counters->total, static_cast<std::size_t>(-1));
+	}
+      }
+  };
+
+  static thread_local SlabCache slabCache;
+
+  /**
+   * @brief Sum a counter of all the threads.
+   * @param field The counter.
+   * @return std::size_t
+   */
+  static auto sum(std::atomic<std::size_t> SlabCounters::* field) -> std::size_t {
+    std::size_t total = 0;
+    for(SlabCounters* c = slabCounters.load(std::memory_order_acquire); c; c = c->next)
+      total += (c->*field).load(std::memory_order_relaxed);
+    return total;
+  }
+
+  /**
+   * @brief Borrow a slab of SLAB_SIZE bytes.
+   * @return The slab.
+   */
+  auto SlabPool::acquire() -> char* {
+    SlabCache& cache = slabCache;
+    SlabCounters& c = *cache.counters;
+    char* slab = cache.free;
+    if(slab)
+      cache.free = *reinterpret_cast<char**>(slab);
+    else {
+      slab = new char[SLAB_SIZE];
+      bump(c.total, 1);
+    }
+    std::size_t borrowed = c.borrowed.load(std::memory_order_relaxed) + 1;
+    c.borrowed.store(borrowed, std::memory_order_relaxed);
+    if(borrowed > c.peak.load(std::memory_order_relaxed)) c.peak.store(borrowed, std::memory_order_relaxed);
+    return slab;
+  }
+
+  /**
+   * @brief Give a slab back to the pool of the calling thread.
+   * @param slab The slab.
+   */
+  auto SlabPool::release(char* slab) -> void {
+    SlabCache& cache = slabCache;
+    *reinterpret_cast<char**>(slab) = cache.free;
+    cache.free = slab;
+    bump(cache.counters->borrowed, static_cast<std::size_t>(-1));
+  }
+
+  /**
+   * @brief Get the number of slabs allocated by the pool.
+   * @return std::size_t
+   */
+  auto SlabPool::total() -> std::size_t {
+    return sum(&SlabCounters::total);
+  }
+
+  /**
+   * @brief Get the maximum number of slabs borrowed at the same time (sum of the threads).
+   * @return std::size_t
+   */
+  auto SlabPool::peak() -> std::size_t {
+    return sum(&SlabCounters::peak);
+  }
+
+  /**
+   * @brief Print the usage of the pool.
+   * @param os The output stream.
+   */
+  auto SlabPool::report(std::ostream& os) -> void {
+    std::size_t total = SlabPool::total();
+    os << "Receive slabs: " << total << " allocated (" << Helper::toHumanStringSize(total * SLAB_SIZE)
+       << "), peak borrowed " << peak() << ", borrowed " << sum(&SlabCounters::borrowed) << std::endl;
+  }
+
+} /* namespace net */
@@ -0,0 +1,62 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#ifndef __SLABPOOL_H__
+#define __SLABPOOL_H__
+
+#include <ostream>
+#include <cstddef>
+
+namespace net {
+
+  /* a full TLS record */
+  constexpr std::size_t SLAB_SIZE = 0x4000;
+
+  /**
+   * @brief Per-thread pools of receive buffers, borrowed by the sockets only while data is pending.
+   * A thread only takes and gives back its own slabs, without any lock, the counters are
+   * written by their thread only and summed by the report.
+   */
+  class SlabPool {
+    public:
+      SlabPool() = delete;
+
+      /**
+       * @brief Borrow a slab of SLAB_SIZE bytes.
+       * @return The slab.
+       */
+      static auto acquire() -> char*;
+
+      /**
+       * @brief Give a slab back to the pool of the calling thread.
+       * @param slab The slab.
+       */
+      static auto release(char* slab) -> void;
+
+      /**
+       * @brief Get the number of slabs allocated by the pool.
+       * @return std::size_t
+       */
+      static auto total() -> std::size_t;
+
+      /**
+       * @brief Get the maximum number of slabs borrowed at the same time (sum of the threads).
+       * @return std::size_t
+       */
+      static auto peak() -> std::size_t;
+
+      /**
+       * @brief Print the usage of the pool.
+       * @param os The output stream.
+       */
+      static auto report(std::ostream& os) -> void;
+  };
+
+} /* namespace net */
+
+#endif /* __SLABPOOL_H__ */
@@ -0,0 +1,126 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#include "TcpInfo.hpp"
+#include "Helper.hpp"
+#include <cstring>
+#include <iomanip>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/tcp.h>
+
+namespace net {
+
+  using helper::Helper;
+
+  TcpInfo::TcpInfo() : _connections(0), _rtt(), _retransmits(0), _retransmitted(0), _cwnd(0),
+		       _deliveryRate(0), _bytesAcked(0), _synData(0) {
+  }
+
+  /**
+   * @brief Sample TCP_INFO.
+   * @param fd The socket (not a TCP socket gives an invalid sample).
+   * @param sample The sample.
+   */
+  auto TcpInfo::sample(int fd, TcpSample& sample) -> void {
+    struct tcp_info info;
+    memset(&info, 0, sizeof(info));
+    socklen_t len = sizeof(info);
+    memset(&sample, 0, sizeof(sample));
+    if(fd < 0 || ::getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) < 0) return;
+    sample.valid = true;
+    sample.rtt = info.tcpi_rtt;
+    sample.rttvar = info.tcpi_rttvar;
+    sample.retransmits = info.tcpi_total_retrans;
+    sample.cwnd = info.tcpi_snd_cwnd;
+    sample.synData = info.tcpi_options & TCPI_OPT_SYN_DATA;
+    /* the fields below are absent from the older kernels (shorter len) */
+    if(len >= offsetof(struct tcp_info, tcpi_bytes_received) + sizeof(info.tcpi_bytes_received)) {
+      sample.bytesAcked = info.tcpi_bytes_acked;
+      sample.bytesReceived = info.tcpi_bytes_received;
+    }
+    if(len >= offsetof(struct tcp_info, tcpi_delivery_rate) + sizeof(info.tcpi_delivery_rate))
+      sample.deliveryRate = info.tcpi_delivery_rate;
+  }
+
+  /**
+   * @brief Print the samples of one connection.
+   * @param os The output stream.
+   * @param samples The samples (TCP_POINTS).
+   */
+  auto TcpInfo::report(std::ostream& os, const TcpSample* samples) -> void {
+    static const char* points[TCP_POINTS] = { "connected", "first byte", "close" };
+    os << "TCP info:" << std::endl;
+    os << std::left << std::setw(12) << "  point" << std::right << std::setw(10) << "rtt(us)" << std::setw(10) << "rttvar"
+       << std::setw(9) << "retrans" << std::setw(7) << "cwnd" << std::setw(16) << "delivery rate" << std::setw(14) << "bytes acked"
+       << std::setw(16) << "bytes received" << std::endl;
+    for(std::size_t p = 0; p < TCP_POINTS; ++p) {
+      const TcpSample& s = samples[p];
+      os << "  " << std::left << std::setw(10) << points[p] << std::right;
+      if(!s.valid) {
+	os << std::setw(10) << "n/a" << std::endl;
+	continue;
+      }
+      os << std::setw(10) << s.rtt << std::setw(10) << s.rttvar << std::setw(9) << s.retransmits << std::setw(7) << s.cwnd
+	 << std::setw(14) << Helper::toHumanStringSize(s.deliveryRate) << "/s" << std::setw(14) << s.bytesAcked
+	 << std::setw(16) << s.bytesReceived << std::endl;
+    }
+    const TcpSample& last = samples[static_cast<std::size_t>(TcpPoint::CLOSE)];
+    if(last.valid) os << "  SYN data acked (fast open): " << (last.synData ? "yes" : "no") << std::endl;
+  }
+
+  /**
+   * @brief Add the close sample of a connection to the aggregate.
+   * @param sample The sample.
+   */
+  auto TcpInfo::add(const TcpSample& sample) -> void {
+    if(!sample.valid) return;
+    _connections++;
+    _rtt.record(sample.rtt);
+    _retransmits += sample.retransmits;
+    if(sample.retransmits) _retransmitted++;
+    _cwnd += sample.cwnd;
+    _deliveryRate += sample.deliveryRate;
+    _bytesAcked += sample.bytesAcked;
+    if(sample.synData) _synData++;
+  }
+
+  /**
+   * @brief Add another aggregate.
+   * @param other The aggregate.
+   */
+  auto TcpInfo::merge(const TcpInfo& other) -> void {
+    _connections += other._connections;
+    _rtt.merge(other._rtt);
+    _retransmits += other._retransmits;
+    _retransmitted += other._retransmitted;
+    _cwnd += other._cwnd;
+    _deliveryRate += other._deliveryRate;
+    _bytesAcked += other._bytesAcked;
+    _synData += other._synData;
+  }
+
+  /**
+   * @brief Print the aggregate.
+   * @param os The output stream.
+   */
+  auto TcpInfo::report(std::ostream& os) const -> void {
+    if(!_connections) {
+      os << "TCP info: no sample" << std::endl;
+      return;
+    }
+    os << "TCP info of " << _connections << " connection(s), at close:" << std::endl;
+    os << "  smoothed RTT: p50 " << _rtt.percentile(50.0) << " us, p99 " << _rtt.percentile(99.0)
+       << " us, max " << _rtt.max() << " us" << std::endl;
+    os << "  retransmits: " << _retransmits << " segment(s) on " << _retransmitted << " connection(s)" << std::endl;
+    os << "  mean cwnd: " << _cwnd / _connections << " segment(s), mean delivery rate: "
+       << Helper::toHumanStringSize(_deliveryRate / _connections) << "/s, bytes acked: " << _bytesAcked << std::endl;
+    os << "  SYN data acked (fast open): " << _synData << " connection(s)" << std::endl;
+  }
+
+} /* namespace net */
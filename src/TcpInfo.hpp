@@ -0,0 +1,98 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#ifndef __TCPINFO_H__
+#define __TCPINFO_H__
+
+#include "Histogram.hpp"
+#include <ostream>
+#include <cstdint>
+#include <cstddef>
+
+namespace net {
+
+  /**
+   * @brief Points of a connection where TCP_INFO is sampled.
+   */
+  enum class TcpPoint : unsigned char {
+      CONNECTED = 0, /* after the TCP connect */
+      FIRST_BYTE,    /* first response byte received */
+      CLOSE,         /* before the close (or at the end of a request on a kept connection) */
+      COUNT
+  };
+
+  constexpr std::size_t TCP_POINTS = static_cast<std::size_t>(TcpPoint::COUNT);
+
+  /**
+   * @brief Subset of TCP_INFO.
+   */
+  struct TcpSample {
+      bool valid;
+      std::uint32_t rtt;          /* smoothed RTT in us */
+      std::uint32_t rttvar;       /* RTT variance in us */
+      std::uint32_t retransmits;  /* total retransmitted segments */
+      std::uint32_t cwnd;         /* congestion window in segments */
+      std::uint64_t deliveryRate; /* bytes per second */
+      std::uint64_t bytesAcked;
+      std::uint64_t bytesReceived;
+      bool synData;               /* data sent with the SYN was acked (TCP Fast Open) */
+  };
+
+  /**
+   * @brief TCP_INFO sampling and aggregation.
+   */
+  class TcpInfo {
+    public:
+      TcpInfo();
+
+      /**
+       * @brief Sample TCP_INFO.
+       * @param fd The socket (not a TCP socket gives an invalid sample).
+       * @param sample The sample.
+       */
+      static auto sample(int fd, TcpSample& sample) -> void;
+
+      /**
+       * @brief Print the samples of one connection.
+       * @param os The output stream.
+       * @param samples The samples (TCP_POINTS).
+       */
+      static auto report(std::ostream& os, const TcpSample* samples) -> void;
+
+      /**
+       * @brief Add the close sample of a connection to the aggregate.
+       * @param sample The sample.
+       */
+      auto add(const TcpSample& sample) -> void;
+
+      /**
+       * @brief Add another aggregate.
+       * @param other The aggregate.
+       */
+      auto merge(const TcpInfo& other) -> void;
+
+      /**
+       * @brief Print the aggregate.
+       * @param os The output stream.
+       */
+      auto report(std::ostream& os) const -> void;
+
+    private:
+      std::uint64_t _connections;
+      helper::Histogram _rtt;
+      std::uint64_t _retransmits;
+      std::uint64_t _retransmitted;
+      std::uint64_t _cwnd;
+      std::uint64_t _deliveryRate;
+      std::uint64_t _bytesAcked;
+      std::uint64_t _synData;
+  };
+
+} /* namespace net */
+
+#endif /* __TCPINFO_H__ */
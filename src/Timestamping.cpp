@@ -0,0 +1,169 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#include "Timestamping.hpp"
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <sys/socket.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+
+namespace net {
+
+  static auto toNs(const struct timespec& ts) -> std::int64_t {
+    return static_cast<std::int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+  }
+
+  /**
+   * @brief Get the SCM_TIMESTAMPING control message of a received message.
+   * @param msg The message.
+   * @return The stamps or nullptr.
+   */
+  static auto stampsOf(struct msghdr& msg) -> const struct scm_timestamping* {
+    for(struct cmsghdr* c = CMSG_FIRSTHDR(&msg); c != nullptr; c = CMSG_NXTHDR(&msg, c))
+      if(c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPING)
+	return reinterpret_cast<const struct scm_timestamping*>(CMSG_DATA(c));
+    return nullptr;
+  }
+
+  /**
+   * @brief Enable the software (and hardware if configured on the interface) RX and TX stamps.
+   * @param fd The socket, before any request byte is written.
+   * @return false if the kernel refuses.
+   */
+  auto Timestamping::enable(int fd) -> bool {
+    /* OPT_ID numbers the TX stamps, OPT_TSONLY does not loop the payload back */
+    unsigned int flags = SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_RAW_HARDWARE
+      | SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_RX_HARDWARE
+      | SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_TX_HARDWARE | SOF_TIMESTAMPING_TX_ACK
+      | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+    return ::setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0;
+  }
+
+  /**
+   * @brief Get the CLOCK_REALTIME time.
+   * @return std::int64_t in nanoseconds.
+   */
+  auto Timestamping::now() -> std::int64_t {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return toNs(ts);
+  }
+
+  /**
+   * @brief Wait for the next bytes and get their RX stamp without consuming them.
+   * @param fd The socket.
+   * @param stamps Where received, hwReceived and read are set.
+   */
+  auto Timestamping::receive(int fd, KernelStamps& stamps) -> void {
+    char data;
+    char control[CMSG_SPACE(sizeof(struct scm_timestamping))];
+    struct iovec iov = { &data, 1 };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t r = ::recvmsg(fd, &msg, MSG_PEEK);
+    stamps.read = now();
+    if(r <= 0) return;
+    const struct scm_timestamping* ts = stampsOf(msg);
+    if(ts == nullptr) return;
+    stamps.received = toNs(ts->ts[0]);
+    stamps.hwReceived = toNs(ts->ts[2]);
+  }
+
+  /**
+   * @brief Drain the error queue and keep the last TX stamps (only the unknown ones are set).
+   * @param fd The socket.
+   * @param stamps Where sent, acked and hwSent are set.
+   */
+  auto Timestamping::transmit(int fd, KernelStamps& stamps) -> void {
+    std::int64_t sent = 0, acked = 0, hwSent = 0;
+    for(;;) {
+      char control[CMSG_SPACE(sizeof(struct scm_timestamping)) + CMSG_SPACE(sizeof(struct sock_extended_err) + 64)];
+      struct msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      if(::recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) break;
+      const struct scm_timestamping* ts = nullptr;
+      const struct sock_extended_err* err = nullptr;
+      for(struct cmsghdr* c = CMSG_FIRSTHDR(&msg); c != nullptr; c = CMSG_NXTHDR(&msg, c)) {
+	if(c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPING)
+	  ts = reinterpret_cast<const struct scm_timestamping*>(CMSG_DATA(c));
+	else if(c->cmsg_len >= CMSG_LEN(sizeof(struct sock_extended_err)))
+	  err = reinterpret_cast<const struct sock_extended_err*>(CMSG_DATA(c));
+      }
+      if(ts == nullptr || err == nullptr || err->ee_origin != SO_EE_ORIGIN_TIMESTAMPING) continue;
+      /* the stamps come in order, the last ones are the last request bytes */
+      if(err->ee_info == SCM_TSTAMP_SND) {
+	if(ts->ts[0].tv_sec || ts->ts[0].tv_nsec) sent = toNs(ts->ts[0]);
+	if(ts->ts[2].tv_sec || ts->ts[2].tv_nsec) hwSent = toNs(ts->ts[2]);
+      } else if(err->ee_info == SCM_TSTAMP_ACK)
+	acked = toNs(ts->ts[0]);
+    }
+    if(!stamps.sent) stamps.sent = sent;
+    if(!stamps.acked) stamps.acked = acked;
+    if(!stamps.hwSent) stamps.hwSent = hwSent;
+  }
+
+  /**
+   * @brief Get the delay between the last write call and the driver (user space and stack).
+   * @param stamps The stamps.
+   * @return The delay in nanoseconds, -1 if unknown.
+   */
+  auto Timestamping::sendDelay(const KernelStamps& stamps) -> std::int64_t {
+    return stamps.written && stamps.sent ? stamps.sent - stamps.written : -1;
+  }
+
+  /**
+   * @brief Get the time between the last request byte sent and the first response byte
+   * received by the kernel (network and server), from the NIC stamps when available.
+   * @param stamps The stamps.
+   * @return The time in nanoseconds, -1 if unknown.
+   */
+  auto Timestamping::networkTime(const KernelStamps& stamps) -> std::int64_t {
+    if(stamps.hwSent && stamps.hwReceived) return stamps.hwReceived - stamps.hwSent;
+    return stamps.sent && stamps.received ? stamps.received - stamps.sent : -1;
+  }
+
+  /**
+   * @brief Get the delay between the kernel and the user space for the first response byte.
+   * @param stamps The stamps.
+   * @return The delay in nanoseconds, -1 if unknown.
+   */
+  auto Timestamping::receiveDelay(const KernelStamps& stamps) -> std::int64_t {
+    return stamps.received && stamps.read ? stamps.read - stamps.received : -1;
+  }
+
+  /**
+   * @brief Print the stamps of one request.
+   * @param os The output stream.
+   * @param stamps The stamps.
+   */
+  auto Timestamping::report(std::ostream& os, const KernelStamps& stamps) -> void {
+    auto line = [&os](const char* name, std::int64_t ns) {
+      os << "  " << std::left << std::setw(48) << name << std::right;
+      if(ns < 0) os << "n/a" << std::endl;
+      else os << std::fixed << std::setprecision(3) << ns / 1e3 << " us" << std::endl;
+    };
+    std::ios_base::fmtflags flags = os.flags();
+    std::streamsize precision = os.precision();
+    os << "Kernel timestamps (" << (stamps.hwSent && stamps.hwReceived ? "hardware" : "software") << "):" << std::endl;
+    line("write call -> sent by the kernel:", sendDelay(stamps));
+    line("sent -> acked by the peer:", stamps.sent && stamps.acked ? stamps.acked - stamps.sent : -1);
+    line("sent -> first byte received (network+server):", networkTime(stamps));
+    line("received by the kernel -> read by httpu:", receiveDelay(stamps));
+    os.flags(flags);
+    os.precision(precision);
+  }
+
+} /* namespace net */
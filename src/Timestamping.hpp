@@ -0,0 +1,97 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#ifndef __TIMESTAMPING_H__
+#define __TIMESTAMPING_H__
+
+#include <ostream>
+#include <cstdint>
+
+namespace net {
+
+  /**
+   * @brief Kernel timestamps of a request, in nanoseconds (0 if unknown).
+   * The software stamps and the user space times use CLOCK_REALTIME, the hardware stamps
+   * use the clock of the NIC and are only compared with each other.
+   */
+  struct KernelStamps {
+      std::int64_t written;    /* user space: last request write call */
+      std::int64_t sent;       /* kernel: last request byte given to the driver */
+      std::int64_t acked;      /* kernel: last request byte acknowledged by the peer */
+      std::int64_t received;   /* kernel: first response byte received */
+      std::int64_t read;       /* user space: first response byte available */
+      std::int64_t hwSent;     /* NIC: last request byte sent */
+      std::int64_t hwReceived; /* NIC: first response byte received */
+  };
+
+  /**
+   * @brief SO_TIMESTAMPING helpers, the RX stamps are peeked (MSG_PEEK) from the socket
+   * and the TX stamps are read from the error queue (MSG_ERRQUEUE).
+   */
+  class Timestamping {
+    public:
+      /**
+       * @brief Enable the software (and hardware if configured on the interface) RX and TX stamps.
+       * @param fd The socket, before any request byte is written.
+       * @return false if the kernel refuses.
+       */
+      static auto enable(int fd) -> bool;
+
+      /**
+       * @brief Get the CLOCK_REALTIME time.
+       * @return std::int64_t in nanoseconds.
+       */
+      static auto now() -> std::int64_t;
+
+      /**
+       * @brief Wait for the next bytes and get their RX stamp without consuming them.
+       * @param fd The socket.
+       * @param stamps Where received, hwReceived and read are set.
+       */
+      static auto receive(int fd, KernelStamps& stamps) -> void;
+
+      /**
+       * @brief Drain the error queue and keep the last TX stamps (only the unknown ones are set).
+       * @param fd The socket.
+       * @param stamps Where sent, acked and hwSent are set.
+       */
+      static auto transmit(int fd, KernelStamps& stamps) -> void;
+
+      /**
+       * @brief Get the delay between the last write call and the driver (user space and stack).
+       * @param stamps The stamps.
+       * @return The delay in nanoseconds, -1 if unknown.
+       */
+      static auto sendDelay(const KernelStamps& stamps) -> std::int64_t;
+
+      /**
+       * @brief Get the time between the last request byte sent and the first response byte
+       * received by the kernel (network and server), from the NIC stamps when available.
+       * @param stamps The stamps.
+       * @return The time in nanoseconds, -1 if unknown.
+       */
+      static auto networkTime(const KernelStamps& stamps) -> std::int64_t;
+
+      /**
+       * @brief Get the delay between the kernel and the user space for the first response byte.
+       * @param stamps The stamps.
+       * @return The delay in nanoseconds, -1 if unknown.
+       */
+      static auto receiveDelay(const KernelStamps& stamps) -> std::int64_t;
+
+      /**
+       * @brief Print the stamps of one request.
+       * @param os The output stream.
+       * @param stamps The stamps.
+       */
+      static auto report(std::ostream& os, const KernelStamps& stamps) -> void;
+  };
+
+} /* namespace net */
+
+#endif /* __TIMESTAMPING_H__ */
@@ -0,0 +1,94 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#include "Timings.hpp"
+
+namespace net {
+
+  static constexpr std::string_view phaseNames[] = {
+    "start", "dns", "connect", "tls", "written", "first_byte", "headers", "body", "decompress"
+  };
+  static_assert(sizeof(phaseNames) / sizeof(phaseNames[0]) == static_cast<std::size_t>(TimingPhase::COUNT),
+		"missing phase name");
+
+  Timings::Timings() : _marks(), _set(0) {
+  }
+
+  /**
+   * @brief Forget the previous request and mark the start.
+   */
+  auto Timings::start() -> void {
+    _set = 0;
+    mark(TimingPhase::START);
+  }
+
+  /**
+   * @brief Mark the end of a phase (now).
+   * @param phase The phase.
+   */
+  auto Timings::mark(TimingPhase phase) -> void {
+    std::size_t i = static_cast<std::size_t>(phase);
+    _marks[i] = clock::now();
+    _set |= 1u << i;
+  }
+
+  /**
+   * @brief Test if a phase is marked.
+   * @param phase The phase.
+   * @return bool
+   */
+  auto Timings::has(TimingPhase phase) const -> bool {
+    return _set & (1u << static_cast<std::size_t>(phase));
+  }
+
+  /**
+   * @brief Get the timestamp of a phase.
+   * @param phase The phase (must be marked).
+   * @return clock::time_point
+   */
+  auto Timings::time(TimingPhase phase) const -> clock::time_point {
+    return _marks[static_cast<std::size_t>(phase)];
+  }
+
+  /**
+   * @brief Get the time of a phase since the start (cumulative, as curl does).
+   * @param phase The phase.
+   * @return The time in seconds, or the time of the previous marked phase if the phase was skipped.
+   */
+  auto Timings::at(TimingPhase phase) const -> double {
+    if(!has(TimingPhase::START)) return 0.0;
+    for(std::size_t i = static_cast<std::size_t>(phase); i > 0; --i)
+      if(_set & (1u << i))
+	return std::chrono::duration<double>(_marks[i] - _marks[0]).count();
+    return 0.0;
+  }
+
+  /**
+   * @brief Get the time spent in a phase (since the previous marked phase).
+   * @param phase The phase.
+   * @return The duration in seconds, 0 if the phase was skipped.
+   */
+  auto Timings::duration(TimingPhase phase) const -> double {
+    std::size_t i = static_cast<std::size_t>(phase);
+    if(i == 0 || !has(phase)) return 0.0;
+    std::size_t p = i - 1;
+    while(p > 0 && !(_set & (1u << p))) --p;
+    return std::chrono::duration<double>(_marks[i] - _marks[p]).count();
+  }
+
+  /**
+   * @brief Get the name of a phase.
+   * @param phase The phase.
+   * @return std::string_view
+   */
+  auto Timings::name(TimingPhase phase) -> std::string_view {
+    std::size_t i = static_cast<std::size_t>(phase);
+    return i < static_cast<std::size_t>(TimingPhase::COUNT) ? phaseNames[i] : std::string_view("unknown");
+  }
+
+} /* namespace net */
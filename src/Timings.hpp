@@ -0,0 +1,96 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#ifndef __TIMINGS_H__
+#define __TIMINGS_H__
+
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+namespace net {
+
+  /**
+   * @brief Phases of a request, in chronological order.
+   */
+  enum class TimingPhase : unsigned char {
+      START = 0,  /* connect called */
+      DNS,        /* name resolved */
+      CONNECT,    /* TCP connected */
+      TLS,        /* TLS handshake done */
+      WRITTEN,    /* request written */
+      FIRST_BYTE, /* first response byte received */
+      HEADERS,    /* response headers complete */
+      BODY,       /* response body complete */
+      DECOMPRESS, /* body decoded and decompressed */
+      COUNT
+  };
+
+  /**
+   * @brief Monotonic timestamps of the phases of one request.
+   */
+  class Timings {
+    public:
+      using clock = std::chrono::steady_clock;
+
+      Timings();
+
+      /**
+       * @brief Forget the previous request and mark the start.
+       */
+      auto start() -> void;
+
+      /**
+       * @brief Mark the end of a phase (now).
+       * @param phase The phase.
+       */
+      auto mark(TimingPhase phase) -> void;
+
+      /**
+       * @brief Test if a phase is marked.
+       * @param phase The phase.
+       * @return bool
+       */
+      auto has(TimingPhase phase) const -> bool;
+
+      /**
+       * @brief Get the timestamp of a phase.
+       * @param phase The phase (must be marked).
+       * @return clock::time_point
+       */
+      auto time(TimingPhase phase) const -> clock::time_point;
+
+      /**
+       * @brief Get the time of a phase since the start (cumulative, as curl does).
+       * @param phase The phase.
+       * @return The time in seconds, or the time of the previous marked phase if the phase was skipped.
+       */
+      auto at(TimingPhase phase) const -> double;
+
+      /**
+       * @brief Get the time spent in a phase (since the previous marked phase).
+       * @param phase The phase.
+       * @return The duration in seconds, 0 if the phase was skipped.
+       */
+      auto duration(TimingPhase phase) const -> double;
+
+      /**
+       * @brief Get the name of a phase.
+       * @param phase The phase.
+       * @return std::string_view
+       */
+      static auto name(TimingPhase phase) -> std::string_view;
+
+    private:
+      clock::time_point _marks[static_cast<std::size_t>(TimingPhase::COUNT)];
+      std::uint32_t _set;
+  };
+
+} /* namespace net */
+
+#endif /* __TIMINGS_H__ */
@@ -0,0 +1,161 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#include "Trace.hpp"
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+
+namespace net {
+
+  using clock = Timings::clock;
+
+  /**
+   * @brief One complete span.
+   */
+  struct TraceEvent {
+      std::int64_t start; /* ns since the trace epoch */
+      std::int64_t duration;
+      std::uint32_t request;
+      unsigned char span;
+  };
+
+  /**
+   * @brief Events of one thread, owned by the registry so that they outlive the thread.
+   */
+  struct TraceRing {
+      std::uint32_t track;
+      std::string name;
+      std::vector<TraceEvent> events;
+      std::size_t next;
+      std::uint64_t written;
+      std::uint32_t requests;
+  };
+
+  /* span names and the phases that end them, the span starts at the previous marked phase */
+  static const struct {
+      const char* name;
+      TimingPhase from;
+      TimingPhase to;
+  } spans[] = {
+    { "connect", TimingPhase::START, TimingPhase::CONNECT },
+    { "handshake", TimingPhase::CONNECT, TimingPhase::TLS },
+    { "write", TimingPhase::TLS, TimingPhase::WRITTEN },
+    { "wait", TimingPhase::WRITTEN, TimingPhase::FIRST_BYTE },
+    { "read", TimingPhase::FIRST_BYTE, TimingPhase::BODY },
+    { "decode", TimingPhase::BODY, TimingPhase::DECOMPRESS }
+  };
+
+  bool Trace::_enabled = false;
+  static std::size_t ringCapacity = TRACE_RING;
+  static const clock::time_point epoch = clock::now();
+  static std::mutex registryLock;
+  static std::vector<std::unique_ptr<TraceRing>> registry;
+  static std::uint32_t nextTrack = 0x10000;
+
+  /**
+   * @brief Get the ring of the calling thread (registered on the first call).
+   * @return TraceRing&
+   */
+  static auto ring() -> TraceRing& {
+    static thread_local TraceRing* r = nullptr;
+    if(!r) {
+      std::lock_guard<std::mutex> lock(registryLock);
+      registry.emplace_back(new TraceRing { nextTrack, "thread " + std::to_string(nextTrack - 0x10000), {}, 0, 0, 0 });
+      nextTrack++;
+      r = registry.back().get();
+      r->events.resize(ringCapacity);
+    }
+    return *r;
+  }
+
+  /**
+   * @brief Enable the tracing (before the first request).
+   * @param capacity The number of events kept per thread.
+   */
+  auto Trace::enable(std::size_t capacity) -> void {
+    ringCapacity = capacity ? capacity : 1;
+    _enabled = true;
+  }
+
+  /**
+   * @brief Name the track of the calling thread (one track per connection).
+   * @param id The track identifier.
+   * @param name The track name.
+   */
+  auto Trace::track(std::uint32_t id, const std::string& name) -> void {
+    if(!_enabled) return;
+    TraceRing& r = ring();
+    r.track = id;
+    r.name = name;
+  }
+
+  /**
+   * @brief Append the spans of a request from its phases timings.
+   * @param timings The timings of the request.
+   */
+  auto Trace::request(const Timings& timings) -> void {
+    if(!_enabled || !timings.has(TimingPhase::START)) return;
+    TraceRing& r = ring();
+    std::uint32_t request = r.requests++;
+    for(const auto& s : spans) {
+      if(!timings.has(s.to)) continue;
+      /* the span starts where the previous marked phase ended (no TLS: write starts at connect) */
+      std::size_t from = static_cast<std::size_t>(s.from);
+      while(from > 0 && !timings.has(static_cast<TimingPhase>(from))) --from;
+      clock::time_point begin = timings.time(static_cast<TimingPhase>(from));
+      clock::time_point end = timings.time(s.to);
+      TraceEvent& e = r.events[r.next];
+      e.start = std::chrono::duration_cast<std::chrono::nanoseconds>(begin - epoch).count();
+      e.duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+      e.request = request;
+      e.span = static_cast<unsigned char>(&s - spans);
+      r.next = (r.next + 1) % r.events.size();
+      r.written++;
+    }
+  }
+
+  /**
+   * @brief Write all the rings with the trace-event JSON format.
+   * Must be called once the traced threads are done.
+   * @param path The output file.
+   * @return false if the file cannot be written.
+   */
+  auto Trace::write(const std::string& path) -> bool {
+    std::ofstream os(path);
+    if(!os.is_open()) return false;
+    std::lock_guard<std::mutex> lock(registryLock);
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::endl;
+    os << std::fixed << std::setprecision(3);
+    bool first = true;
+    for(const std::unique_ptr<TraceRing>& r : registry) {
+      os << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << r->track
+	 << ",\"args\":{\"name\":\"" << r->name << "\"}}";
+      first = false;
+      std::size_t count = std::min<std::uint64_t>(r->written, r->events.size());
+      /* oldest first */
+      std::size_t start = r->written > r->events.size() ? r->next : 0;
+      for(std::size_t i = 0; i < count; ++i) {
+	const TraceEvent& e = r->events[(start + i) % r->events.size()];
+	os << ",\n{\"name\":\"" << spans[e.span].name << "\",\"cat\":\"http\",\"ph\":\"X\",\"ts\":" << e.start / 1e3
+	   << ",\"dur\":" << e.duration / 1e3 << ",\"pid\":1,\"tid\":" << r->track
+	   << ",\"args\":{\"request\":" << e.request << "}}";
+      }
+      if(r->written > r->events.size())
+	os << ",\n{\"name\":\"dropped\",\"ph\":\"i\",\"s\":\"t\",\"ts\":0,\"pid\":1,\"tid\":" << r->track
+	   << ",\"args\":{\"events\":" << (r->written - r->events.size()) << "}}";
+    }
+    os << "\n]}" << std::endl;
+    return os.good();
+  }
+
+} /* namespace net */
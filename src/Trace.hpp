@@ -0,0 +1,72 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include "Timings.hpp"
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+namespace net {
+
+  /* events kept per thread, the oldest are overwritten */
+  constexpr std::size_t TRACE_RING = 0x10000;
+
+  /**
+   * @brief Chrome/Perfetto trace-event timeline of the requests.
+   * Each thread appends the spans of its requests (connect, handshake, write, wait, read, decode)
+   * to its own ring buffer without locks; the rings are written out once the threads are done.
+   */
+  class Trace {
+    public:
+      Trace() = delete;
+
+      /**
+       * @brief Enable the tracing (before the first request).
+       * @param capacity The number of events kept per thread.
+       */
+      static auto enable(std::size_t capacity = TRACE_RING) -> void;
+
+      /**
+       * @brief Test if the tracing is enabled.
+       * @return bool
+       */
+      static auto enabled() -> bool {
+	return _enabled;
+      }
+
+      /**
+       * @brief Name the track of the calling thread (one track per connection).
+       * @param id The track identifier.
+       * @param name The track name.
+       */
+      static auto track(std::uint32_t id, const std::string& name) -> void;
+
+      /**
+       * @brief Append the spans of a request from its phases timings.
+       * @param timings The timings of the request.
+       */
+      static auto request(const Timings& timings) -> void;
+
+      /**
+       * @brief Write all the rings with the trace-event JSON format.
+       * Must be called once the traced threads are done.
+       * @param path The output file.
+       * @return false if the file cannot be written.
+       */
+      static auto write(const std::string& path) -> bool;
+
+    private:
+      static bool _enabled;
+  };
+
+} /* namespace net */
+
+#endif /* __TRACE_H__ */
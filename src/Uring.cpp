@@ -0,0 +1,500 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#include "Uring.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace net {
+
+  enum UringOp : std::uint64_t {
+    OP_CONNECT = 1,
+    OP_SEND,
+    OP_RECV,
+    OP_CANCEL
+  };
+
+  static inline auto userData(int slot, UringOp op) -> std::uint64_t {
+    return (static_cast<std::uint64_t>(slot) << 8) | op;
+  }
+
+  Uring::Uring() : _fd(-1), _ok(false), _multishot(true), _enters(0), _toSubmit(0), _tail(0), _ring(MAP_FAILED),
+		   _ringSize(0), _sqes(nullptr), _sqesSize(0), _sqHead(nullptr), _sqTail(nullptr), _sqMask(0),
+		   _sqArray(nullptr), _cqHead(nullptr), _cqTail(nullptr), _cqMask(0), _cqes(nullptr), _bufRing(nullptr),
+		   _recvBuffers(nullptr), _sendBuffers(nullptr), _bufTail(0), _slots() {
+    _ok = setup();
+  }
+
+  Uring::~Uring() {
+    /* closing the ring releases the files and the buffers registrations */
+    if(_fd != -1) close(_fd);
+    if(_ring != MAP_FAILED) munmap(_ring, _ringSize);
+    if(_sqes != nullptr) munmap(_sqes, _sqesSize);
+    if(_bufRing != nullptr) munmap(_bufRing, URING_RECV_BUFFERS * sizeof(struct io_uring_buf));
+    if(_recvBuffers != nullptr) munmap(_recvBuffers, URING_RECV_BUFFERS * URING_RECV_SIZE);
+    if(_sendBuffers != nullptr) munmap(_sendBuffers, URING_FILES * URING_SEND_SIZE);
+  }
+
+  /**
+   * @brief Test if the kernel supports everything needed (the ring of the calling thread is set up).
+   * @return bool
+   */
+  auto Uring::available() -> bool {
+    return thread().ok();
+  }
+
+  /**
+   * @brief Get the ring of the calling thread (set up on first use).
+   * @return Uring&
+   */
+  auto Uring::thread() -> Uring& {
+    static thread_local Uring ring;
+    return ring;
+  }
+
+  /**
+   * @brief Test if the ring is usable.
+   * @return bool
+   */
+  auto Uring::ok() const -> bool {
+    return _ok;
+  }
+
+  /**
+   * @brief Get the number of io_uring_enter calls.
+   * @return std::uint64_t
+   */
+  auto Uring::enters() const -> std::uint64_t {
+    return _enters;
+  }
+
+  /**
+   * @brief Set up the ring, the fixed files, the registered and the provided buffers.
+   * @return false if the kernel lacks a feature.
+   */
+  auto Uring::setup() -> bool {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    /* one thread submits and the completions are posted on its next kernel entry */
+    p.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+    _fd = static_cast<int>(::syscall(__NR_io_uring_setup, URING_ENTRIES, &p));
+    if(_fd < 0 && errno == EINVAL) {
+      memset(&p, 0, sizeof(p));
+      _fd = static_cast<int>(::syscall(__NR_io_uring_setup, URING_ENTRIES, &p));
+    }
+    if(_fd < 0) return false;
+    if(!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_FAST_POLL)) return false;
+
+    _ringSize = std::max<std::size_t>(p.sq_off.array + p.sq_entries * sizeof(unsigned),
+				      p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe));
+    _ring = mmap(nullptr, _ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+    if(_ring == MAP_FAILED) return false;
+    _sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+    if(sqes == MAP_FAILED) return false;
+    _sqes = static_cast<struct io_uring_sqe*>(sqes);
+    char* ring = static_cast<char*>(_ring);
+    _sqHead = reinterpret_cast<unsigned*>(ring + p.sq_off.head);
+    _sqTail = reinterpret_cast<unsigned*>(ring + p.sq_off.tail);
+    _sqMask = *reinterpret_cast<unsigned*>(ring + p.sq_off.ring_mask);
+    _sqArray = reinterpret_cast<unsigned*>(ring + p.sq_off.array);
+    _cqHead = reinterpret_cast<unsigned*>(ring + p.cq_off.head);
+    _cqTail = reinterpret_cast<unsigned*>(ring + p.cq_off.tail);
+    _cqMask = *reinterpret_cast<unsigned*>(ring + p.cq_off.ring_mask);
+    _cqes = reinterpret_cast<struct io_uring_cqe*>(ring + p.cq_off.cqes);
+    _tail = *_sqTail;
+
+    /* sparse fixed files table */
+    int fds[URING_FILES];
+    std::fill(std::begin(fds), std::end(fds), -1);
+    if(::syscall(__NR_io_uring_register, _fd, IORING_REGISTER_FILES, fds, URING_FILES) < 0) return false;
+
+    /* one registered send buffer per fixed file */
+    void* send = mmap(nullptr, URING_FILES * URING_SEND_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(send == MAP_FAILED) return false;
+    _sendBuffers = static_cast<char*>(send);
+    struct iovec iov[URING_FILES];
+    for(unsigned int i = 0; i < URING_FILES; ++i)
+      iov[i] = { _sendBuffers + i * URING_SEND_SIZE, URING_SEND_SIZE };
+    if(::syscall(__NR_io_uring_register, _fd, IORING_REGISTER_BUFFERS, iov, URING_FILES) < 0) return false;
+
+    /* the provided buffer ring (group 0) of the receptions */
+    void* recv = mmap(nullptr, URING_RECV_BUFFERS * URING_RECV_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(recv == MAP_FAILED) return false;
+    _recvBuffers = static_cast<char*>(recv);
+    void* bufRing = mmap(nullptr, URING_RECV_BUFFERS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(bufRing == MAP_FAILED) return false;
+    _bufRing = static_cast<struct io_uring_buf_ring*>(bufRing);
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<std::uint64_t>(_bufRing);
+    reg.ring_entries = URING_RECV_BUFFERS;
+    reg.bgid = 0;
+    if(::syscall(__NR_io_uring_register, _fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) return false;
+    for(unsigned int bid = 0; bid < URING_RECV_BUFFERS; ++bid)
+      recycle(static_cast<std::uint16_t>(bid));
+    return true;
+  }
+
+  /**
+   * @brief Get a free submission queue entry (cleared).
+   * @return io_uring_sqe*
+   */
+  auto Uring::sqe() -> io_uring_sqe* {
+    if(_tail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE) > _sqMask)
+      enter(0);
+    unsigned int index = _tail & _sqMask;
+    struct io_uring_sqe* e = &_sqes[index];
+    memset(e, 0, sizeof(*e));
+    _sqArray[index] = index;
+    _tail++;
+    _toSubmit++;
+    return e;
+  }
+
+  /**
+   * @brief Submit the queued entries and wait for some completions.
+   * @param wait The number of completions to wait for.
+   * @return 0 or -errno.
+   */
+  auto Uring::enter(unsigned int wait) -> int {
+    __atomic_store_n(_sqTail, _tail, __ATOMIC_RELEASE);
+    for(;;) {
+      _enters++;
+      long r = ::syscall(__NR_io_uring_enter, _fd, _toSubmit, wait, wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+      if(r >= 0) {
+	_toSubmit -= std::min<unsigned int>(static_cast<unsigned int>(r), _toSubmit);
+	if(!_toSubmit || wait) return 0;
+	continue;
+      }
+      if(errno == EINTR) continue;
+      /* the completion queue is full */
+      if(errno == EBUSY || errno == EAGAIN) {
+	reap();
+	continue;
+      }
+      return -errno;
+    }
+  }
+
+  /**
+   * @brief Process the completions.
+   */
+  auto Uring::reap() -> void {
+    unsigned int head = *_cqHead;
+    unsigned int tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+    for(; head != tail; ++head) {
+      const struct io_uring_cqe& cqe = _cqes[head & _cqMask];
+      Slot& s = _slots[cqe.user_data >> 8];
+      switch(cqe.user_data & 0xff) {
+	case OP_CONNECT:
+	case OP_SEND:
+	case OP_CANCEL:
+	  /* the first error of a linked submission is kept */
+	  if(s.result >= 0 || (cqe.user_data & 0xff) == OP_CANCEL) s.result = cqe.res;
+	  if(s.waiting) s.waiting--;
+	  break;
+	case OP_RECV:
+	  if(!(cqe.flags & IORING_CQE_F_MORE)) s.armed = false;
+	  if(cqe.res > 0 && (cqe.flags & IORING_CQE_F_BUFFER))
+	    s.chunks.push_back({ static_cast<std::uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT), static_cast<std::uint32_t>(cqe.res) });
+	  else if(cqe.res == 0)
+	    s.eof = true;
+	  else if(cqe.res == -EINVAL && _multishot)
+	    /* kernel without multishot receive, one receive per wait from now on */
+	    _multishot = false;
+	  else if(cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED)
+	    s.error = cqe.res;
+	  break;
+      }
+    }
+    __atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+  }
+
+  /**
+   * @brief Give a receive buffer back to the kernel.
+   * @param bid The buffer id.
+   */
+  auto Uring::recycle(std::uint16_t bid) -> void {
+    /* not _bufRing->bufs, the flexible array of the kernel header is shifted in C++ */
+    struct io_uring_buf* b = reinterpret_cast<struct io_uring_buf*>(_bufRing) + (_bufTail & (URING_RECV_BUFFERS - 1));
+    b->addr = reinterpret_cast<std::uint64_t>(_recvBuffers + bid * URING_RECV_SIZE);
+    b->len = URING_RECV_SIZE;
+    b->bid = bid;
+    _bufTail++;
+    __atomic_store_n(&_bufRing->tail, _bufTail, __ATOMIC_RELEASE);
+  }
+
+  /**
+   * @brief Queue the receive of a slot.
+   * @param slot The slot.
+   */
+  auto Uring::arm(int slot) -> void {
+    struct io_uring_sqe* e = sqe();
+    e->opcode = IORING_OP_RECV;
+    e->fd = slot;
+    e->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+    e->buf_group = 0;
+    e->ioprio = _multishot ? IORING_RECV_MULTISHOT : 0;
+    e->user_data = userData(slot, OP_RECV);
+    _slots[slot].armed = true;
+  }
+
+  /**
+   * @brief Wait for the completions of the operations of a slot.
+   * @param slot The slot.
+   * @return The result of the last one.
+   */
+  auto Uring::complete(int slot) -> int {
+    Slot& s = _slots[slot];
+    while(s.waiting) {
+      int r = enter(s.waiting);
+      if(r < 0) return r;
+      reap();
+    }
+    return s.result;
+  }
+
+  /**
+   * @brief Register a socket as a fixed file.
+   * @param fd The socket.
+   * @return The slot or -errno.
+   */
+  auto Uring::attach(int fd) -> int {
+    int slot = 0;
+    while(slot < static_cast<int>(URING_FILES) && _slots[slot].used) ++slot;
+    if(slot == static_cast<int>(URING_FILES)) return -EMFILE;
+    struct io_uring_files_update update;
+    memset(&update, 0, sizeof(update));
+    update.offset = slot;
+    update.fds = reinterpret_cast<std::uint64_t>(&fd);
+    if(::syscall(__NR_io_uring_register, _fd, IORING_REGISTER_FILES_UPDATE, &update, 1) < 0) return -errno;
+    Slot& s = _slots[slot];
+    s.used = true;
+    s.armed = s.eof = false;
+    s.error = s.result = 0;
+    s.waiting = 0;
+    s.offset = 0;
+    s.chunks.clear();
+    return slot;
+  }
+
+  /**
+   * @brief Stop the reception of a slot, give its buffers back and unregister the file.
+   * @param slot The slot.
+   */
+  auto Uring::detach(int slot) -> void {
+    Slot& s = _slots[slot];
+    if(s.armed) {
+      struct io_uring_sqe* e = sqe();
+      e->opcode = IORING_OP_ASYNC_CANCEL;
+      e->addr = userData(slot, OP_RECV);
+      e->user_data = userData(slot, OP_CANCEL);
+      s.waiting++;
+      /* the receive ends with -ECANCELED (or the data received meanwhile) */
+      while(s.waiting || s.armed) {
+	if(enter(1) < 0) break;
+	reap();
+      }
+    }
+    for(; !s.chunks.empty(); s.chunks.pop_front()) recycle(s.chunks.front().bid);
+    int fd = -1;
+    struct io_uring_files_update update;
+    memset(&update, 0, sizeof(update));
+    update.offset = slot;
+    update.fds = reinterpret_cast<std::uint64_t>(&fd);
+    ::syscall(__NR_io_uring_register, _fd, IORING_REGISTER_FILES_UPDATE, &update, 1);
+    s.used = false;
+  }
+
+  /**
+   * @brief Connect and send the first bytes (TLS ClientHello) in one submission.
+   * @param slot The slot.
+   * @param address The remote address.
+   * @param length The address length.
+   * @param first The first bytes (may be empty, at most URING_SEND_SIZE).
+   * @return 0 or -errno.
+   */
+  auto Uring::connect(int slot, const struct sockaddr* address, socklen_t length, std::string_view first) -> int {
+    Slot& s = _slots[slot];
+    first = first.substr(0, URING_SEND_SIZE);
+    s.result = 0;
+    struct io_uring_sqe* e = sqe();
+    e->opcode = IORING_OP_CONNECT;
+    e->fd = slot;
+    e->flags = IOSQE_FIXED_FILE | (first.empty() ? 0 : IOSQE_IO_LINK);
+    e->addr = reinterpret_cast<std::uint64_t>(address);
+    e->off = length;
+    e->user_data = userData(slot, OP_CONNECT);
+    s.waiting++;
+    std::size_t sent = 0;
+    if(!first.empty()) {
+      char* buffer = _sendBuffers + slot * URING_SEND_SIZE;
+      memcpy(buffer, first.data(), first.size());
+      e = sqe();
+      e->opcode = IORING_OP_WRITE_FIXED;
+      e->fd = slot;
+      e->flags = IOSQE_FIXED_FILE;
+      e->addr = reinterpret_cast<std::uint64_t>(buffer);
+      e->len = static_cast<std::uint32_t>(first.size());
+      e->buf_index = static_cast<std::uint16_t>(slot);
+      e->user_data = userData(slot, OP_SEND);
+      s.waiting++;
+    }
+    int r = complete(slot);
+    if(r < 0) return r;
+    if(!first.empty()) sent = static_cast<std::size_t>(r);
+    /* short write */
+    struct iovec rest = { const_cast<char*>(first.data()) + sent, first.size() - sent };
+    return sent < first.size() ? send(slot, &rest, 1) : 0;
+  }
+
+  /**
+   * @brief Send the data through the registered buffer of the slot, the parts are gathered
+   * so that they leave in as few submissions as possible.
+   * @param slot The slot.
+   * @param iov The parts.
+   * @param count The number of parts.
+   * @return 0 or -errno.
+   */
+  auto Uring::send(int slot, const struct iovec* iov, int count) -> int {
+    Slot& s = _slots[slot];
+    char* buffer = _sendBuffers + slot * URING_SEND_SIZE;
+    int part = 0;
+    std::size_t offset = 0;
+    while(part < count) {
+      /* gather as much as the registered buffer holds */
+      std::size_t size = 0;
+      while(part < count && size < URING_SEND_SIZE) {
+	std::size_t n = std::min(iov[part].iov_len - offset, URING_SEND_SIZE - size);
+	memcpy(buffer + size, static_cast<const char*>(iov[part].iov_base) + offset, n);
+	size += n;
+	offset += n;
+	if(offset == iov[part].iov_len) {
+	  ++part;
+	  offset = 0;
+	}
+      }
+      std::size_t done = 0;
+      while(done < size) {
+	struct io_uring_sqe* e = sqe();
+	e->opcode = IORING_OP_WRITE_FIXED;
+	e->fd = slot;
+	e->flags = IOSQE_FIXED_FILE;
+	e->addr = reinterpret_cast<std::uint64_t>(buffer + done);
+	e->len = static_cast<std::uint32_t>(size - done);
+	e->buf_index = static_cast<std::uint16_t>(slot);
+	e->user_data = userData(slot, OP_SEND);
+	s.waiting++;
+	s.result = 0;
+	int r = complete(slot);
+	if(r < 0) return r;
+	if(r == 0) return -EPIPE;
+	done += static_cast<std::size_t>(r);
+      }
+    }
+    return 0;
+  }
+
+  /**
+   * @brief Wait until some data (or the end of the stream) is pending.
+   * @param slot The slot.
+   * @return 0 or -errno.
+   */
+  auto Uring::wait(int slot) -> int {
+    Slot& s = _slots[slot];
+    /* the receive is queued with the wait, in the same system call */
+    while(s.chunks.empty() && !s.eof && !s.error) {
+      if(!s.armed) arm(slot);
+      int r = enter(1);
+      if(r < 0) return r;
+      reap();
+    }
+    return s.chunks.empty() ? s.error : 0;
+  }
+
+  /**
+   * @brief Test without waiting if some data, the end of the stream or an error is pending.
+   * @param slot The slot.
+   * @return bool
+   */
+  auto Uring::ready(int slot) -> bool {
+    Slot& s = _slots[slot];
+    reap();
+    return !s.chunks.empty() || s.eof || s.error;
+  }
+
+  /**
+   * @brief Get the pending received data without copy, wait if there is none.
+   * @param slot The slot.
+   * @param data The data (empty at the end of the stream), valid until consume.
+   * @return 0 or -errno.
+   */
+  auto Uring::pending(int slot, std::string_view& data) -> int {
+    Slot& s = _slots[slot];
+    /* without any system call while the multishot receive has data queued */
+    if(s.chunks.empty()) reap();
+    int r = wait(slot);
+    if(r < 0) return r;
+    if(s.chunks.empty())
+      data = std::string_view();
+    else {
+      const Chunk& c = s.chunks.front();
+      data = std::string_view(_recvBuffers + c.bid * URING_RECV_SIZE + s.offset, c.length - s.offset);
+    }
+    return 0;
+  }
+
+  /**
+   * @brief Consume the pending received data.
+   * @param slot The slot.
+   * @param size The number of bytes (at most the size returned by pending).
+   */
+  auto Uring::consume(int slot, std::size_t size) -> void {
+    Slot& s = _slots[slot];
+    s.offset += size;
+    if(!s.chunks.empty() && s.offset >= s.chunks.front().length) {
+      recycle(s.chunks.front().bid);
+      s.chunks.pop_front();
+      s.offset = 0;
+    }
+  }
+
+  /**
+   * @brief Read the pending data, wait if there is none.
+   * @param slot The slot.
+   * @param buffer The buffer.
+   * @param size The buffer size.
+   * @return The number of bytes, 0 at the end of the stream or -errno.
+   */
+  auto Uring::recv(int slot, char* buffer, std::size_t size) -> ssize_t {
+    std::string_view data;
+    int r = pending(slot, data);
+    if(r < 0) return r;
+    std::size_t reads = 0;
+    /* all the queued chunks, without waiting for more */
+    while(reads < size && !data.empty()) {
+      std::size_t n = std::min(size - reads, data.size());
+      memcpy(buffer + reads, data.data(), n);
+      reads += n;
+      consume(slot, n);
+      Slot& s = _slots[slot];
+      data = s.chunks.empty() ? std::string_view()
+	: std::string_view(_recvBuffers + s.chunks.front().bid * URING_RECV_SIZE + s.offset, s.chunks.front().length - s.offset);
+    }
+    return static_cast<ssize_t>(reads);
+  }
+
+} /* namespace net */
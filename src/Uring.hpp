@@ -0,0 +1,241 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#ifndef __URING_H__
+#define __URING_H__
+
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+namespace net {
+
+  /* submission queue entries of a ring */
+  constexpr unsigned int URING_ENTRIES = 64;
+  /* fixed files (open connections) of a ring */
+  constexpr unsigned int URING_FILES = 8;
+  /* registered send buffer of each fixed file */
+  constexpr std::size_t URING_SEND_SIZE = 0x4000;
+  /* provided receive buffers shared by the connections (power of 2) */
+  constexpr unsigned int URING_RECV_BUFFERS = 32;
+  constexpr std::size_t URING_RECV_SIZE = 0x4000;
+
+  /**
+   * @brief Per-thread io_uring, used through raw system calls.
+   * The sockets are fixed files, the sends use registered buffers (WRITE_FIXED) and the
+   * receptions are multishot receives into a provided buffer ring, so the reads only enter
+   * the kernel when no received data is pending. The methods return -errno on error.
+   */
+  class Uring {
+    public:
+      Uring();
+      ~Uring();
+      Uring(const Uring&) = delete;
+      Uring& operator=(const Uring&) = delete;
+
+      /**
+       * @brief Test if the kernel supports everything needed (the ring of the calling thread is set up).
+       * @return bool
+       */
+      static auto available() -> bool;
+
+      /**
+       * @brief Get the ring of the calling thread (set up on first use).
+       * @return Uring&
+       */
+      static auto thread() -> Uring&;
+
+      /**
+       * @brief Test if the ring is usable.
+       * @return bool
+       */
+      auto ok() const -> bool;
+
+      /**
+       * @brief Register a socket as a fixed file.
+       * @param fd The socket.
+       * @return The slot or -errno.
+       */
+      auto attach(int fd) -> int;
+
+      /**
+       * @brief Stop the reception of a slot, give its buffers back and unregister the file.
+       * @param slot The slot.
+       */
+      auto detach(int slot) -> void;
+
+      /**
+       * @brief Connect and send the first bytes (TLS ClientHello) in one submission.
+       * @param slot The slot.
+       * @param address The remote address.
+       * @param length The address length.
+       * @param first The first bytes (may be empty, at most URING_SEND_SIZE).
+       * @return 0 or -errno.
+       */
+      auto connect(int slot, const struct sockaddr* address, socklen_t length, std::string_view first) -> int;
+
+      /**
+       * @brief Send the data through the registered buffer of the slot, the parts are gathered
+       * so that they leave in as few submissions as possible.
+       * @param slot The slot.
+       * @param iov The parts.
+       * @param count The number of parts.
+       * @return 0 or -errno.
+       */
+      auto send(int slot, const struct iovec* iov, int count) -> int;
+
+      /**
+       * @brief Wait until some data (or the end of the stream) is pending.
+       * @param slot The slot.
+       * @return 0 or -errno.
+       */
+      auto wait(int slot) -> int;
+
+      /**
+       * @brief Test without waiting if some data, the end of the stream or an error is pending.
+       * @param slot The slot.
+       * @return bool
+       */
+      auto ready(int slot) -> bool;
+
+      /**
+       * @brief Read the pending data, wait if there is none.
+       * @param slot The slot.
+       * @param buffer The buffer.
+       * @param size The buffer size.
+       * @return The number of bytes, 0 at the end of the stream or -errno.
+       */
+      auto recv(int slot, char* buffer, std::size_t size) -> ssize_t;
+
+      /**
+       * @brief Get the pending received data without copy, wait if there is none.
+       * @param slot The slot.
+       * @param data The data (empty at the end of the stream), valid until consume.
+       * @return 0 or -errno.
+       */
+      auto pending(int slot, std::string_view& data) -> int;
+
+      /**
+       * @brief Consume the pending received data.
+       * @param slot The slot.
+       * @param size The number of bytes (at most the size returned by pending).
+       */
+      auto consume(int slot, std::size_t size) -> void;
+
+      /**
+       * @brief Get the number of io_uring_enter calls.
+       * @return std::uint64_t
+       */
+      auto enters() const -> std::uint64_t;
+
+    private:
+      struct Chunk {
+	  std::uint16_t bid;
+	  std::uint32_t length;
+      };
+      /**
+       * @brief Received chunks of a slot, in a fixed ring (a slot never holds more than all the buffers).
+       */
+      struct ChunkQueue {
+	  Chunk items[URING_RECV_BUFFERS];
+	  unsigned int first;
+	  unsigned int count;
+	  auto empty() const -> bool { return count == 0; }
+	  auto front() const -> const Chunk& { return items[first]; }
+	  auto push_back(const Chunk& c) -> void { items[(first + count++) % URING_RECV_BUFFERS] = c; }
+	  auto pop_front() -> void { first = (first + 1) % URING_RECV_BUFFERS; count--; }
+	  auto clear() -> void { first = count = 0; }
+      };
+      struct Slot {
+	  bool used;
+	  bool armed;
+	  bool eof;
+	  int error;
+	  int result;
+	  unsigned int waiting;
+	  std::size_t offset;
+	  ChunkQueue chunks;
+      };
+      int _fd;
+      bool _ok;
+      bool _multishot;
+      std::uint64_t _enters;
+      unsigned int _toSubmit;
+      unsigned int _tail;
+      void* _ring;
+      std::size_t _ringSize;
+      io_uring_sqe* _sqes;
+      std::size_t _sqesSize;
+      unsigned* _sqHead;
+      unsigned* _sqTail;
+      unsigned _sqMask;
+      unsigned* _sqArray;
+      unsigned* _cqHead;
+      unsigned* _cqTail;
+      unsigned _cqMask;
+      io_uring_cqe* _cqes;
+      io_uring_buf_ring* _bufRing;
+      char* _recvBuffers;
+      char* _sendBuffers;
+      unsigned short _bufTail;
+      Slot _slots[URING_FILES];
+
+      /**
+       * @brief Set up the ring, the fixed files, the registered and the provided buffers.
+       * @return false if the kernel lacks a feature.
+       */
+      auto setup() -> bool;
+
+      /**
+       * @brief Get a free submission queue entry (cleared).
+       * @return io_uring_sqe*
+       */
+      auto sqe() -> io_uring_sqe*;
+
+      /**
+       * @brief Submit the queued entries and wait for some completions.
+       * @param wait The number of completions to wait for.
+       * @return 0 or -errno.
+       */
+      auto enter(unsigned int wait) -> int;
+
+      /**
+       * @brief Process the completions.
+       */
+      auto reap() -> void;
+
+      /**
+       * @brief Queue the receive of a slot.
+       * @param slot The slot.
+       */
+      auto arm(int slot) -> void;
+
+      /**
+       * @brief Give a receive buffer back to the kernel.
+       * @param bid The buffer id.
+       */
+      auto recycle(std::uint16_t bid) -> void;
+
+      /**
+       * @brief Wait for the completions of the operations of a slot.
+       * @param slot The slot.
+       * @return The result of the last one.
+       */
+      auto complete(int slot) -> int;
+  };
+
+} /* namespace net */
+
+#endif /* __URING_H__ */
@@ -0,0 +1,111 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#include "Bench.hpp"
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <new>
+#include <cstdlib>
+
+static std::atomic<std::size_t> benchAllocations(0);
+
+auto operator new(std::size_t size) -> void* {
+  benchAllocations.fetch_add(1, std::memory_order_relaxed);
+  if(void* p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+auto operator new[](std::size_t size) -> void* {
+  return operator new(size);
+}
+
+auto operator delete(void* p) noexcept -> void {
+  std::free(p);
+}
+
+auto operator delete[](void* p) noexcept -> void {
+  std::free(p);
+}
+
+auto operator delete(void* p, std::size_t) noexcept -> void {
+  std::free(p);
+}
+
+auto operator delete[](void* p, std::size_t) noexcept -> void {
+  std::free(p);
+}
+
+namespace bench {
+
+  using clock = std::chrono::steady_clock;
+
+  Bench::Bench(std::ostream& os, double minTimeMs, const std::string& filter) : _os(os), _minTimeMs(minTimeMs),
+									      _filter(filter), _header(false) {
+  }
+
+  /**
+   * @brief Test if a benchmark or a group of benchmarks is selected by the filter.
+   * @param name The benchmark name or a prefix of it.
+   * @return bool
+   */
+  auto Bench::enabled(const std::string& name) const -> bool {
+    return _filter.empty() || name.find(_filter) != std::string::npos || _filter.find(name) != std::string::npos;
+  }
+
+  /**
+   * @brief Get the number of allocations done since the start of the process.
+   * @return std::size_t
+   */
+  auto Bench::allocations() -> std::size_t {
+    return benchAllocations.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Run a benchmark.
+   * @param name The benchmark name.
+   * @param bytes The number of bytes processed by one operation (0 if meaningless).
+   * @param op The operation.
+   * @return The result.
+   */
+  auto Bench::run(const std::string& name, std::size_t bytes, const std::function<void()>& op) -> BenchResult {
+    BenchResult r = { name, 0, 0.0, 0.0, 0.0 };
+    if(!_filter.empty() && name.find(_filter) == std::string::npos) return r;
+    if(!_header) {
+      _header = true;
+      _os << std::left << std::setw(40) << "benchmark" << std::right << std::setw(12) << "iterations"
+	  << std::setw(14) << "ns/op" << std::setw(12) << "MB/s" << std::setw(12) << "allocs/op" << std::endl;
+    }
+    /* warm up (and steady state for the arenas) */
+    op();
+    std::size_t n = 1;
+    double elapsed = 0.0;
+    std::size_t allocs = 0;
+    for(;;) {
+      std::size_t a = allocations();
+      clock::time_point start = clock::now();
+      for(std::size_t i = 0; i < n; ++i) op();
+      elapsed = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+      allocs = allocations() - a;
+      if(elapsed >= _minTimeMs) break;
+      /* aim a bit over the minimum time */
+      std::size_t next = elapsed > 0.0 ? static_cast<std::size_t>(n * _minTimeMs * 1.2 / elapsed) : n * 10;
+      n = next > n ? (next < n * 100 ? next : n * 100) : n * 2;
+    }
+    r.iterations = n;
+    r.nsPerOp = elapsed * 1e6 / n;
+    r.bytesPerSec = bytes ? (bytes * n) / (elapsed / 1000.0) : 0.0;
+    r.allocsPerOp = static_cast<double>(allocs) / n;
+    _os << std::left << std::setw(40) << name << std::right << std::setw(12) << n
+	<< std::setw(14) << std::fixed << std::setprecision(1) << r.nsPerOp
+	<< std::setw(12) << std::setprecision(1) << (r.bytesPerSec / 1e6)
+	<< std::setw(12) << std::setprecision(2) << r.allocsPerOp << std::endl;
+    return r;
+  }
+
+} /* namespace bench */
@@ -0,0 +1,84 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <string>
+#include <functional>
+#include <ostream>
+#include <cstddef>
+
+namespace bench {
+
+  /**
+   * @brief Result of one benchmark.
+   */
+  struct BenchResult {
+      std::string name;
+      std::size_t iterations;
+      double nsPerOp;
+      double bytesPerSec;
+      double allocsPerOp;
+  };
+
+  /**
+   * @brief Micro-benchmark runner.
+   * Each benchmark is warmed up, then repeated until the minimum duration is reached.
+   * The allocations are counted by the global operator new of the bench binary.
+   */
+  class Bench {
+    public:
+      /**
+       * @param os The output stream.
+       * @param minTimeMs The minimum measured time of each benchmark.
+       * @param filter Only run the benchmarks containing this string.
+       */
+      Bench(std::ostream& os, double minTimeMs = 300.0, const std::string& filter = "");
+
+      /**
+       * @brief Run a benchmark.
+       * @param name The benchmark name.
+       * @param bytes The number of bytes processed by one operation (0 if meaningless).
+       * @param op The operation.
+       * @return The result.
+       */
+      auto run(const std::string& name, std::size_t bytes, const std::function<void()>& op) -> BenchResult;
+
+      /**
+       * @brief Test if a benchmark or a group of benchmarks is selected by the filter.
+       * @param name The benchmark name or a prefix of it.
+       * @return bool
+       */
+      auto enabled(const std::string& name) const -> bool;
+
+      /**
+       * @brief Get the number of allocations done since the start of the process.
+       * @return std::size_t
+       */
+      static auto allocations() -> std::size_t;
+
+    private:
+      std::ostream& _os;
+      double _minTimeMs;
+      std::string _filter;
+      bool _header;
+  };
+
+  /**
+   * @brief Prevent the compiler from removing a computation.
+   * @param p The value.
+   */
+  template<typename T>
+  inline auto keep(const T& p) -> void {
+    asm volatile("" : : "g"(&p) : "memory");
+  }
+
+} /* namespace bench */
+
+#endif /* __BENCH_H__ */
@@ -0,0 +1,100 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#include "EndToEnd.hpp"
+#include "HttpClient.hpp"
+#include "EasySocket.hpp"
+#include "Uring.hpp"
+#include "fixture/FixtureServer.hpp"
+#include <fstream>
+#include <iostream>
+
+namespace bench {
+
+  using net::http::HttpClient;
+  using net::http::HttpClientConnect;
+  using net::fixture::FixtureServer;
+  using net::fixture::FixtureConfig;
+
+  /**
+   * @brief Run one request scenario.
+   * @param b The runner.
+   * @param name The benchmark name.
+   * @param server The fixture server.
+   * @param path The fixture path.
+   * @param bytes The expected plain body size.
+   */
+  static auto scenario(Bench& b, const std::string& name, const FixtureServer& server, bool tls,
+		       const std::string& path, std::size_t bytes) -> void {
+    HttpClient client("httpu_bench");
+    std::ifstream noparams;
+    HttpClientConnect cnx;
+    cnx.host = server.host() + path;
+    cnx.method = "GET";
+    cnx.ssl = tls;
+    cnx.gzip = false;
+    cnx.is_params = &noparams;
+    cnx.urlencode = cnx.isform = false;
+    cnx.print_query = cnx.print_chunk = cnx.print_raw_resp = cnx.print_hex = false;
+    cnx.print_nothing = true;
+    cnx.memory_budget = 0;
+    /* a new connection for each request, the connect and the handshake are part of the measure */
+    cnx.keep_alive = false;
+    b.run(name, bytes, [&]() {
+	client.connect(cnx);
+	if(client.getPlainText().size() != bytes)
+	  throw net::http::HttpClientException(name + ": unexpected body size " + std::to_string(client.getPlainText().size()));
+      });
+  }
+
+  /**
+   * @brief Drive HttpClient against local FixtureServer instances (plain and TLS)
+   * to measure the whole client path: connect, TLS, EasySocket reads and the decoders.
+   * @param b The runner.
+   */
+  auto endToEnd(Bench& b) -> void {
+    if(!b.enabled("e2e/")) return;
+    FixtureConfig config;
+    FixtureServer plain(config);
+    config.tls = true;
+    FixtureServer tls(config);
+    try {
+      plain.start();
+      tls.start();
+    } catch(const std::exception& e) {
+      std::cerr << "e2e: " << e.what() << std::endl;
+      return;
+    }
+    net::EasySocket::loadSSL();
+    scenario(b, "e2e/http/length-1k", plain, false, "/length/1k", 1024);
+    scenario(b, "e2e/http/length-1m", plain, false, "/length/1m", 1 << 20);
+    scenario(b, "e2e/http/length-64m", plain, false, "/length/64m", 64 << 20);
+    scenario(b, "e2e/http/chunked-1m-8k", plain, false, "/chunked/1m/8k", 1 << 20);
+    scenario(b, "e2e/http/chunked-1m-256", plain, false, "/chunked/1m/256", 1 << 20);
+    scenario(b, "e2e/http/gzip-1m", plain, false, "/gzip/1m", 1 << 20);
+    scenario(b, "e2e/http/deflate-1m", plain, false, "/deflate/1m", 1 << 20);
+    scenario(b, "e2e/http/drip-4k-1k-1ms", plain, false, "/drip/4k/1k/1", 4096);
+    scenario(b, "e2e/https/length-1k", tls, true, "/length/1k", 1024);
+    scenario(b, "e2e/https/length-1m", tls, true, "/length/1m", 1 << 20);
+    scenario(b, "e2e/https/chunked-1m-8k", tls, true, "/chunked/1m/8k", 1 << 20);
+    scenario(b, "e2e/https/gzip-1m", tls, true, "/gzip/1m", 1 << 20);
+    if(net::Uring::available()) {
+      net::EasySocket::ioBackend(net::IoBackend::URING);
+      scenario(b, "e2e/uring/http/length-1k", plain, false, "/length/1k", 1024);
+      scenario(b, "e2e/uring/http/length-1m", plain, false, "/length/1m", 1 << 20);
+      scenario(b, "e2e/uring/http/length-64m", plain, false, "/length/64m", 64 << 20);
+      scenario(b, "e2e/uring/https/length-1k", tls, true, "/length/1k", 1024);
+      scenario(b, "e2e/uring/https/length-1m", tls, true, "/length/1m", 1 << 20);
+      net::EasySocket::ioBackend(net::IoBackend::SOCKET);
+    }
+    plain.stop();
+    tls.stop();
+    net::EasySocket::unloadSSL();
+  }
+
+} /* namespace bench */
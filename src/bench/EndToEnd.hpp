@@ -0,0 +1,25 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#ifndef __ENDTOEND_H__
+#define __ENDTOEND_H__
+
+#include "Bench.hpp"
+
+namespace bench {
+
+  /**
+   * @brief Drive HttpClient against local FixtureServer instances (plain and TLS)
+   * to measure the whole client path: connect, TLS, EasySocket reads and the decoders.
+   * @param b The runner.
+   */
+  auto endToEnd(Bench& b) -> void;
+
+} /* namespace bench */
+
+#endif /* __ENDTOEND_H__ */
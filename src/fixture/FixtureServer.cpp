@@ -0,0 +1,533 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#include "FixtureServer.hpp"
+#include "GZIP.hpp"
+#include <cstring>
+#include <charconv>
+#include <vector>
+#include <chrono>
+#include <csignal>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <openssl/err.h>
+#include <openssl/x509.h>
+#include <openssl/evp.h>
+#include <openssl/ec.h>
+
+namespace net {
+  namespace fixture {
+
+    using std::string;
+    using std::string_view;
+    using std::size_t;
+    using utils::GZIP;
+    using utils::GZIPMethod;
+
+    constexpr size_t PATTERN_SIZE = 0x10000;
+    constexpr size_t REQUEST_MAX = 0x10000;
+    constexpr size_t IO_BLOCK = 0x10000;
+
+    static inline auto throw_libc(const string& msg) -> void {
+      throw FixtureServerException(msg + strerror(errno));
+    }
+
+    /**
+     * @brief Get the reproducible pattern repeated by the bodies.
+     * @return The pattern (PATTERN_SIZE bytes).
+     */
+    static auto pattern() -> const string& {
+      static const string p = []() {
+	string s;
+	s.reserve(PATTERN_SIZE + 128);
+	for(size_t i = 0; s.size() < PATTERN_SIZE; ++i)
+	  s += "{\"id\":" + std::to_string(i) + ",\"name\":\"record-" + std::to_string(i) + "\",\"value\":"
+	    + std::to_string(i * 7919 % 104729) + ",\"active\":" + ((i & 1) ? "true" : "false") + "},\n";
+	s.resize(PATTERN_SIZE);
+	return s;
+      }();
+      return p;
+    }
+
+    /**
+     * @brief Parse a size with an optional k, m or g suffix.
+     * @param s The value.
+     * @param def The default value.
+     * @return The size.
+     */
+    auto FixtureServer::parseSize(string_view s, size_t def) -> size_t {
+      size_t v = 0;
+      auto r = std::from_chars(s.data(), s.data() + s.size(), v);
+      if(r.ec != std::errc() || r.ptr == s.data()) return def;
+      switch(r.ptr != s.data() + s.size() ? *r.ptr : 0) {
+	case 'k': case 'K': return v << 10;
+	case 'm': case 'M': return v << 20;
+	case 'g': case 'G': return v << 30;
+	default: return v;
+      }
+    }
+
+    static auto iequals(string_view a, string_view b) -> bool {
+      return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+    }
+
+    /**
+     * @brief One accepted connection, plain or TLS.
+     */
+    struct FixtureStream {
+	int fd;
+	SSL* ssl;
+
+	auto read(char* buffer, size_t length) -> ssize_t {
+	  if(ssl) {
+	    int r = SSL_read(ssl, buffer, static_cast<int>(length));
+	    return r > 0 ? r : (SSL_get_error(ssl, r) == SSL_ERROR_ZERO_RETURN ? 0 : -1);
+	  }
+	  ssize_t r;
+	  while((r = ::recv(fd, buffer, length, 0)) < 0 && errno == EINTR);
+	  return r;
+	}
+
+	auto write(const char* data, size_t length) -> bool {
+	  while(length) {
+	    ssize_t w;
+	    if(ssl) {
+	      int r = SSL_write(ssl, data, static_cast<int>(std::min(length, static_cast<size_t>(INT32_MAX))));
+	      w = r > 0 ? r : -1;
+	    } else {
+	      w = ::send(fd, data, length, MSG_NOSIGNAL);
+	      if(w < 0 && errno == EINTR) continue;
+	    }
+	    if(w <= 0) return false;
+	    data += w;
+	    length -= static_cast<size_t>(w);
+	  }
+	  return true;
+	}
+
+	auto write(string_view s) -> bool {
+	  return write(s.data(), s.size());
+	}
+
+	/**
+	 * @brief Write length bytes of the pattern from an offset.
+	 */
+	auto writePattern(size_t offset, size_t length) -> bool {
+	  const string& p = pattern();
+	  while(length) {
+	    size_t off = offset % PATTERN_SIZE;
+	    size_t n = std::min(length, std::min(PATTERN_SIZE - off, IO_BLOCK));
+	    if(!write(p.data() + off, n)) return false;
+	    offset += n;
+	    length -= n;
+	  }
+	  return true;
+	}
+    };
+
+    FixtureServer::FixtureServer(const FixtureConfig& config) : _config(config), _fd(-1), _wakeup{ -1, -1 }, _port(0),
+								_ctx(nullptr), _acceptor(), _lock(), _idle(), _clients(),
+								_encoded(), _requests(0), _running(false) {
+    }
+
+    FixtureServer::~FixtureServer() {
+      stop();
+    }
+
+    /**
+     * @brief Get the reproducible body of a given size (as sent in length mode).
+     * @param size The body size.
+     * @return std::string
+     */
+    auto FixtureServer::body(size_t size) -> string {
+      const string& p = pattern();
+      string s;
+      s.reserve(size);
+      while(s.size() < size)
+	s.append(p, 0, std::min(PATTERN_SIZE, size - s.size()));
+      return s;
+    }
+
+    /**
+     * @brief Get the bound TCP port.
+     * @return int
+     */
+    auto FixtureServer::port() const -> int {
+      return _port;
+    }
+
+    /**
+     * @brief Get the host value usable by the client (address:port/).
+     * @return std::string
+     */
+    auto FixtureServer::host() const -> string {
+      return _config.address + ":" + std::to_string(_port);
+    }
+
+    /**
+     * @brief Get the number of served requests.
+     * @return std::size_t
+     */
+    auto FixtureServer::requests() const -> size_t {
+      return _requests.load();
+    }
+
+    /**
+     * @brief Create the TLS context with a generated self-signed certificate.
+     */
+    auto FixtureServer::newContext() -> void {
+      _ctx = SSL_CTX_new(TLS_server_method());
+      EVP_PKEY* pkey = EVP_EC_gen("P-256");
+      X509* x509 = X509_new();
+      bool ok = _ctx && pkey && x509;
+      if(ok) {
+	X509_set_version(x509, 2);
+	ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+	X509_gmtime_adj(X509_getm_notBefore(x509), 0);
+	X509_gmtime_adj(X509_getm_notAfter(x509), 86400L * 365);
+	X509_set_pubkey(x509, pkey);
+	X509_NAME* name = X509_get_subject_name(x509);
+	X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+	X509_set_issuer_name(x509, name);
+	ok = X509_sign(x509, pkey, EVP_sha256()) > 0 && SSL_CTX_use_certificate(_ctx, x509) == 1
+	  && SSL_CTX_use_PrivateKey(_ctx, pkey) == 1;
+      }
+      X509_free(x509);
+      EVP_PKEY_free(pkey);
+      if(!ok) {
+	char buf[256];
+	ERR_error_string_n(ERR_get_error(), buf, sizeof(buf));
+	if(_ctx) SSL_CTX_free(_ctx);
+	_ctx = nullptr;
+	throw FixtureServerException(string("Unable to create the TLS context: ") + buf);
+      }
+    }
+
+    /**
+     * @brief Bind the socket and start the accept thread.
+     */
+    auto FixtureServer::start() -> void {
+      if(_running) return;
+      /* the TLS writes to a closed peer must not kill the benchmark */
+      std::signal(SIGPIPE, SIG_IGN);
+      if(_config.tls) newContext();
+      if(!_config.unixPath.empty()) {
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if(_config.unixPath.size() >= sizeof(addr.sun_path))
+	  throw FixtureServerException("Unix socket path too long: " + _config.unixPath);
+	memcpy(addr.sun_path, _config.unixPath.data(), _config.unixPath.size());
+	socklen_t len = offsetof(struct sockaddr_un, sun_path) + _config.unixPath.size();
+	/* '@' selects the abstract namespace */
+	if(addr.sun_path[0] == '@') addr.sun_path[0] = 0;
+	else ::unlink(addr.sun_path);
+	if((_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+	  throw_libc("Cannot create socket: ");
+	if(::bind(_fd, reinterpret_cast<struct sockaddr*>(&addr), len) < 0) {
+	  ::close(_fd);
+	  _fd = -1;
+	  throw_libc("Cannot bind " + _config.unixPath + ": ");
+	}
+      } else {
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(static_cast<uint16_t>(_config.port));
+	if(::inet_pton(AF_INET, _config.address.c_str(), &addr.sin_addr) != 1)
+	  throw FixtureServerException("Invalid address: " + _config.address);
+	if((_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+	  throw_libc("Cannot create socket: ");
+	int on = 1;
+	::setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	/* accept the data of the SYN (TCP Fast Open clients), unless disabled by net.ipv4.tcp_fastopen */
+	int qlen = SOMAXCONN;
+	::setsockopt(_fd, IPPROTO_TCP, TCP_FASTOPEN, &qlen, sizeof(qlen));
+	if(::bind(_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+	  ::close(_fd);
+	  _fd = -1;
+	  throw_libc("Cannot bind " + _config.address + ": ");
+	}
+	socklen_t len = sizeof(addr);
+	::getsockname(_fd, reinterpret_cast<struct sockaddr*>(&addr), &len);
+	_port = ntohs(addr.sin_port);
+      }
+      if(::listen(_fd, SOMAXCONN) < 0 || ::pipe2(_wakeup, O_CLOEXEC) < 0) {
+	::close(_fd);
+	_fd = -1;
+	throw_libc("Cannot listen: ");
+      }
+      _running = true;
+      _acceptor = std::thread(&FixtureServer::acceptLoop, this);
+    }
+
+    /**
+     * @brief Stop the accept thread and wait for the connections.
+     */
+    auto FixtureServer::stop() -> void {
+      if(!_running.exchange(false)) return;
+      if(::write(_wakeup[1], "x", 1) < 0) { }
+      _acceptor.join();
+      {
+	std::unique_lock<std::mutex> lock(_lock);
+	/* wake up the connections blocked on a read */
+	for(int fd : _clients) ::shutdown(fd, SHUT_RDWR);
+	_idle.wait(lock, [this]() { return _clients.empty(); });
+      }
+      ::close(_fd);
+      ::close(_wakeup[0]);
+      ::close(_wakeup[1]);
+      _fd = _wakeup[0] = _wakeup[1] = -1;
+      if(!_config.unixPath.empty() && _config.unixPath[0] != '@')
+	::unlink(_config.unixPath.c_str());
+      if(_ctx) SSL_CTX_free(_ctx);
+      _ctx = nullptr;
+    }
+
+    /**
+     * @brief Accept loop.
+     */
+    auto FixtureServer::acceptLoop() -> void {
+      struct pollfd fds[2] = { { _fd, POLLIN, 0 }, { _wakeup[0], POLLIN, 0 } };
+      while(_running) {
+	if(::poll(fds, 2, -1) < 0 && errno != EINTR) break;
+	if(fds[1].revents) break;
+	if(!(fds[0].revents & POLLIN)) continue;
+	int fd = ::accept4(_fd, nullptr, nullptr, SOCK_CLOEXEC);
+	if(fd < 0) continue;
+	if(_config.unixPath.empty()) {
+	  int on = 1;
+	  ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	}
+	{
+	  std::lock_guard<std::mutex> lock(_lock);
+	  _clients.insert(fd);
+	}
+	std::thread(&FixtureServer::serve, this, fd).detach();
+      }
+    }
+
+    /**
+     * @brief Get the encoded body of a size (cached).
+     * @param mode GZIP or DEFLATE.
+     * @param size The plain body size.
+     * @return The encoded body.
+     */
+    auto FixtureServer::encoded(FixtureMode mode, size_t size) -> const string& {
+      std::lock_guard<std::mutex> lock(_lock);
+      auto key = std::make_pair(mode, size);
+      auto it = _encoded.find(key);
+      if(it == _encoded.end())
+	it = _encoded.emplace(key, GZIP::compress(body(size), mode == FixtureMode::GZIP ? GZIPMethod::GZ : GZIPMethod::DEFLATE, 6)).first;
+      return it->second;
+    }
+
+    /**
+     * @brief Serve the requests of one connection.
+     * @param fd The connection.
+     */
+    auto FixtureServer::serve(int fd) -> void {
+      FixtureStream stream = { fd, nullptr };
+      if(_ctx) {
+	stream.ssl = SSL_new(_ctx);
+	if(stream.ssl) SSL_set_fd(stream.ssl, fd);
+	if(!stream.ssl || SSL_accept(stream.ssl) != 1) {
+	  if(stream.ssl) SSL_free(stream.ssl);
+	  stream.ssl = nullptr;
+	  fd = -1;
+	}
+      }
+      string request;
+      char buffer[0x1000];
+      bool keepAlive = fd != -1;
+      size_t linger = 0;
+      while(keepAlive && _running) {
+	/* read the request headers */
+	size_t end;
+	while((end = request.find("\r\n\r\n")) == string::npos && request.size() < REQUEST_MAX) {
+	  ssize_t r = stream.read(buffer, sizeof(buffer));
+	  if(r <= 0) break;
+	  request.append(buffer, static_cast<size_t>(r));
+	}
+	if(end == string::npos) break;
+	string_view hdr = string_view(request).substr(0, end);
+	string_view line = hdr.substr(0, hdr.find("\r\n"));
+	/* METHOD PATH VERSION */
+	size_t sp1 = line.find(' '), sp2 = line.rfind(' ');
+	string_view path = sp1 == sp2 ? "/" : line.substr(sp1 + 1, sp2 - sp1 - 1);
+	bool headOnly = line.substr(0, sp1) == "HEAD";
+	keepAlive = line.substr(sp2 + 1) == "HTTP/1.1";
+	size_t contentLength = 0;
+	string_view range, ifNoneMatch;
+	for(size_t pos = line.size() + 2; pos < hdr.size();) {
+	  size_t eol = hdr.find("\r\n", pos);
+	  string_view h = hdr.substr(pos, eol == string_view::npos ? string_view::npos : eol - pos);
+	  pos = eol == string_view::npos ? hdr.size() : eol + 2;
+	  size_t colon = h.find(':');
+	  if(colon == string_view::npos) continue;
+	  string_view name = h.substr(0, colon), value = h.substr(colon + 1);
+	  while(!value.empty() && value.front() == ' ') value.remove_prefix(1);
+	  if(iequals(name, "Connection"))
+	    keepAlive = !iequals(value, "close") && (keepAlive || iequals(value, "keep-alive"));
+	  else if(iequals(name, "Content-Length"))
+	    contentLength = parseSize(value, 0);
+	  else if(iequals(name, "Range"))
+	    range = value;
+	  else if(iequals(name, "If-None-Match"))
+	    ifNoneMatch = value;
+	}
+	/* skip the request body */
+	size_t consumed = end + 4 + contentLength;
+	while(request.size() < consumed) {
+	  ssize_t r = stream.read(buffer, sizeof(buffer));
+	  if(r <= 0) { keepAlive = false; break; }
+	  request.append(buffer, static_cast<size_t>(r));
+	}
+	if(request.size() < consumed) break;
+
+	/* select the response from the path */
+	FixtureMode mode = _config.mode;
+	size_t size = _config.size, chunk = _config.chunk;
+	unsigned int delay = _config.delay;
+	bool found = true;
+	{
+	  string_view p = path.substr(0, path.find('?'));
+	  /* absolute-form (http://host/path) */
+	  size_t scheme = p.find("://");
+	  if(scheme != string_view::npos) {
+	    size_t slash = p.find('/', scheme + 3);
+	    p = slash == string_view::npos ? string_view() : p.substr(slash);
+	  }
+	  std::vector<string_view> parts;
+	  while(!p.empty()) {
+	    if(p.front() == '/') { p.remove_prefix(1); continue; }
+	    size_t n = p.find('/');
+	    parts.push_back(p.substr(0, n));
+	    p = n == string_view::npos ? string_view() : p.substr(n);
+	  }
+	  if(!parts.empty()) {
+	    if(parts[0] == "length") mode = FixtureMode::LENGTH;
+	    else if(parts[0] == "chunked") mode = FixtureMode::CHUNKED;
+	    else if(parts[0] == "gzip") mode = FixtureMode::GZIP;
+	    else if(parts[0] == "deflate") mode = FixtureMode::DEFLATE;
+	    else if(parts[0] == "drip") mode = FixtureMode::DRIP;
+	    else found = false;
+	    if(parts.size() > 1) size = parseSize(parts[1], size);
+	    if(parts.size() > 2) chunk = std::max<size_t>(1, parseSize(parts[2], chunk));
+	    if(parts.size() > 3) delay = static_cast<unsigned int>(parseSize(parts[3], delay));
+	  }
+	}
+	/* a single byte range (bytes=first-[last]), length mode only */
+	bool partial = false;
+	size_t first = 0, last = 0;
+	if(found && mode == FixtureMode::LENGTH && range.substr(0, 6) == "bytes=") {
+	  string_view r = range.substr(6);
+	  size_t dash = r.find('-');
+	  if(dash != string_view::npos && dash > 0
+	     && std::from_chars(r.data(), r.data() + dash, first).ec == std::errc()) {
+	    partial = true;
+	    last = size ? size - 1 : 0;
+	    if(dash + 1 < r.size()) {
+	      size_t l;
+	      if(std::from_chars(r.data() + dash + 1, r.data() + r.size(), l).ec == std::errc()) last = std::min(last, l);
+	    }
+	  }
+	}
+	/* validator of the selected body, the query max-age=N adds a lifetime */
+	string validator = "ETag: \"" + std::to_string(static_cast<int>(mode)) + "-" + std::to_string(size) + "\"\r\n";
+	bool notModified = found && !ifNoneMatch.empty() && validator.compare(6, string::npos, string(ifNoneMatch) + "\r\n") == 0;
+	string_view params = path.substr(std::min(path.find('?'), path.size()));
+	size_t query = params.find("max-age=");
+	if(query != string_view::npos) {
+	  size_t maxAge = parseSize(params.substr(query + 8), 0);
+	  validator += "Cache-Control: max-age=" + std::to_string(maxAge) + "\r\n";
+	}
+	/* the query linger=MS delays the close after the last response (slow closing servers) */
+	query = params.find("linger=");
+	if(query != string_view::npos) linger = parseSize(params.substr(query + 7), 0);
+	request.erase(0, consumed);
+	_requests++;
+
+	string head = found ? "HTTP/1.1 200 OK\r\n" : "HTTP/1.1 404 Not Found\r\n";
+	head += "Server: httpu-fixture\r\nContent-Type: application/json\r\n";
+	head += keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+	if(found) head += validator;
+	bool ok;
+	if(!found) {
+	  ok = stream.write(head + "Content-Length: 0\r\n\r\n");
+	} else if(notModified) {
+	  head.replace(9, 6, "304 Not Modified");
+	  ok = stream.write(head + "\r\n");
+	} else if(partial && (first > last || first >= size)) {
+	  ok = stream.write("HTTP/1.1 416 Range Not Satisfiable\r\nServer: httpu-fixture\r\n"
+			    + string(keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n")
+			    + "Content-Range: bytes */" + std::to_string(size) + "\r\nContent-Length: 0\r\n\r\n");
+	} else if(partial) {
+	  head.replace(9, 6, "206 Partial Content");
+	  ok = stream.write(head + "Accept-Ranges: bytes\r\nContent-Range: bytes " + std::to_string(first) + "-"
+			    + std::to_string(last) + "/" + std::to_string(size) + "\r\nContent-Length: "
+			    + std::to_string(last - first + 1) + "\r\n\r\n");
+	  ok = ok && (headOnly || stream.writePattern(first, last - first + 1));
+	} else if(headOnly) {
+	  /* the headers of the GET response, without the body */
+	  if(mode == FixtureMode::CHUNKED)
+	    head += "Transfer-Encoding: chunked\r\n";
+	  else if(mode == FixtureMode::GZIP || mode == FixtureMode::DEFLATE)
+	    head += string("Content-Encoding: ") + (mode == FixtureMode::GZIP ? "gzip" : "deflate")
+	      + "\r\nContent-Length: " + std::to_string(encoded(mode, size).size()) + "\r\n";
+	  else
+	    head += (mode == FixtureMode::LENGTH ? "Accept-Ranges: bytes\r\n" : "") + string("Content-Length: ")
+	      + std::to_string(size) + "\r\n";
+	  ok = stream.write(head + "\r\n");
+	} else if(mode == FixtureMode::CHUNKED) {
+	  ok = stream.write(head + "Transfer-Encoding: chunked\r\n\r\n");
+	  char line[32];
+	  for(size_t off = 0; ok && off < size; off += chunk) {
+	    size_t n = std::min(chunk, size - off);
+	    int l = snprintf(line, sizeof(line), "%zx\r\n", n);
+	    ok = stream.write(line, static_cast<size_t>(l)) && stream.writePattern(off, n) && stream.write("\r\n", 2);
+	  }
+	  ok = ok && stream.write("0\r\n\r\n", 5);
+	} else if(mode == FixtureMode::GZIP || mode == FixtureMode::DEFLATE) {
+	  const string& e = encoded(mode, size);
+	  ok = stream.write(head + "Content-Encoding: " + (mode == FixtureMode::GZIP ? "gzip" : "deflate")
+			    + "\r\nContent-Length: " + std::to_string(e.size()) + "\r\n\r\n") && stream.write(e);
+	} else {
+	  if(mode == FixtureMode::LENGTH) head += "Accept-Ranges: bytes\r\n";
+	  ok = stream.write(head + "Content-Length: " + std::to_string(size) + "\r\n\r\n");
+	  if(mode == FixtureMode::DRIP) {
+	    for(size_t off = 0; ok && off < size && _running; off += chunk) {
+	      if(off) std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+	      ok = stream.writePattern(off, std::min(chunk, size - off));
+	    }
+	  } else
+	    ok = stream.writePattern(0, size);
+	}
+	keepAlive = keepAlive && ok;
+      }
+      if(linger && _running) std::this_thread::sleep_for(std::chrono::milliseconds(linger));
+      if(stream.ssl) {
+	SSL_shutdown(stream.ssl);
+	SSL_free(stream.ssl);
+      }
+      ::shutdown(stream.fd, SHUT_WR);
+      /* closed under the lock, the descriptor cannot be reused by a new client before its removal */
+      std::lock_guard<std::mutex> lock(_lock);
+      _clients.erase(stream.fd);
+      ::close(stream.fd);
+      _idle.notify_all();
+    }
+
+  } /* namespace fixture */
+} /* namespace net */
@@ -0,0 +1,169 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#ifndef __FIXTURESERVER_H__
+#define __FIXTURESERVER_H__
+
+#include <exception>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <set>
+#include <map>
+#include <condition_variable>
+#include <openssl/ssl.h>
+
+namespace net {
+  namespace fixture {
+
+    class FixtureServerException: public std::exception {
+      public:
+	FixtureServerException(std::string msg) : _msg(msg) { }
+	virtual ~FixtureServerException() = default;
+
+	virtual const char* what() const throw() { return _msg.c_str(); }
+      private:
+	std::string _msg;
+    };
+
+    /**
+     * @brief Response framing of the fixture server.
+     */
+    enum class FixtureMode : unsigned char {
+	LENGTH = 0, /* Content-Length */
+	CHUNKED,    /* Transfer-Encoding: chunked */
+	GZIP,       /* Content-Encoding: gzip + Content-Length */
+	DEFLATE,    /* Content-Encoding: deflate + Content-Length */
+	DRIP,       /* Content-Length, written in small blocks with a delay */
+    };
+
+    struct FixtureConfig {
+	/**
+	 * @param address The loopback address to listen on.
+	 * @param port The TCP port (0 for an ephemeral port).
+	 * @param unixPath Listen on this Unix socket instead of TCP (if not empty, '@' for the abstract namespace).
+	 * @param tls Serve TLS with a generated self-signed certificate.
+	 * @param mode The default response framing.
+	 * @param size The default body size.
+	 * @param chunk The default chunk (or drip block) size.
+	 * @param delay The default drip delay in milliseconds.
+	 */
+	std::string address = "127.0.0.1";
+	int port = 0;
+	std::string unixPath;
+	bool tls = false;
+	FixtureMode mode = FixtureMode::LENGTH;
+	std::size_t size = 1024;
+	std::size_t chunk = 0x2000;
+	unsigned int delay = 10;
+    };
+
+    /**
+     * @brief Deterministic HTTP/1.1 server used by the end-to-end benchmarks.
+     * The response is selected by the request path: /<mode>/<size>[/<chunk>[/<delay>]]
+     * with mode in length, chunked, gzip, deflate or drip and the sizes accepting the k, m and g suffixes.
+     * Any other path is served with the defaults of the configuration. HEAD is answered with the headers
+     * of the GET response and the length mode serves a single byte range (206 Partial Content).
+     * Each body has an ETag (honored by If-None-Match) and the query ?max-age=N adds a Cache-Control.
+     * The body is a reproducible JSON-like pattern, streamed so that huge bodies cost no memory.
+     */
+    class FixtureServer {
+      public:
+	FixtureServer(const FixtureConfig& config);
+	virtual ~FixtureServer();
+	FixtureServer(const FixtureServer&) = delete;
+	FixtureServer& operator=(const FixtureServer&) = delete;
+
+	/**
+	 * @brief Bind the socket and start the accept thread.
+	 */
+	auto start() -> void;
+
+	/**
+	 * @brief Stop the accept thread and wait for the connections.
+	 */
+	auto stop() -> void;
+
+	/**
+	 * @brief Get the bound TCP port.
+	 * @return int
+	 */
+	auto port() const -> int;
+
+	/**
+	 * @brief Get the host value usable by the client (address:port/).
+	 * @return std::string
+	 */
+	auto host() const -> std::string;
+
+	/**
+	 * @brief Get the number of served requests.
+	 * @return std::size_t
+	 */
+	auto requests() const -> std::size_t;
+
+	/**
+	 * @brief Get the reproducible body of a given size (as sent in length mode).
+	 * @param size The body size.
+	 * @return std::string
+	 */
+	static auto body(std::size_t size) -> std::string;
+
+	/**
+	 * @brief Parse a size with an optional k, m or g suffix.
+	 * @param s The value.
+	 * @param def The default value (returned if the value is invalid).
+	 * @return The size.
+	 */
+	static auto parseSize(std::string_view s, std::size_t def) -> std::size_t;
+
+      private:
+	FixtureConfig _config;
+	int _fd;
+	int _wakeup[2];
+	int _port;
+	SSL_CTX* _ctx;
+	std::thread _acceptor;
+	std::mutex _lock;
+	std::condition_variable _idle;
+	std::set<int> _clients;
+	std::map<std::pair<FixtureMode, std::size_t>, std::string> _encoded;
+	std::atomic<std::size_t> _requests;
+	std::atomic<bool> _running;
+
+	/**
+	 * @brief Create the TLS context with a generated self-signed certificate.
+	 */
+	auto newContext() -> void;
+
+	/**
+	 * @brief Accept loop.
+	 */
+	auto acceptLoop() -> void;
+
+	/**
+	 * @brief Serve the requests of one connection.
+	 * @param fd The connection.
+	 */
+	auto serve(int fd) -> void;
+
+	/**
+	 * @brief Get the encoded body of a size (cached).
+	 * @param mode GZIP or DEFLATE.
+	 * @param size The plain body size.
+	 * @return The encoded body.
+	 */
+	auto encoded(FixtureMode mode, std::size_t size) -> const std::string&;
+    };
+
+  } /* namespace fixture */
+} /* namespace net */
+
+#endif /* __FIXTURESERVER_H__ */
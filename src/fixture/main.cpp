@@ -0,0 +1,105 @@
+/**
+*******************************************************************************
+* <p><b>Project httpu</b><br/>
+* </p>
+* @author Keidan
+*
+*******************************************************************************
+*/
+#include <iostream>
+#include <csignal>
+#include <cstring>
+#include <algorithm>
+#include <getopt.h>
+#include <unistd.h>
+#include "FixtureServer.hpp"
+
+using namespace net::fixture;
+
+static const struct option long_options[] = {
+  { "help",    0, NULL, 'h' },
+  { "address", 1, NULL, 'a' },
+  { "port",    1, NULL, 'p' },
+  { "unix",    1, NULL, 'u' },
+  { "tls",     0, NULL, 's' },
+  { "mode",    1, NULL, 'm' },
+  { "size",    1, NULL, 'l' },
+  { "chunk",   1, NULL, 'c' },
+  { "delay",   1, NULL, 'd' },
+  { NULL,      0, NULL,  0  },
+};
+
+static volatile sig_atomic_t running = 1;
+
+static auto signal_hook(int s) -> void {
+  (void)s;
+  running = 0;
+}
+
+static auto usage(int xcode) -> void {
+  std::cout << "usage: httpu_fixture.elf [options]" << std::endl;
+  std::cout << "\t--help, -h: Print this help." << std::endl;
+  std::cout << "\t--address, -a: The loopback address (default 127.0.0.1)." << std::endl;
+  std::cout << "\t--port, -p: The TCP port (default ephemeral)." << std::endl;
+  std::cout << "\t--unix, -u: Listen on a Unix socket ('@name' for the abstract namespace)." << std::endl;
+  std::cout << "\t--tls, -s: Serve TLS with a generated self-signed certificate." << std::endl;
+  std::cout << "\t--mode, -m: Default framing: length, chunked, gzip, deflate or drip." << std::endl;
+  std::cout << "\t--size, -l: Default body size (k, m and g suffixes)." << std::endl;
+  std::cout << "\t--chunk, -c: Default chunk or drip block size." << std::endl;
+  std::cout << "\t--delay, -d: Default drip delay in milliseconds." << std::endl;
+  std::cout << "The path /<mode>/<size>[/<chunk>[/<delay>]] overrides the defaults per request." << std::endl;
+  std::cout << "The query ?max-age=<seconds> adds Cache-Control, ?linger=<ms> delays the close of the connection (use & to combine)." << std::endl;
+  exit(xcode);
+}
+
+auto main(int argc, char** argv) -> int {
+  FixtureConfig config;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "ha:p:u:sm:l:c:d:", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'h': usage(0); break;
+      case 'a': config.address = optarg; break;
+      case 'p': config.port = atoi(optarg); break;
+      case 'u': config.unixPath = optarg; break;
+      case 's': config.tls = true; break;
+      case 'm': {
+	std::string m(optarg);
+	if(m == "length") config.mode = FixtureMode::LENGTH;
+	else if(m == "chunked") config.mode = FixtureMode::CHUNKED;
+	else if(m == "gzip") config.mode = FixtureMode::GZIP;
+	else if(m == "deflate") config.mode = FixtureMode::DEFLATE;
+	else if(m == "drip") config.mode = FixtureMode::DRIP;
+	else {
+	  std::cerr << "Invalid mode: " << optarg << std::endl;
+	  usage(1);
+	}
+	break;
+      }
+      case 'l': config.size = FixtureServer::parseSize(optarg, config.size); break;
+      case 'c': config.chunk = std::max<std::size_t>(1, FixtureServer::parseSize(optarg, config.chunk)); break;
+      case 'd': config.delay = static_cast<unsigned int>(atoi(optarg)); break;
+      default: usage(1); break;
+    }
+  }
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(struct sigaction));
+  sa.sa_handler = &signal_hook;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  FixtureServer server(config);
+  try {
+    server.start();
+  } catch(const FixtureServerException& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  if(config.unixPath.empty())
+    std::cout << "Listening on " << (config.tls ? "https://" : "http://") << server.host() << std::endl;
+  else
+    std::cout << "Listening on " << config.unixPath << (config.tls ? " (TLS)" : "") << std::endl;
+  while(running) pause();
+  server.stop();
+  std::cout << server.requests() << " requests served." << std::endl;
+  return 0;
+}
@@ -13,10 +13,19 @@
 #include <getopt.h>
 #include <unistd.h>
 #include <streambuf>
+#include <optional>
 
 #include <sys/types.h>
 #include "HttpClient.hpp" 
 #include "Helper.hpp" 
+#include "SSLMemPool.hpp"
+#include "SlabPool.hpp"
+#include "LoadRunner.hpp"
+#include "Downloader.hpp"
+#include "Prober.hpp"
+#include "PerfCounters.hpp"
+#include "Trace.hpp"
+#include "Uring.hpp"
 
 
 using std::cerr;
@@ -36,6 +45,8 @@ using helper::APPNAME;
 
 static HttpClient client(APPNAME);
 static std::ifstream is_params;
+static bool quiet = false;
+static bool ssl_loaded = false;
 
 static const struct option long_options[] = { 
     { "help"        , 0, NULL, 'h' },
@@ -54,6 +65,38 @@ static const struct option long_options[] = {
     { "form"        , 0, NULL, '8' },
     { "multipart"   , 1, NULL, '9' },
     { "multiparts"  , 1, NULL, 'A' },
+    { "ssl-pool"    , 0, NULL, 'B' },
+    { "low-memory"  , 0, NULL, 'C' },
+    { "memory-budget", 1, NULL, 'D' },
+    { "write-out"   , 1, NULL, 'E' },
+    { "json"        , 0, NULL, 'F' },
+    { "rate"        , 1, NULL, 'G' },
+    { "duration"    , 1, NULL, 'H' },
+    { "connections" , 1, NULL, 'I' },
+    { "histogram"   , 1, NULL, 'J' },
+    { "interval"    , 1, NULL, 'K' },
+    { "stats"       , 1, NULL, 'L' },
+    { "perf"        , 0, NULL, 'M' },
+    { "trace"       , 1, NULL, 'N' },
+    { "tcp-info"    , 0, NULL, 'O' },
+    { "timestamps"  , 0, NULL, 'P' },
+    { "io-uring"    , 0, NULL, 'Q' },
+    { "download"    , 1, NULL, 'R' },
+    { "cache"       , 1, NULL, 'S' },
+    { "output"      , 1, NULL, 'T' },
+    { "output-mode" , 1, NULL, 'U' },
+    { "low-latency" , 0, NULL, 'V' },
+    { "sndbuf"      , 1, NULL, 'W' },
+    { "rcvbuf"      , 1, NULL, 'X' },
+    { "busy-poll"   , 1, NULL, 'Y' },
+    { "cpu"         , 1, NULL, 'Z' },
+    { "unix-socket" , 1, NULL, 'u' },
+    { "probe"       , 1, NULL, 'a' },
+    { "probe-get"   , 0, NULL, 'b' },
+    { "probe-header", 1, NULL, 'c' },
+    { "per-host"    , 1, NULL, 'd' },
+    { "no-keep-alive", 0, NULL, 'e' },
+    { "threads"     , 1, NULL, 'f' },
     { NULL          , 0, NULL,  0  } 
 };
 
@@ -63,9 +106,10 @@ auto signal_hook(int s) -> void {
 }
 
 auto shutdown_hook() -> void {
-  if(client.ssl()) net::EasySocket::unloadSSL();
+  if(ssl_loaded) net::EasySocket::unloadSSL();
+  if(net::SSLMemPool::installed()) net::SSLMemPool::report(cout);
   if(is_params.is_open()) is_params.close();
-  cout << "Bye bye." << endl;
+  if(!quiet) cout << "Bye bye." << endl;
 }
 
 auto usage(int err) -> void {
@@ -97,6 +141,42 @@ auto usage(int err) -> void {
   cout << "\t--uexcept: The list of characters that are not encoded in URL format." << endl;
   cout << "\t--multipart: Add new header to the query multipart(format key=value)." << endl;
   cout << "\t--multiparts: A file with the headers." << endl;
+  cout << "\t--ssl-pool: Route the OpenSSL allocations through per-thread pools and print their usage." << endl;
+  cout << "\t--low-memory: Shared SSL context with resumed sessions, OpenSSL buffers released while idle, TLS records received through per-thread slabs and the response buffers released between the requests (the idle keep-alive connections of a load only hold their socket and TLS state)." << endl;
+  cout << "\t--memory-budget: The per-connection memory budget in bytes: the memory in use (buffered response, receive and TLS buffers), a body streamed by --output or --download only holds the receive buffer." << endl;
+  cout << "\t--write-out: Prints the request information after the response using a curl -w like format." << endl;
+  cout << "\t\t%{time_namelookup}, %{time_connect}, %{time_appconnect}, %{time_pretransfer}, %{time_written}," << endl;
+  cout << "\t\t%{time_starttransfer}, %{time_headers}, %{time_body}, %{time_decompress}, %{time_total} (seconds since the start)," << endl;
+  cout << "\t\t%{http_code}, %{size_header}, %{size_download}, %{size_plain}, %{url_effective} and %{json}." << endl;
+  cout << "\t\tWith --low-latency, time_connect is the return of a Fast Open connect (about 0): the TCP handshake is counted in time_appconnect with TLS, else in time_starttransfer." << endl;
+  cout << "\t--json: Prints the request information in JSON (same as --write-out '%{json}\\n')." << endl;
+  cout << "\t--rate: Open-loop load mode, sends the requests at this constant rate (requests per second)." << endl;
+  cout << "\t--duration: Duration of the load in seconds (default 10)." << endl;
+  cout << "\t--connections: Number of keep-alive connections of the load (default 1) or of ranges of the download (default 4)." << endl;
+  cout << "\t--threads: Number of worker threads of the load, each one owns a share of the connections and watches the idle ones with epoll (default one per connection, at most 64)." << endl;
+  cout << "\t--no-keep-alive: Send Connection: close, each request then uses a new connection." << endl;
+  cout << "\t--histogram: Export the full latency histogram of the load to this file (HdrHistogram percentile format, ms)." << endl;
+  cout << "\t--interval: Prints the live statistics of the load every N seconds." << endl;
+  cout << "\t--stats: Write the live statistics to this file instead of stdout (CSV if the name ends with .csv, JSON lines else)." << endl;
+  cout << "\t--perf: Count the CPU cycles, instructions, cache misses, context switches and CPU time of each phase (perf_event_open)." << endl;
+  cout << "\t--trace: Write the connect, handshake, write, wait, read and decode spans of each connection to this file (Chrome trace-event JSON, for Perfetto)." << endl;
+  cout << "\t--tcp-info: Sample TCP_INFO after the connect, at the first byte and at the close (RTT, retransmits, cwnd, delivery rate, bytes acked)." << endl;
+  cout << "\t--timestamps: Kernel RX/TX timestamping (SO_TIMESTAMPING), separates the network and server time from the client own delays." << endl;
+  cout << "\t--io-uring: Use io_uring for the socket I/O (fixed files, registered buffers, multishot receive, TLS through memory BIOs), falls back on read/write if unavailable." << endl;
+  cout << "\t--download: Download the body into this file, in parallel byte ranges (--connections) written in place, resumed from the journal file.journal after an interruption." << endl;
+  cout << "\t--cache: Cache the GET responses in this directory (Cache-Control, max-age, ETag and Last-Modified), fresh hits need no network and stale ones are revalidated." << endl;
+  cout << "\t--output: Write the decoded body to this file instead of printing it (streamed when not chunked nor compressed)." << endl;
+  cout << "\t--output-mode: Write path of --output: mmap (default, sized from Content-Length) or direct (O_DIRECT with double buffering)." << endl;
+  cout << "\t--low-latency: Low-latency socket profile: TCP Fast Open (the request or the ClientHello goes with the SYN to the known servers), TCP_NODELAY and TCP_QUICKACK (the connect phase then no longer includes the TCP handshake)." << endl;
+  cout << "\t--sndbuf: Socket send buffer size in bytes (SO_SNDBUF)." << endl;
+  cout << "\t--rcvbuf: Socket receive buffer size in bytes (SO_RCVBUF), set before the connect to size the window scale." << endl;
+  cout << "\t--busy-poll: Busy-poll budget in microseconds: SO_BUSY_POLL, SO_PREFER_BUSY_POLL and non-blocking reads spinning before parking in the kernel (the read/write backend only, use with --cpu)." << endl;
+  cout << "\t--unix-socket, -u: Connect to this Unix socket instead of the host, which still names the Host header ('@name' for the abstract namespace)." << endl;
+  cout << "\t--probe: Headers-only sweep of the URLs of this file (one per line, http:// or https://), prints the status, the time and the URL of each one as it completes." << endl;
+  cout << "\t--probe-get: Probe with a GET reset once the headers are received instead of a HEAD." << endl;
+  cout << "\t--probe-header: Prints this response header on the probe lines (repeatable)." << endl;
+  cout << "\t--per-host: Maximum concurrent probes of the same host (default 6), --connections sets the total (default 64)." << endl;
+  cout << "\t--cpu: Pin httpu on this core, the workers of the load on the next allowed cores (wrapping around the cpuset)." << endl;
   exit(err);
 }
 
@@ -116,15 +196,35 @@ auto readFile(const char* filename) -> string {
   return content;
 }
 
+/**
+ * @brief Write the trace, whatever the outcome of the requests (the failed ones are the interesting ones).
+ * @param path The trace file (empty if the tracing is disabled).
+ */
+auto writeTrace(const string& path) -> void {
+  if(!path.empty() && !net::Trace::write(path))
+    cerr << "Unable to write the trace " << path << endl;
+}
+
 int  main(int argc, char** argv) {
   HttpClientConnect cnx;
   struct sigaction sa;
   bool print_hdr = false;
+  string write_out;
+  string histogram_file, trace_file;
+  net::http::LoadConfig load = { 0.0, 10.0, 0, "", 0.0, "", -1, 0 };
+  string download_file;
+  net::http::ProbeConfig probe = { "", 0, 0, false, {} };
+  std::optional<net::http::HttpCache> cache;
+  string output_file;
+  net::SinkMode output_mode = net::SinkMode::MMAP;
+  net::SocketProfile profile = net::DEFAULT_PROFILE;
   cnx.method = "GET";
   cnx.host = cnx.uexcept = "";
-  cnx.gzip = cnx.ssl = cnx.urlencode = cnx.isform = cnx.print_query = cnx.print_hex = cnx.print_chunk = false;
+  cnx.gzip = cnx.ssl = cnx.urlencode = cnx.isform = cnx.print_query = cnx.print_hex = cnx.print_chunk = cnx.print_raw_resp = false;
   cnx.is_params = &is_params;
   cnx.print_nothing = false;
+  cnx.memory_budget = 0;
+  cnx.keep_alive = true;
 
   memset(&sa, 0, sizeof(struct sigaction));
   sa.sa_handler = &signal_hook;
@@ -134,7 +234,7 @@ int  main(int argc, char** argv) {
 
 
   int opt;
-  while ((opt = getopt_long(argc, argv, "hv:0:sm:1:2:3:g4:5:67:89:A:", long_options, NULL)) != -1) {
+  while ((opt = getopt_long(argc, argv, "hv:0:sm:1:2:3:g4:5:67:89:A:BCD:E:FG:H:I:J:K:L:MN:OPQR:S:T:U:VW:X:Y:Z:u:a:bc:d:ef:", long_options, NULL)) != -1) {
     switch (opt) {
       case 'h': usage(0); break;
       case 'v': {
@@ -193,6 +293,7 @@ int  main(int argc, char** argv) {
 	break;
       }
       case '4': /* is_params */
+	load.paramsFile = string(optarg);
 	is_params.open(optarg, std::ios::binary | std::ios::ate);
 	if(!is_params.is_open()) {
 	  cerr << "Unable to open the file " << optarg << endl;
@@ -240,19 +341,154 @@ int  main(int argc, char** argv) {
 	}
 	break;
       }
+      case 'B': /* ssl-pool */
+	if(!net::SSLMemPool::install()) {
+	  cerr << "Unable to install the OpenSSL memory pools" << endl;
+	  exit(1);
+	}
+	break;
+      case 'C': net::EasySocket::lowMemory(true); break;
+      case 'D': cnx.memory_budget = std::strtoul(optarg, NULL, 10); break;
+      case 'E': write_out = string(optarg); break;
+      case 'F': write_out = "%{json}\\n"; break;
+      case 'G': load.rate = std::strtod(optarg, NULL); break;
+      case 'H': load.duration = std::strtod(optarg, NULL); break;
+      case 'I': load.connections = static_cast<unsigned int>(std::strtoul(optarg, NULL, 10)); break;
+      case 'J': histogram_file = string(optarg); break;
+      case 'K': load.interval = std::strtod(optarg, NULL); break;
+      case 'L': load.statsFile = string(optarg); break;
+      case 'M': net::PerfCounters::enable(true); break;
+      case 'N': trace_file = string(optarg); net::Trace::enable(); break;
+      case 'O': net::EasySocket::tcpInfo(true); break;
+      case 'P': net::EasySocket::timestamping(true); break;
+      case 'Q':
+	net::EasySocket::ioBackend(net::IoBackend::URING);
+	if(!net::Uring::available())
+	  cerr << "io_uring is unavailable, the read/write system calls are used." << endl;
+	break;
+      case 'R': download_file = string(optarg); break;
+      case 'S':
+	try {
+	  cache.emplace(string(optarg));
+	} catch (std::exception& e)  {
+	  cerr << e.what() << endl;
+	  exit(1);
+	}
+	client.cache(&*cache);
+	break;
+      case 'T': output_file = string(optarg); break;
+      case 'U': {
+	string mode(optarg);
+	if(mode == "mmap")
+	  output_mode = net::SinkMode::MMAP;
+	else if(mode == "direct")
+	  output_mode = net::SinkMode::DIRECT;
+	else {
+	  cerr << "Invalid output mode: " << optarg << endl;
+	  usage(1);
+	}
+	break;
+      }
+      case 'V': {
+	/* the buffers and the busy poll keep their own options */
+	net::SocketProfile tuned = profile;
+	profile = net::LOW_LATENCY_PROFILE;
+	profile.sendBuffer = tuned.sendBuffer;
+	profile.receiveBuffer = tuned.receiveBuffer;
+	profile.busyPoll = tuned.busyPoll;
+	break;
+      }
+      case 'W': profile.sendBuffer = static_cast<int>(std::strtol(optarg, NULL, 10)); break;
+      case 'X': profile.receiveBuffer = static_cast<int>(std::strtol(optarg, NULL, 10)); break;
+      case 'Y': profile.busyPoll = static_cast<int>(std::strtol(optarg, NULL, 10)); break;
+      case 'Z':
+	load.cpu = static_cast<int>(std::strtol(optarg, NULL, 10));
+	if(load.cpu < 0 || !Helper::pinThread(static_cast<unsigned int>(load.cpu))) {
+	  cerr << "Unable to pin on the core " << optarg << endl;
+	  exit(1);
+	}
+	break;
+      case 'u':
+	if(!net::EasySocket::unixSocket(string(optarg))) {
+	  cerr << "Unix socket path too long: " << optarg << endl;
+	  exit(1);
+	}
+	break;
+      case 'a': probe.urls = string(optarg); break;
+      case 'b': probe.get = true; break;
+      case 'c': probe.fields.push_back(string(optarg)); break;
+      case 'd': probe.perHost = static_cast<unsigned int>(std::strtoul(optarg, NULL, 10)); break;
+      case 'e': cnx.keep_alive = false; break;
+      case 'f': load.threads = static_cast<unsigned int>(std::strtoul(optarg, NULL, 10)); break;
       default: cerr << "Unknown option" << endl; usage(-1); break;
     }
   }
-  if(cnx.ssl && !net::EasySocket::loadSSL()) {
+  net::EasySocket::profile(profile);
+  quiet = cnx.print_nothing;
+  /* the https:// URLs of a probe need TLS */
+  if((cnx.ssl || !probe.urls.empty()) && !net::EasySocket::loadSSL()) {
     cerr << "Unable to load SSL : " << net::EasySocket::lastErrorSSL() << endl;
     exit(1);
   }
+  ssl_loaded = cnx.ssl || !probe.urls.empty();
   if(cnx.method == "GET" && cnx.is_params->is_open()) {
     cerr << "Unable to use the parameters file with GET method" << endl;
     exit(1);
   }
 
-  
+  if(load.rate > 0.0) {
+    try {
+      net::http::LoadRunner runner(APPNAME, cnx, load);
+      runner.run();
+      runner.report(cout);
+      if(net::PerfCounters::enabled())
+	net::PerfCounters::aggregate(cout, runner.latency().count());
+      if(!histogram_file.empty()) {
+	std::ofstream ofs(histogram_file);
+	if(!ofs.is_open()) {
+	  cerr << "Unable to open the file " << histogram_file << endl;
+	  exit(1);
+	}
+	runner.latency().exportDistribution(ofs, 1e6);
+      }
+    } catch (std::exception& e)  {
+      cerr << e.what() << endl;
+    }
+    writeTrace(trace_file);
+    return 0;
+  }
+
+  net::Trace::track(0, "main");
+  if(!probe.urls.empty()) {
+    try {
+      probe.connections = load.connections;
+      net::http::Prober prober(APPNAME, cnx, probe);
+      prober.run(cout);
+      if(!cnx.print_nothing) prober.report(cout);
+    } catch (std::exception& e)  {
+      cerr << e.what() << endl;
+    }
+    writeTrace(trace_file);
+    return 0;
+  }
+
+  if(!download_file.empty()) {
+    try {
+      net::http::Downloader downloader(APPNAME, cnx, { download_file, load.connections });
+      downloader.run();
+      if(!cnx.print_nothing) downloader.report(cout);
+    } catch (std::exception& e)  {
+      cerr << e.what() << endl;
+    }
+    writeTrace(trace_file);
+    return 0;
+  }
+
+  std::optional<net::FileSink> sink;
+  if(!output_file.empty()) {
+    sink.emplace(output_file, output_mode);
+    client.sink(&*sink);
+  }
   try {
     client.connect(cnx);
    
@@ -260,28 +496,56 @@ int  main(int argc, char** argv) {
     HttpHeader& hdr = client.getHttpHeader();
  
     /* test support of gzip content */
-    string& plain = client.getPlainText();
+    std::string_view plain = client.body();
 
-    /* print the respponse informations*/
-    cout << "Response code " << hdr.code() << ", reason: '" << hdr.reason() << "'" << endl;
-    if(print_hdr) {
-      cout << "List of headers (length: " << Helper::toHumanStringSize(hdr.length()) << "):" << endl;
-      helper::vstring hkeys = hdr.keys();
-      for(helper::vstring::const_iterator it = hkeys.begin(); it != hkeys.end(); ++it) {
-	string key = (*it);
-	helper::vstring values = hdr.get(key);
-	for(helper::vstring::const_iterator jt = values.begin(); jt != values.end(); ++jt) {
-	  cout << " - " << key << ": " << (*jt) << endl;
+    {
+      net::PerfScope perf(net::PerfPhase::OUTPUT);
+      /* print the respponse informations*/
+      if(!cnx.print_nothing)
+	cout << "Response code " << hdr.code() << ", reason: '" << hdr.reason() << "'" << endl;
+      if(print_hdr) {
+	cout << "List of headers (length: " << Helper::toHumanStringSize(hdr.length()) << "):" << endl;
+	for(std::string_view key : hdr.keys()) {
+	  for(std::string_view value : hdr.get(key))
+	    cout << " - " << key << ": " << value << endl;
 	}
       }
+      if(net::EasySocket::lowMemory() || cnx.memory_budget) {
+	cout << "Connection memory peak: " << Helper::toHumanStringSize(client.memoryPeak());
+	if(cnx.memory_budget) cout << " (budget " << Helper::toHumanStringSize(cnx.memory_budget) << ")";
+	cout << endl;
+	if(net::EasySocket::lowMemory()) net::SlabPool::report(cout);
+      }
+      if(net::EasySocket::tcpInfo()) {
+	net::TcpSample tcp[net::TCP_POINTS];
+	for(std::size_t p = 0; p < net::TCP_POINTS; ++p)
+	  tcp[p] = client.tcpInfo(static_cast<net::TcpPoint>(p));
+	net::TcpInfo::report(cout, tcp);
+      }
+      if(net::EasySocket::timestamping())
+	net::Timestamping::report(cout, client.stamps());
+      if(cache && !cnx.print_nothing) {
+	static const char* status[] = { "not cacheable", "miss", "hit", "revalidated (304)" };
+	cout << "Cache: " << status[static_cast<std::size_t>(client.cacheStatus())] << endl;
+      }
+      if(!cnx.print_nothing && sink) {
+	cout << "Body written to " << sink->path() << ": " << Helper::toHumanStringSize(sink->written())
+	     << " (" << sink->method() << ")" << endl;
+      } else if(!cnx.print_nothing) {
+	cout << "Body length: " << Helper::toHumanStringSize(plain.size()) << endl;
+	if(!plain.empty())
+	  cout << "=====" << plain << "=====" << endl;
+      }
+      if(!write_out.empty())
+	client.writeOut(cout, write_out);
     }
-    cout << "Body length: " << Helper::toHumanStringSize(plain.size()) << endl;
-    if(!plain.empty())
-      cout << "=====" << plain << "=====" << endl;
+    if(net::PerfCounters::enabled())
+      net::PerfCounters::thread().report(cout);
    
     //cout << endl << endl;
   } catch (std::exception& e)  {
     cerr << e.what() << endl;
   }
+  writeTrace(trace_file);
   return 0;
 }